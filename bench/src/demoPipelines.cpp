@@ -0,0 +1,482 @@
+#include "demoPipelines.h"
+#include "rgbaPack.h"
+#include "alignedMemory.h"
+#include "depthConversion.h"
+#include "regionSegmenter.h"
+#include "blobTracker.h"
+#include "eventSink.h"
+#include "gestureRules.h"
+#include "pointCloud.h"
+#include "depthReprojector.h"
+#include "headTracker.h"
+
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+//--------------------------------------------------------------
+demoPipeline::demoPipeline(const std::string & name) : name(name), total("total"),
+	segmenter(subtractor.getSegmenter()), background(subtractor.getBackground()) {
+	source = NULL;
+	pool = NULL;
+	width = 0;
+	height = 0;
+	dirty = 0;
+	dirtyTiles = 0;
+	totalTiles = 0;
+	checkedPixels = 0;
+	labelledPixels = 0;
+	frames = 0;
+	bytesCopied = 0;
+	bytesShared = 0;
+	colorPixels = NULL;
+
+	// the color image doesn't need anything else, the depth goes through
+	// the noise filter and then the background model
+	captureStage = graph.addStage("capture", this, &demoPipeline::captureFrame);
+	denoiseStage = graph.addStage("denoise", this, &demoPipeline::denoise);
+	backgroundStage = graph.addStage("background", this, &demoPipeline::updateBackground, denoiseStage);
+	// every sample, for the exact percentiles (a run is only so long)
+	graph.setSampling(true);
+}
+
+//--------------------------------------------------------------
+void demoPipeline::setPool(threadPool * pool) {
+	this->pool = pool;
+	graph.setup(pool);
+	subtractor.setPool(pool);
+}
+
+//--------------------------------------------------------------
+void demoPipeline::setup(frameSource & source) {
+	width = source.getWidth();
+	height = source.getHeight();
+	colorImg = buffers.acquire(width*height*3);
+	grayDiff = buffers.acquire(width*height);
+	memset(colorImg.write(), 0, width*height*3);
+	memset(grayDiff.write(), 0, width*height);
+
+	subtractor.setup(width, height);
+	labeller.setup(width, height);
+	windows.setup(width, height);
+	registration.setup(width, height);
+	this->source = &source;
+	captureFrame();
+	subtractor.learnBackground();
+	subtractor.update(source.getRawDepthPixels());
+	// nothing has been masked against the new background yet
+	subtractor.invalidate();
+}
+
+//--------------------------------------------------------------
+void demoPipeline::process(frameSource & source) {
+	this->source = &source;
+	unsigned long long copied = buffers.getBytesCopied();
+	unsigned long long shared = buffers.getBytesShared();
+	{
+		stageTimer all(total);
+		graph.run();
+		// draw() keeps up, so it picks up every frame
+		handOver(shown.getWriteBuffer());
+		shown.publish();
+		shown.update();
+	}
+	bytesCopied += buffers.getBytesCopied() - copied;
+	bytesShared += buffers.getBytesShared() - shared;
+	frames++;
+}
+
+//--------------------------------------------------------------
+void demoPipeline::handOver(shownFrame & frame) {
+	frame.color = colorImg;
+	frame.mask = grayDiff;
+}
+
+//--------------------------------------------------------------
+backgroundSubtractor & demoPipeline::getSubtractor() {
+	return subtractor;
+}
+
+//--------------------------------------------------------------
+blobPyramid & demoPipeline::getLabeller() {
+	return labeller;
+}
+
+//--------------------------------------------------------------
+trackWindows & demoPipeline::getWindows() {
+	return windows;
+}
+
+//--------------------------------------------------------------
+const std::string & demoPipeline::getName() {
+	return name;
+}
+
+//--------------------------------------------------------------
+std::vector<stageStats> & demoPipeline::getStages() {
+	return graph.getStats();
+}
+
+//--------------------------------------------------------------
+stageStats & demoPipeline::getTotal() {
+	return total;
+}
+
+//--------------------------------------------------------------
+double demoPipeline::getDirtyFraction() {
+	return totalTiles > 0 ? (double) dirtyTiles / totalTiles : 0;
+}
+
+//--------------------------------------------------------------
+double demoPipeline::getCheckedPixels() {
+	return frames > 0 ? (double) checkedPixels / frames : 0;
+}
+
+//--------------------------------------------------------------
+double demoPipeline::getLabelledPixels() {
+	return frames > 0 ? (double) labelledPixels / frames : 0;
+}
+
+//--------------------------------------------------------------
+double demoPipeline::getBytesCopied() {
+	return frames > 0 ? (double) bytesCopied / frames : 0;
+}
+
+//--------------------------------------------------------------
+double demoPipeline::getBytesShared() {
+	return frames > 0 ? (double) bytesShared / frames : 0;
+}
+
+//--------------------------------------------------------------
+bool demoPipeline::writeOutput(const std::string & path) {
+	return false;
+}
+
+//--------------------------------------------------------------
+void demoPipeline::clearStats() {
+	graph.clearStats();
+	total.clear();
+	dirtyTiles = 0;
+	totalTiles = 0;
+	checkedPixels = 0;
+	labelledPixels = 0;
+	frames = 0;
+	bytesCopied = 0;
+	bytesShared = 0;
+}
+
+//--------------------------------------------------------------
+void demoPipeline::captureFrame() {
+	// Through the registration, in strips as in the demos. The depth
+	// frame is read straight from the source by denoise(). The demos share
+	// a frame that is already registered with the capture thread's copy,
+	// here it is the one copy out of the source.
+	registration.update();
+	colorPixels = colorImg.overwrite();
+	if (source->isRGBRegistered()) {
+		memcpy(colorPixels, source->getRGBPixels(), width*height*3);
+		buffers.countCopy(width*height*3);
+	} else
+		forStrips(width*3, &demoPipeline::registerStrip);
+}
+
+//--------------------------------------------------------------
+void demoPipeline::registerStrip(int y0, int y1, int thread) {
+	registration.apply(source->getRawDepthPixels(), source->getRGBPixels(), colorPixels, y0, y1);
+}
+
+//--------------------------------------------------------------
+void demoPipeline::denoise() {
+	// segmenter.update(), which the demos use in place of
+	// grayImage.dilate(); grayImage.erode();
+	dirty = segmenter.update(source->getRawDepthPixels());
+	dirtyTiles += dirty;
+	totalTiles += segmenter.getTileCount();
+	checkedPixels += segmenter.getCheckedPixels();
+}
+
+//--------------------------------------------------------------
+void demoPipeline::updateBackground() {
+	segmenter.updateBackground(background);
+}
+
+// Time between frames for the trackers. Synthetic frames are made as fast
+// as the pipelines take them, so go by the kinect's 30fps rather than the clock
+#define FRAME_SECONDS (1 / 30.0f)
+
+//--------------------------------------------------------------
+class objmanipPipeline : public demoPipeline {
+
+	public:
+		objmanipPipeline() : demoPipeline("objmanip") {
+			// two hands, with windows on the same grid as the tiles
+			windows.setExpectedTracks(2);
+			windows.setGrid(32);
+			int maskStage = graph.addStage("mask", this, &objmanipPipeline::mask, backgroundStage);
+			int blobStage = graph.addStage("blobs", this, &objmanipPipeline::findBlobs, maskStage);
+			int pointStage = graph.addStage("points", this, &objmanipPipeline::findPoints, blobStage);
+			int trackStage = graph.addStage("tracking", this, &objmanipPipeline::track, blobStage);
+			graph.addStage("blob math", this, &objmanipPipeline::blobMath, trackStage, pointStage);
+			threshold = 2550;
+			blobs.count = 0;
+			potZangle = potYangle = potSize = 0;
+		}
+
+		void setup(frameSource & source) {
+			demoPipeline::setup(source);
+			cloud.setup(width, height);
+		}
+
+	private:
+		// with no dirty tiles the mask and blobs are the same as last frame
+		void mask() {
+			if (dirty > 0)
+				segmenter.mask(background.getLimits(), grayDiff.write(), threshold);
+		}
+
+		// only in the windows around the hands when there are any, which
+		// is all that was masked
+		void findBlobs() {
+			if (dirty == 0)
+				return;
+			if (windows.isFullFrame())
+				labeller.find(grayDiff.read(), blobs, 1000, (width*height)/2, 5, segmenter.getFiltered());
+			else
+				labeller.findInBoxes(grayDiff.read(), blobs, 1000, (width*height)/2, 5, segmenter.getFiltered(),
+									 windows.getX0(), windows.getY0(), windows.getX1(), windows.getY1(), windows.getCount());
+			labelledPixels += labeller.getRefinedPixels();
+		}
+
+		// and the windows for the next frame
+		void track() {
+			tracker.update(blobs, FRAME_SECONDS);
+			windows.update(tracker.getTracks(), blobs, FRAME_SECONDS);
+			windows.apply(segmenter);
+		}
+
+		// the blobs' pixels as points in meters
+		void findPoints() {
+			if (dirty > 0)
+				cloud.update(segmenter.getFiltered(), grayDiff.read(), blobs);
+		}
+
+		void handPosition(int track, float & x, float & y, float & z) {
+			trackList & tracks = tracker.getTracks();
+			if (!cloud.getCentroid(tracks.blob[track], x, y, z))
+				cloud.unproject(tracks.x[track], tracks.y[track], tracks.depth[track], x, y, z);
+		}
+
+		void blobMath() {
+			trackList & tracks = tracker.getTracks();
+			if (tracks.count >= 2) {
+				float x1, y1, z1, x2, y2, z2;
+				handPosition(0, x1, y1, z1);
+				handPosition(1, x2, y2, z2);
+				float dx = fabsf(x2 - x1), dy = x1 < x2 ? y2 - y1 : y1 - y2, dz = x1 < x2 ? z2 - z1 : z1 - z2;
+				potZangle = 180 - atan2f(dy, dx) * 180.0f / 3.14159265f;
+				potYangle = -atan2f(dz, dx) * 180.0f / 3.14159265f;
+				potSize = sqrtf(dx*dx + dy*dy + dz*dz) * 300;
+			}
+		}
+
+		int threshold;
+		blobList blobs;
+		blobTracker tracker;
+		pointCloud cloud;
+		float potZangle, potYangle, potSize;
+};
+
+//--------------------------------------------------------------
+class parallaxPipeline : public demoPipeline {
+
+	public:
+		parallaxPipeline() : demoPipeline("parallax") {
+			// the depth shown on screen only needs the filtered frame, the
+			// reprojection needs the color image and the head (which needs
+			// the mask)
+			graph.addStage("display", this, &parallaxPipeline::display, denoiseStage);
+			int maskStage = graph.addStage("mask", this, &parallaxPipeline::mask, backgroundStage);
+			int headStage = graph.addStage("head", this, &parallaxPipeline::trackHead, maskStage);
+			int reprojectStage = graph.addStage("reproject", this, &parallaxPipeline::reproject, captureStage, headStage);
+			graph.addStage("rgba pack", this, &parallaxPipeline::pack, reprojectStage);
+			threshold = 2900;
+			maskedPixels = NULL;
+			eyeX = eyeY = 0;
+			eyeDir = 1;
+		}
+
+		~parallaxPipeline() {
+			alignedFree(maskedPixels);
+		}
+
+		void setup(frameSource & source) {
+			demoPipeline::setup(source);
+			maskedPixels = (unsigned char *) alignedMalloc(width*height*4);
+			grayImage = buffers.acquire(width*height);
+			grayPixels = NULL;
+			reprojector.setup(width, height);
+			reprojector.setPool(pool);
+			head.setup(width, height);
+		}
+
+		// The packed RGB of the last frame as a binary PPM, the background
+		// (alpha 0) is black
+		bool writeOutput(const std::string & path) {
+			FILE * file = fopen(path.c_str(), "wb");
+			if (file == NULL) {
+				fprintf(stderr, "parallaxPipeline: can't write %s\n", path.c_str());
+				return false;
+			}
+			fprintf(file, "P6\n%d %d\n255\n", width, height);
+			for (int i = 0; i < width*height; i++)
+				fwrite(maskedPixels + i*4, 1, 3, file);
+			fclose(file);
+			return true;
+		}
+
+	private:
+		// both in strips of rows on the pool's threads, as in the demo
+		void display() {
+			grayPixels = grayImage.overwrite();
+			forStrips(width*3, &parallaxPipeline::displayStrip);
+		}
+
+		void displayStrip(int y0, int y1, int thread) {
+			rawDepthToDisplay(segmenter.getFiltered() + y0*width, grayPixels + y0*width, (y1 - y0)*width);
+		}
+
+		void mask() {
+			if (dirty > 0)
+				segmenter.mask(background.getLimits(), grayDiff.write(), threshold);
+		}
+
+		void handOver(shownFrame & frame) {
+			demoPipeline::handOver(frame);
+			frame.second = grayImage;
+		}
+
+		// head tracking is always on, as if 't' had been pressed
+		void trackHead() {
+			head.update(grayDiff.read(), segmenter.getFiltered(), FRAME_SECONDS);
+		}
+
+		// the virtual camera follows the head, or moves back and forth as
+		// in the demo's update() when there isn't one
+		void reproject() {
+			if (head.isTracking()) {
+				eyeX = head.getX() * 1000;
+				eyeY = head.getY() * 1000;
+			} else {
+				eyeX += 20*eyeDir;
+				if (eyeX > 300)
+					eyeDir = -1;
+				else if (eyeX < -300)
+					eyeDir = 1;
+			}
+			reprojector.setViewpoint(eyeX / 1000.0f, eyeY / 1000.0f, threshold / 1000.0f);
+			reprojector.update(segmenter.getFiltered(), grayDiff.read(), colorImg.read());
+		}
+
+		void pack() {
+			forStrips(width*8, &parallaxPipeline::packStrip);
+		}
+
+		void packStrip(int y0, int y1, int thread) {
+			rgbaPack(reprojector.getColor() + y0*width*3, reprojector.getAlpha() + y0*width, maskedPixels + y0*width*4, (y1 - y0)*width);
+		}
+
+		int threshold;
+		// the filtered depth frame as it is shown on screen, and its pixels
+		// while display() fills them in
+		frameBuffer grayImage;
+		unsigned char * grayPixels;
+		unsigned char * maskedPixels;
+		depthReprojector reprojector;
+		headTracker head;
+		float eyeX, eyeY, eyeDir;
+};
+
+//--------------------------------------------------------------
+class mkartPipeline : public demoPipeline {
+
+	public:
+		mkartPipeline() : demoPipeline("mkart") {
+			int regionStage = graph.addStage("mask + blobs", this, &mkartPipeline::findRegions, backgroundStage);
+			int trackStage = graph.addStage("tracking", this, &mkartPipeline::track, regionStage);
+			graph.addStage("steering", this, &mkartPipeline::steer, trackStage);
+			threshold = 3000;
+			keysDown = 0;
+			gestures.parse(GESTURE_RULES_DEFAULT);
+		}
+
+		~mkartPipeline() {
+			keys.stopThread();
+		}
+
+		void setup(frameSource & source) {
+			demoPipeline::setup(source);
+			footDiff = buffers.acquire(width*height);
+			memset(footDiff.write(), 0, width*height);
+			regions.setup(width, height);
+			int footTop = 300 * height / 480;
+			handRegion = regions.addRegion("hands", 0, 0, -1, -1, 0, 2550, 1000, (width*height)/2, 5);
+			footRegion = regions.addRegion("foot", 0, footTop, -1, -1, 0, threshold, 1000, (width*height)/2, 5);
+			// the keys go through the same dispatcher as in the demo, into
+			// a list rather than to the OS
+			keys.setup(&keySink);
+			keys.startThread();
+		}
+
+	private:
+		// the hands' mask is written from scratch, the foot's keeps the
+		// rows above it black, as in the demo
+		void findRegions() {
+			if (dirty > 0) {
+				regions.setMaskOutput(handRegion, grayDiff.overwrite());
+				regions.setMaskOutput(footRegion, footDiff.write());
+				regions.find(segmenter.getFiltered(), background.getLimits());
+			}
+		}
+
+		void handOver(shownFrame & frame) {
+			demoPipeline::handOver(frame);
+			frame.second = footDiff;
+		}
+
+		void track() {
+			tracker.update(regions.getBlobs(handRegion), FRAME_SECONDS);
+		}
+
+		void steer() {
+			float features[GESTURE_FEATURE_COUNT];
+			gestureFeatures(tracker, regions.getBlobs(footRegion).count, 0, features);
+			unsigned int down = gestures.evaluate(features, source->getTimestamp());
+			unsigned int changed = down ^ keysDown;
+			for (int k = 0; k < INPUT_KEY_COUNT; k++){
+				if (changed & (1 << k))
+					keys.post(k, (down & (1 << k)) != 0, source->getTimestamp());
+			}
+			keysDown = down;
+		}
+
+		int threshold;
+		frameBuffer footDiff;
+		regionSegmenter regions;
+		int handRegion, footRegion;
+		blobTracker tracker;
+		gestureRules gestures;
+		unsigned int keysDown;
+		recordingEventSink keySink;
+		eventDispatcher keys;
+};
+
+//--------------------------------------------------------------
+demoPipeline * createDemoPipeline(const std::string & name) {
+	if (name == "objmanip")
+		return new objmanipPipeline();
+	if (name == "parallax")
+		return new parallaxPipeline();
+	if (name == "mkart")
+		return new mkartPipeline();
+	return NULL;
+}
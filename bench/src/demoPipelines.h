@@ -0,0 +1,138 @@
+#ifndef _DEMO_PIPELINES
+#define _DEMO_PIPELINES
+
+#include <string>
+#include <vector>
+
+#include "frameSource.h"
+#include "stageStats.h"
+#include "stageGraph.h"
+#include "backgroundSubtractor.h"
+#include "blobPyramid.h"
+#include "trackWindows.h"
+#include "depthRegistration.h"
+#include "frameBufferPool.h"
+#include "tripleBuffer.h"
+
+// The images a demo hands over to draw() each frame, shared with the
+// processing as in the demos (see frameBufferPool.h)
+struct shownFrame {
+	frameBuffer color;
+	frameBuffer mask;
+	// parallax's depth view, or mkart's foot mask
+	frameBuffer second;
+};
+
+// Each of these reproduces one demo's per frame processing on plain
+// buffers, as a stageGraph of the same stages as the demo, so every stage
+// gets its own stageStats. The openFrameworks/ofxCv calls are replaced by
+// equivalent code so the pipelines run headless.
+class demoPipeline {
+
+	public:
+		demoPipeline(const std::string & name);
+		virtual ~demoPipeline() {}
+
+		// Runs the stages that don't depend on each other, and strips of
+		// the per pixel passes, on the pool's threads. NULL (the default)
+		// runs everything in order on the calling thread.
+		void setPool(threadPool * pool);
+
+		// Allocates the images and captures the background from the
+		// current frame of source (like pressing space in the demos)
+		virtual void setup(frameSource & source);
+		// Runs the stages over the current frame of source
+		void process(frameSource & source);
+
+		// The noise filter and background model, see backgroundSubtractor.h
+		backgroundSubtractor & getSubtractor();
+		// What objmanip finds its blobs with, see blobPyramid.h
+		blobPyramid & getLabeller();
+		// Where objmanip looks for its hands, off by default, see trackWindows.h
+		trackWindows & getWindows();
+
+		const std::string & getName();
+		std::vector<stageStats> & getStages();
+		stageStats & getTotal();
+		// Fraction of the tiles that were recomputed, over all frames
+		double getDirtyFraction();
+		// Pixels checked for changes and labelled per frame, over all frames
+		double getCheckedPixels();
+		double getLabelledPixels();
+		// Bytes of images copied, and shared instead, per frame
+		double getBytesCopied();
+		double getBytesShared();
+		// Clears the stage timings and tile counts
+		void clearStats();
+		// Saves what the last frame produced as an image, if the demo
+		// produces one (only parallax does). Returns false if it didn't.
+		virtual bool writeOutput(const std::string & path);
+
+	protected:
+		// The stages every demo starts with. Stand-in for the ofxCv calls
+		// that aren't in common/src
+		void captureFrame();
+		void registerStrip(int y0, int y1, int thread);
+		// Shares the frame's images with draw(), as at the end of the
+		// demos' stages
+		virtual void handOver(shownFrame & frame);
+		// The noise filter, only over the tiles that changed
+		void denoise();
+		void updateBackground();
+
+		// Runs method over strips of rows on the pool's threads, or over the
+		// whole frame on this one without a pool
+		template <class T>
+		void forStrips(int rowBytes, void (T::*method)(int y0, int y1, int thread)) {
+			T * obj = static_cast<T *>(this);
+			if (pool != NULL)
+				pool->forStrips(height, rowBytes, obj, method);
+			else
+				(obj->*method)(0, height, 0);
+		}
+
+		// declared first, so it outlives every image
+		frameBufferPool buffers;
+		std::string name;
+		stageGraph graph;
+		int captureStage, denoiseStage, backgroundStage;
+		stageStats total;
+		// the frame being processed
+		frameSource * source;
+		threadPool * pool;
+
+		int width;
+		int height;
+		// the demos' chain, with its two halves timed separately through
+		// getSegmenter() and getBackground()
+		backgroundSubtractor subtractor;
+		tileSegmenter & segmenter;
+		backgroundModel & background;
+		blobPyramid labeller;
+		trackWindows windows;
+		// lines the colour image up with the depth, see depthRegistration.h
+		depthRegistration registration;
+		// tiles the noise filter redid this frame, and over all frames
+		int dirty;
+		long long dirtyTiles;
+		long long totalTiles;
+		// pixels checked and labelled over all frames, and the frames
+		long long checkedPixels;
+		long long labelledPixels;
+		long long frames;
+		// and the images' bytes copied and shared over all frames
+		unsigned long long bytesCopied;
+		unsigned long long bytesShared;
+
+		frameBuffer colorImg;
+		frameBuffer grayDiff;
+		// the color image captureFrame() is filling in
+		unsigned char * colorPixels;
+		// what draw() would be showing, picked up as soon as it is handed over
+		tripleBuffer<shownFrame> shown;
+};
+
+// Builds the pipeline for the demo with the given name, or NULL
+demoPipeline * createDemoPipeline(const std::string & name);
+
+#endif
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "demoPipelines.h"
+#include "threadPool.h"
+#include "fileFrameSource.h"
+#include "syntheticFrameSource.h"
+
+//--------------------------------------------------------------
+static void usage() {
+	printf("usage: kinect-bench [options]\n"
+		   "  --demo NAME      objmanip, parallax or mkart (repeatable, default all)\n"
+		   "  --clip FILE      run over a recorded clip instead of synthetic frames\n"
+		   "  --frames N       frames to time per demo (default 300)\n"
+		   "  --warmup N       frames to run before timing (default 10)\n"
+		   "  --kernel WxH     size of the noise filter's kernel (default 3x3)\n"
+		   "  --temporal N     temporal filter deadband in raw steps, 0 is off (default 2)\n"
+		   "  --tolerance N    raw depth change that makes a tile dirty (default 0)\n"
+		   "  --blob-levels N  times objmanip's mask is halved before labelling,\n"
+		   "                   0 labels it at full size (default 1)\n"
+		   "  --roi N          objmanip only filters, masks and labels windows around\n"
+		   "                   the hands, and the whole frame every N frames\n"
+		   "  --threads N      threads on top of the main one, 0 runs every stage\n"
+		   "                   in order on the main one (default one per extra core)\n"
+		   "  --json           print results as json\n"
+		   "  --budget-ms MS   exit with 1 if any demo's p99 frame time is over MS\n"
+		   "  --dump PREFIX    save the last frame's output image to PREFIX<demo>.ppm,\n"
+		   "                   for demos that have one\n");
+}
+
+//--------------------------------------------------------------
+static void printStage(stageStats & s, bool json, bool last) {
+	if (json) {
+		printf("        {\"name\": \"%s\", \"min_us\": %.2f, \"median_us\": %.2f, \"p99_us\": %.2f, \"mean_us\": %.2f}%s\n",
+			   s.getName().c_str(), s.getMin(), s.getMedian(), s.getPercentile(99), s.getMean(), last ? "" : ",");
+	} else {
+		printf("  %-20s %10.1f %10.1f %10.1f %10.1f\n",
+			   s.getName().c_str(), s.getMin(), s.getMedian(), s.getPercentile(99), s.getMean());
+	}
+}
+
+//--------------------------------------------------------------
+int main(int argc, char ** argv) {
+	std::vector<std::string> demos;
+	const char * clip = NULL;
+	int frames = 300;
+	int warmup = 10;
+	int kernelWidth = 3, kernelHeight = 3;
+	int temporal = 2;
+	int tolerance = 0;
+	int blobLevels = 1;
+	int roi = -1;
+	int threads = threadPool::getDefaultThreadCount();
+	bool json = false;
+	double budget = 0;
+	const char * dump = NULL;
+
+	for (int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--demo" && hasValue)
+			demos.push_back(argv[++i]);
+		else if (arg == "--clip" && hasValue)
+			clip = argv[++i];
+		else if (arg == "--frames" && hasValue)
+			frames = atoi(argv[++i]);
+		else if (arg == "--warmup" && hasValue)
+			warmup = atoi(argv[++i]);
+		else if (arg == "--kernel" && hasValue && sscanf(argv[i+1], "%dx%d", &kernelWidth, &kernelHeight) == 2)
+			i++;
+		else if (arg == "--temporal" && hasValue)
+			temporal = atoi(argv[++i]);
+		else if (arg == "--tolerance" && hasValue)
+			tolerance = atoi(argv[++i]);
+		else if (arg == "--blob-levels" && hasValue)
+			blobLevels = atoi(argv[++i]);
+		else if (arg == "--roi" && hasValue)
+			roi = atoi(argv[++i]);
+		else if (arg == "--threads" && hasValue)
+			threads = atoi(argv[++i]);
+		else if (arg == "--json")
+			json = true;
+		else if (arg == "--budget-ms" && hasValue)
+			budget = atof(argv[++i]);
+		else if (arg == "--dump" && hasValue)
+			dump = argv[++i];
+		else {
+			usage();
+			return arg == "--help" ? 0 : 2;
+		}
+	}
+	if (demos.empty()) {
+		demos.push_back("objmanip");
+		demos.push_back("parallax");
+		demos.push_back("mkart");
+	}
+
+	if (json)
+		printf("{\n  \"source\": \"%s\",\n  \"frames\": %d,\n  \"threads\": %d,\n  \"pipelines\": [\n", clip ? clip : "synthetic", frames, threads);
+
+	// one pool for all the demos, like the one each demo keeps for its life
+	threadPool pool;
+	pool.setup(threads);
+
+	bool overBudget = false;
+	for (size_t d = 0; d < demos.size(); d++){
+		demoPipeline * pipeline = createDemoPipeline(demos[d]);
+		if (pipeline == NULL) {
+			fprintf(stderr, "unknown demo %s\n", demos[d].c_str());
+			return 2;
+		}
+		pipeline->setPool(&pool);
+		pipeline->getSubtractor().getSegmenter().setKernel(kernelWidth, kernelHeight);
+		pipeline->getSubtractor().getSegmenter().setTemporal(temporal);
+		pipeline->getSubtractor().getSegmenter().setTolerance(tolerance);
+		pipeline->getLabeller().setLevels(blobLevels);
+		pipeline->getWindows().setEnabled(roi >= 0);
+		pipeline->getWindows().setFullFrameInterval(roi);
+
+		// every demo gets a fresh source, so they all see the same frames
+		fileFrameSource fileSource;
+		syntheticFrameSource syntheticSource;
+		frameSource * source = &syntheticSource;
+		if (clip != NULL) {
+			if (!fileSource.open(clip))
+				return 1;
+			fileSource.setRealtime(false);
+			source = &fileSource;
+		}
+
+		// the first frame is the background
+		source->update();
+		pipeline->setup(*source);
+
+		for (int i = 0; i < warmup + frames; i++){
+			source->update();
+			if (i == warmup)
+				pipeline->clearStats();
+			pipeline->process(*source);
+		}
+
+		if (dump != NULL)
+			pipeline->writeOutput(dump + pipeline->getName() + ".ppm");
+
+		std::vector<stageStats> & stages = pipeline->getStages();
+		stageStats & total = pipeline->getTotal();
+		double fps = total.getTotal() > 0 ? total.getCount() * 1000000.0 / total.getTotal() : 0;
+		if (budget > 0 && total.getPercentile(99) > budget * 1000)
+			overBudget = true;
+
+		if (json) {
+			printf("    {\n      \"name\": \"%s\",\n      \"fps\": %.1f,\n      \"dirty_tiles\": %.3f,\n"
+				   "      \"checked_pixels\": %.0f,\n      \"labelled_pixels\": %.0f,\n"
+				   "      \"bytes_copied\": %.0f,\n      \"bytes_shared\": %.0f,\n      \"stages\": [\n",
+				   pipeline->getName().c_str(), fps, pipeline->getDirtyFraction(), pipeline->getCheckedPixels(), pipeline->getLabelledPixels(),
+				   pipeline->getBytesCopied(), pipeline->getBytesShared());
+			for (size_t s = 0; s < stages.size(); s++)
+				printStage(stages[s], true, false);
+			printStage(total, true, true);
+			printf("      ]\n    }%s\n", d + 1 < demos.size() ? "," : "");
+		} else {
+			printf("%s (%d frames, %.1f fps, %.0f%% of tiles dirty, %d threads)\n", pipeline->getName().c_str(), total.getCount(), fps,
+				   pipeline->getDirtyFraction() * 100, threads + 1);
+			// only objmanip's labelling is counted
+			if (pipeline->getLabelledPixels() > 0)
+				printf("  %.0f pixels checked and %.0f labelled per frame\n", pipeline->getCheckedPixels(), pipeline->getLabelledPixels());
+			else
+				printf("  %.0f pixels checked per frame\n", pipeline->getCheckedPixels());
+			printf("  %.0f bytes of images copied and %.0f shared per frame\n", pipeline->getBytesCopied(), pipeline->getBytesShared());
+			printf("  %-20s %10s %10s %10s %10s\n", "stage (us)", "min", "median", "p99", "mean");
+			for (size_t s = 0; s < stages.size(); s++)
+				printStage(stages[s], false, false);
+			printStage(total, false, true);
+			printf("\n");
+		}
+
+		delete pipeline;
+	}
+
+	if (json)
+		printf("  ]\n}\n");
+
+	if (overBudget) {
+		fprintf(stderr, "p99 frame time is over the %.2f ms budget\n", budget);
+		return 1;
+	}
+	return 0;
+}
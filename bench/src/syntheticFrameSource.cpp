@@ -0,0 +1,99 @@
+#include "syntheticFrameSource.h"
+#include "timer.h"
+#include "depthConversion.h"
+
+#include <math.h>
+
+//--------------------------------------------------------------
+syntheticFrameSource::syntheticFrameSource(int width, int height)
+	: width(width), height(height), depth(width*height), rawDepth(width*height), rgb(width*height*3) {
+	frame = -1;
+	seed = 1;
+	timestamp = 0;
+}
+
+//--------------------------------------------------------------
+void syntheticFrameSource::drawBlob(float cx, float cy, float rx, float ry, float millimeters) {
+	unsigned short value = millimetersToRawDepth(millimeters);
+	int x0 = (int) (cx - rx), x1 = (int) (cx + rx);
+	int y0 = (int) (cy - ry), y1 = (int) (cy + ry);
+	for (int y = y0 < 0 ? 0 : y0; y <= y1 && y < height; y++){
+		for (int x = x0 < 0 ? 0 : x0; x <= x1 && x < width; x++){
+			float dx = (x - cx) / rx;
+			float dy = (y - cy) / ry;
+			if (dx*dx + dy*dy <= 1)
+				rawDepth[y*width + x] = value;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+bool syntheticFrameSource::update() {
+	frame++;
+	timestamp = timerMicros();
+
+	// back wall 3.8m away, coming to 3.3m towards the bottom (the floor),
+	// with a raw step of sensor flicker either way
+	for (int y = 0; y < height; y++){
+		unsigned short wall = millimetersToRawDepth(3800 - 500.0f * y / height);
+		for (int x = 0; x < width; x++){
+			seed = seed * 1103515245 + 12345;
+			rawDepth[y*width + x] = wall + ((seed >> 16) % 3) - 1;
+		}
+	}
+
+	if (frame > 0) {
+		// two hands on a steering wheel, turning back and forth
+		float angle = 0.6f * sinf(frame * 0.05f);
+		float cx = width * 0.5f, cy = height * 0.4f, r = width * 0.18f;
+		drawBlob(cx - r * cosf(angle), cy - r * sinf(angle), width * 0.04f, height * 0.07f, 1900);
+		drawBlob(cx + r * cosf(angle), cy + r * sinf(angle), width * 0.04f, height * 0.07f, 1900);
+
+		// foot pressing the "pedal" every couple of seconds
+		if ((frame / 60) % 2 == 1)
+			drawBlob(width * 0.6f, height * 0.88f, width * 0.06f, height * 0.08f, 2800);
+	}
+
+	rawDepthToDisplay(&rawDepth[0], &depth[0], width*height);
+	for (int i = 0; i < width*height; i++){
+		rgb[i*3  ] = depth[i];
+		rgb[i*3+1] = (unsigned char) (i % width);
+		rgb[i*3+2] = (unsigned char) (i / width);
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+int syntheticFrameSource::getWidth() {
+	return width;
+}
+
+//--------------------------------------------------------------
+int syntheticFrameSource::getHeight() {
+	return height;
+}
+
+//--------------------------------------------------------------
+unsigned char * syntheticFrameSource::getDepthPixels() {
+	return &depth[0];
+}
+
+//--------------------------------------------------------------
+unsigned short * syntheticFrameSource::getRawDepthPixels() {
+	return &rawDepth[0];
+}
+
+//--------------------------------------------------------------
+unsigned char * syntheticFrameSource::getRGBPixels() {
+	return &rgb[0];
+}
+
+//--------------------------------------------------------------
+float syntheticFrameSource::getDistanceAt(int x, int y) {
+	return rawDepthToCentimeters(rawDepth[y*width + x]);
+}
+
+//--------------------------------------------------------------
+unsigned long long syntheticFrameSource::getTimestamp() {
+	return timestamp;
+}
@@ -0,0 +1,42 @@
+#ifndef _SYNTHETIC_FRAME_SOURCE
+#define _SYNTHETIC_FRAME_SOURCE
+
+#include <vector>
+#include "frameSource.h"
+
+// Generates a fake kinect scene so the pipelines can be benchmarked
+// without a recorded clip: a noisy back wall, two "hands" moving in a
+// circle like they are turning a steering wheel, and a "foot" that steps
+// in and out at the bottom of the frame. The scene is laid out in
+// millimeters and turned into raw values with depthConversion.h, the
+// 8 bit depth image is the display view of those. The first frame is
+// the empty scene, so it can be captured as the background.
+class syntheticFrameSource : public frameSource {
+
+	public:
+		syntheticFrameSource(int width = 640, int height = 480);
+
+		bool update();
+		int getWidth();
+		int getHeight();
+		unsigned char * getDepthPixels();
+		unsigned short * getRawDepthPixels();
+		unsigned char * getRGBPixels();
+		float getDistanceAt(int x, int y);
+		unsigned long long getTimestamp();
+
+	private:
+		void drawBlob(float cx, float cy, float rx, float ry, float millimeters);
+
+		int width;
+		int height;
+		int frame;
+		unsigned int seed;
+		unsigned long long timestamp;
+
+		std::vector<unsigned char> depth;
+		std::vector<unsigned short> rawDepth;
+		std::vector<unsigned char> rgb;
+};
+
+#endif
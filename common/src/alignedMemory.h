@@ -0,0 +1,12 @@
+#ifndef _ALIGNED_MEMORY
+#define _ALIGNED_MEMORY
+
+#include <stddef.h>
+
+// Vector loads and stores are fastest on aligned addresses, so
+// buffers that are reused every frame should be allocated with these.
+// Memory from alignedMalloc must be released with alignedFree.
+void * alignedMalloc(size_t size, size_t alignment = 32);
+void alignedFree(void * ptr);
+
+#endif
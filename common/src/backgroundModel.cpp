@@ -0,0 +1,249 @@
+#include "backgroundModel.h"
+#include "depthConversion.h"
+
+#include <math.h>
+
+// update() has to come out the same as updateScalar() to the bit, so
+// neither may have its multiplies and adds fused into FMAs (which round
+// once instead of twice), eg. with -march=native
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+//--------------------------------------------------------------
+backgroundModel::backgroundModel() {
+	width = height = 0;
+	rate = 0.05f;
+	deviations = 3;
+	minVariance = 1;
+	noReading = 2047;
+}
+
+//--------------------------------------------------------------
+void backgroundModel::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+	// every raw value past the furthest real distance is no reading
+	noReading = millimetersToRawDepth(DEPTH_MAX_MILLIMETERS + 1);
+
+	mean.assign(width*height, 2047);
+	variance.assign(width*height, minVariance);
+	limits.assign(width*height, 2047);
+}
+
+//--------------------------------------------------------------
+void backgroundModel::setLearningRate(float rate) {
+	this->rate = rate < 0 ? 0 : (rate > 1 ? 1 : rate);
+}
+
+//--------------------------------------------------------------
+void backgroundModel::setDeviations(float deviations) {
+	this->deviations = deviations < 0 ? 0 : deviations;
+}
+
+//--------------------------------------------------------------
+void backgroundModel::setMinimumDeviation(float deviation) {
+	minVariance = deviation * deviation;
+}
+
+//--------------------------------------------------------------
+void backgroundModel::learn(const unsigned short * depth) {
+	for (int i = 0; i < width*height; i++){
+		mean[i] = depth[i] < noReading ? depth[i] : 2047;
+		variance[i] = minVariance;
+	}
+	// work the limits out without taking anything in
+	float saved = rate;
+	rate = 0;
+	update(depth);
+	rate = saved;
+}
+
+//--------------------------------------------------------------
+void backgroundModel::update(const unsigned short * depth) {
+	update(depth, 0, width*height);
+}
+
+//--------------------------------------------------------------
+void backgroundModel::updateScalar(const unsigned short * depth, int start, int count) {
+	float k2 = deviations * deviations;
+	for (int i = start; i < start + count; i++){
+		float m = mean[i], v = variance[i];
+		if (m >= noReading) {
+			limits[i] = 2047;
+			continue;
+		}
+		// only take in pixels with a reading that aren't foreground
+		if (depth[i] < noReading && depth[i] >= limits[i]) {
+			float d = depth[i] - m;
+			m = m + rate * d;
+			v = v + rate * (d*d - v);
+			if (v < minVariance)
+				v = minVariance;
+			mean[i] = m;
+			variance[i] = v;
+		}
+		// foreground is depth < mean - deviations * sd, and depth is a whole
+		// number, so the limit is that rounded up
+		float t = m - sqrtf(k2 * v);
+		if (t < 0)
+			t = 0;
+		int limit = (int) t;
+		if (limit < t)
+			limit++;
+		limits[i] = (unsigned short) limit;
+	}
+}
+
+//--------------------------------------------------------------
+void backgroundModel::update(const unsigned short * depth, int start, int count) {
+	// The same steps as updateScalar(), with the ifs turned into blends.
+	// Pixels with no reading in the model have a limit of 2047, so they
+	// never pass the foreground test and are never taken in either.
+	int i = start, end = start + count;
+	float k2 = deviations * deviations;
+
+#if defined(__AVX2__)
+	const __m128i vNoReading = _mm_set1_epi16((short) noReading);
+	const __m256 vNoReadingF = _mm256_set1_ps(noReading);
+	const __m256 vRate = _mm256_set1_ps(rate);
+	const __m256 vMinVar = _mm256_set1_ps(minVariance);
+	const __m256 vK2 = _mm256_set1_ps(k2);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256i none = _mm256_set1_epi32(2047);
+	for (; i + 16 <= end; i += 16){
+		__m128i x16[2], l16[2];
+		__m256i limit[2];
+		for (int h = 0; h < 2; h++){
+			x16[h] = _mm_loadu_si128((const __m128i *) (depth + i + 8*h));
+			l16[h] = _mm_loadu_si128((const __m128i *) (&limits[i + 8*h]));
+			__m128i take16 = _mm_andnot_si128(_mm_cmplt_epi16(x16[h], l16[h]), _mm_cmplt_epi16(x16[h], vNoReading));
+			__m256 take = _mm256_castsi256_ps(_mm256_cvtepi16_epi32(take16));
+			__m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(x16[h]));
+			__m256 m = _mm256_loadu_ps(&mean[i + 8*h]);
+			__m256 v = _mm256_loadu_ps(&variance[i + 8*h]);
+			__m256 valid = _mm256_cmp_ps(m, vNoReadingF, _CMP_LT_OQ);
+
+			__m256 d = _mm256_sub_ps(x, m);
+			__m256 m2 = _mm256_add_ps(m, _mm256_mul_ps(vRate, d));
+			__m256 v2 = _mm256_add_ps(v, _mm256_mul_ps(vRate, _mm256_sub_ps(_mm256_mul_ps(d, d), v)));
+			v2 = _mm256_max_ps(v2, vMinVar);
+			m = _mm256_blendv_ps(m, m2, take);
+			v = _mm256_blendv_ps(v, v2, take);
+			_mm256_storeu_ps(&mean[i + 8*h], m);
+			_mm256_storeu_ps(&variance[i + 8*h], v);
+
+			__m256 t = _mm256_max_ps(_mm256_sub_ps(m, _mm256_sqrt_ps(_mm256_mul_ps(vK2, v))), zero);
+			__m256i l = _mm256_cvttps_epi32(t);
+			l = _mm256_sub_epi32(l, _mm256_castps_si256(_mm256_cmp_ps(_mm256_cvtepi32_ps(l), t, _CMP_LT_OQ)));
+			limit[h] = _mm256_blendv_epi8(none, l, _mm256_castps_si256(valid));
+		}
+		for (int h = 0; h < 2; h++){
+			__m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(limit[h]), _mm256_extracti128_si256(limit[h], 1));
+			_mm_storeu_si128((__m128i *) (&limits[i + 8*h]), packed);
+		}
+	}
+#elif defined(__SSE2__)
+	const __m128i vNoReading = _mm_set1_epi16((short) noReading);
+	const __m128 vNoReadingF = _mm_set1_ps(noReading);
+	const __m128 vRate = _mm_set1_ps(rate);
+	const __m128 vMinVar = _mm_set1_ps(minVariance);
+	const __m128 vK2 = _mm_set1_ps(k2);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i zero16 = _mm_setzero_si128();
+	const __m128i none = _mm_set1_epi32(2047);
+	for (; i + 8 <= end; i += 8){
+		__m128i x16 = _mm_loadu_si128((const __m128i *) (depth + i));
+		__m128i l16 = _mm_loadu_si128((const __m128i *) (&limits[i]));
+		__m128i take16 = _mm_andnot_si128(_mm_cmplt_epi16(x16, l16), _mm_cmplt_epi16(x16, vNoReading));
+		__m128i limit[2];
+		for (int h = 0; h < 2; h++){
+			__m128 take = _mm_castsi128_ps(h ? _mm_unpackhi_epi16(take16, take16) : _mm_unpacklo_epi16(take16, take16));
+			__m128 x = _mm_cvtepi32_ps(h ? _mm_unpackhi_epi16(x16, zero16) : _mm_unpacklo_epi16(x16, zero16));
+			__m128 m = _mm_loadu_ps(&mean[i + 4*h]);
+			__m128 v = _mm_loadu_ps(&variance[i + 4*h]);
+			__m128 valid = _mm_cmplt_ps(m, vNoReadingF);
+
+			__m128 d = _mm_sub_ps(x, m);
+			__m128 m2 = _mm_add_ps(m, _mm_mul_ps(vRate, d));
+			__m128 v2 = _mm_add_ps(v, _mm_mul_ps(vRate, _mm_sub_ps(_mm_mul_ps(d, d), v)));
+			v2 = _mm_max_ps(v2, vMinVar);
+			m = _mm_or_ps(_mm_and_ps(take, m2), _mm_andnot_ps(take, m));
+			v = _mm_or_ps(_mm_and_ps(take, v2), _mm_andnot_ps(take, v));
+			_mm_storeu_ps(&mean[i + 4*h], m);
+			_mm_storeu_ps(&variance[i + 4*h], v);
+
+			__m128 t = _mm_max_ps(_mm_sub_ps(m, _mm_sqrt_ps(_mm_mul_ps(vK2, v))), zero);
+			__m128i l = _mm_cvttps_epi32(t);
+			l = _mm_sub_epi32(l, _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(l), t)));
+			__m128i keep = _mm_castps_si128(valid);
+			limit[h] = _mm_or_si128(_mm_and_si128(keep, l), _mm_andnot_si128(keep, none));
+		}
+		_mm_storeu_si128((__m128i *) (&limits[i]), _mm_packs_epi32(limit[0], limit[1]));
+	}
+#elif defined(__aarch64__)
+	// 64 bit ARM only, 32 bit NEON has no vector square root
+	const uint16x8_t vNoReading = vdupq_n_u16(noReading);
+	const float32x4_t vNoReadingF = vdupq_n_f32(noReading);
+	const float32x4_t vRate = vdupq_n_f32(rate);
+	const float32x4_t vMinVar = vdupq_n_f32(minVariance);
+	const float32x4_t vK2 = vdupq_n_f32(k2);
+	const float32x4_t zero = vdupq_n_f32(0);
+	const int32x4_t none = vdupq_n_s32(2047);
+	for (; i + 8 <= end; i += 8){
+		uint16x8_t x16 = vld1q_u16(depth + i);
+		uint16x8_t l16 = vld1q_u16(&limits[i]);
+		uint16x8_t take16 = vandq_u16(vcgeq_u16(x16, l16), vcltq_u16(x16, vNoReading));
+		int32x4_t limit[2];
+		for (int h = 0; h < 2; h++){
+			uint16x4_t takeHalf = h ? vget_high_u16(take16) : vget_low_u16(take16);
+			uint32x4_t take = vreinterpretq_u32_s32(vmovl_s16(vreinterpret_s16_u16(takeHalf)));
+			float32x4_t x = vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(x16) : vget_low_u16(x16)));
+			float32x4_t m = vld1q_f32(&mean[i + 4*h]);
+			float32x4_t v = vld1q_f32(&variance[i + 4*h]);
+			uint32x4_t valid = vcltq_f32(m, vNoReadingF);
+
+			float32x4_t d = vsubq_f32(x, m);
+			float32x4_t m2 = vaddq_f32(m, vmulq_f32(vRate, d));
+			float32x4_t v2 = vaddq_f32(v, vmulq_f32(vRate, vsubq_f32(vmulq_f32(d, d), v)));
+			v2 = vmaxq_f32(v2, vMinVar);
+			m = vbslq_f32(take, m2, m);
+			v = vbslq_f32(take, v2, v);
+			vst1q_f32(&mean[i + 4*h], m);
+			vst1q_f32(&variance[i + 4*h], v);
+
+			float32x4_t t = vmaxq_f32(vsubq_f32(m, vsqrtq_f32(vmulq_f32(vK2, v))), zero);
+			limit[h] = vbslq_s32(valid, vcvtpq_s32_f32(t), none);
+		}
+		vst1q_u16(&limits[i], vreinterpretq_u16_s16(vcombine_s16(vqmovn_s32(limit[0]), vqmovn_s32(limit[1]))));
+	}
+#endif
+
+	// finish off whatever doesn't fill a whole vector
+	updateScalar(depth, i, end - i);
+}
+
+//--------------------------------------------------------------
+unsigned short * backgroundModel::getLimits() {
+	return &limits[0];
+}
+
+//--------------------------------------------------------------
+float * backgroundModel::getMean() {
+	return &mean[0];
+}
+
+//--------------------------------------------------------------
+float * backgroundModel::getVariance() {
+	return &variance[0];
+}
@@ -0,0 +1,72 @@
+#ifndef _BACKGROUND_MODEL
+#define _BACKGROUND_MODEL
+
+#include <vector>
+
+// A running statistical model of the background depth, in place of a
+// single captured frame. Each pixel keeps a mean and a variance of its
+// raw depth, which follow the input slowly, and a pixel counts as
+// foreground when it is more than a few standard deviations nearer than
+// the mean. So where the sensor is noisy (edges, far away, shiny things)
+// a pixel has to come further forward before it shows up, and where it is
+// steady a small step is enough.
+//
+// Foreground pixels are left out of the update, so a player standing
+// still is not slowly taken into the background. Pixels that had no
+// reading when the model was learned stay "no reading" until the next
+// learn(), and anything with a reading counts as foreground there, the
+// same as with depthMaskLimits().
+//
+// The model hands its result over as per pixel limits for depthMask()
+// (see depthMask.h), so it works with tileSegmenter::mask() unchanged.
+// update() is vectorized with SSE2/AVX2 (and NEON on 64 bit ARM), 4 or 8
+// pixels at a time in floats.
+class backgroundModel {
+
+	public:
+		backgroundModel();
+
+		// Allocates an empty model, everything passes until learn()
+		void setup(int width, int height);
+
+		// How far the mean and variance move towards each new value, 0 to 1
+		void setLearningRate(float rate);
+		// How many standard deviations nearer than the mean is foreground
+		void setDeviations(float deviations);
+		// The smallest standard deviation, in raw steps, so a perfectly
+		// steady pixel doesn't let every little flicker through
+		void setMinimumDeviation(float deviation);
+
+		// Starts the model again from a raw depth frame (eg. when the user
+		// presses space)
+		void learn(const unsigned short * depth);
+		// Takes a raw depth frame into the model. The second version only
+		// does pixels start to start+count-1, depth is still the whole frame.
+		void update(const unsigned short * depth);
+		void update(const unsigned short * depth, int start, int count);
+		// The same in plain C, as a reference for the vectorized version.
+		// The two agree bit for bit (this file is built without FMA
+		// contraction for that).
+		void updateScalar(const unsigned short * depth, int start, int count);
+
+		// Limits for depthMask(), a pixel nearer than its limit is foreground
+		unsigned short * getLimits();
+		// The model itself, in raw depth units
+		float * getMean();
+		float * getVariance();
+
+	private:
+		int width;
+		int height;
+		float rate;
+		float deviations;
+		float minVariance;
+		// the first raw value that means no reading
+		unsigned short noReading;
+
+		std::vector<float> mean;
+		std::vector<float> variance;
+		std::vector<unsigned short> limits;
+};
+
+#endif
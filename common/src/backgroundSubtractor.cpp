@@ -0,0 +1,80 @@
+#include "backgroundSubtractor.h"
+
+//--------------------------------------------------------------
+backgroundSubtractor::backgroundSubtractor() {
+	bLearn = false;
+	// hold pixels steady through the sensor flickering by a raw step or
+	// two, which also keeps tiles from going dirty when nothing moved
+	segmenter.setTemporal(2);
+}
+
+//--------------------------------------------------------------
+void backgroundSubtractor::setup(int width, int height) {
+	segmenter.setup(width, height);
+	background.setup(width, height);
+}
+
+//--------------------------------------------------------------
+void backgroundSubtractor::setPool(threadPool * pool) {
+	segmenter.setPool(pool);
+}
+
+//--------------------------------------------------------------
+void backgroundSubtractor::learnBackground() {
+	bLearn = true;
+}
+
+//--------------------------------------------------------------
+void backgroundSubtractor::invalidate() {
+	segmenter.invalidate();
+}
+
+//--------------------------------------------------------------
+bool backgroundSubtractor::update(const unsigned short * rawDepth) {
+	// Claimed up front, so a request made while this frame is being
+	// filtered is kept for the next one rather than cleared with this one
+	bool learn = __sync_bool_compare_and_swap(&bLearn, true, false);
+	// nothing masked against the old background can be kept
+	if (learn)
+		segmenter.invalidate();
+
+	segmenter.update(rawDepth);
+
+	if (learn) {
+		background.learn(segmenter.getFiltered());
+	} else {
+		// keep the model following the scene, apart from the foreground
+		segmenter.updateBackground(background);
+	}
+	return learn;
+}
+
+//--------------------------------------------------------------
+void backgroundSubtractor::mask(unsigned char * mask, int cutoff, int y0, int y1) {
+	segmenter.mask(background.getLimits(), mask, cutoff, y0, y1);
+}
+
+//--------------------------------------------------------------
+int backgroundSubtractor::getDirtyCount() {
+	return segmenter.getDirtyCount();
+}
+
+//--------------------------------------------------------------
+unsigned short * backgroundSubtractor::getFiltered() {
+	return segmenter.getFiltered();
+}
+
+//--------------------------------------------------------------
+unsigned short * backgroundSubtractor::getLimits() {
+	return background.getLimits();
+}
+
+//--------------------------------------------------------------
+tileSegmenter & backgroundSubtractor::getSegmenter() {
+	return segmenter;
+}
+
+//--------------------------------------------------------------
+backgroundModel & backgroundSubtractor::getBackground() {
+	return background;
+}
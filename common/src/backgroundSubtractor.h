@@ -0,0 +1,55 @@
+#ifndef _BACKGROUND_SUBTRACTOR
+#define _BACKGROUND_SUBTRACTOR
+
+#include "tileSegmenter.h"
+#include "backgroundModel.h"
+
+// The background subtraction every demo runs on each depth frame: the
+// noise filter over the tiles that changed (see tileSegmenter.h), then
+// either learning the background from the filtered frame, when it was
+// asked for, or keeping the running model up to date (see
+// backgroundModel.h). The masks are then made from getLimits().
+class backgroundSubtractor {
+
+	public:
+		// Starts with the temporal filter the demos use, see getSegmenter()
+		// to change it
+		backgroundSubtractor();
+
+		// Allocates everything. Until a background is learned every pixel
+		// nearer than the cutoff counts as foreground.
+		void setup(int width, int height);
+
+		// Splits the passes over the frame into strips on the pool's
+		// threads, see tileSegmenter.h
+		void setPool(threadPool * pool);
+
+		// Learn the background from the next frame (eg. when space is
+		// pressed), safe to call from any thread
+		void learnBackground();
+		// Forces everything to be masked again, eg. after a threshold changed
+		void invalidate();
+
+		// Takes in a raw depth frame. Returns true if the background was
+		// learned from it.
+		bool update(const unsigned short * rawDepth);
+
+		// Masks the dirty tiles of the filtered frame, see tileSegmenter::mask()
+		void mask(unsigned char * mask, int cutoff, int y0 = 0, int y1 = -1);
+
+		int getDirtyCount();
+		unsigned short * getFiltered();
+		unsigned short * getLimits();
+
+		// To set the noise filter and change detection up, see tileSegmenter.h
+		tileSegmenter & getSegmenter();
+		// To set the background model up, see backgroundModel.h
+		backgroundModel & getBackground();
+
+	private:
+		tileSegmenter segmenter;
+		backgroundModel background;
+		volatile bool bLearn;
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "blobLabeller.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using std::min;
+using std::max;
+
+//--------------------------------------------------------------
+// Sum and sum of squares of count raw depth values
+static void depthMoments(const unsigned short * depth, int count, unsigned long long & sum, unsigned long long & sum2) {
+	int i = 0;
+#if defined(__SSE2__)
+	// raw values are 11 bits, so madd can square and pair them up in 32
+	// bits. Each lane takes at most 2*2047^2 per step, so the lanes are
+	// emptied into the 64 bit totals every 128 steps.
+	const __m128i ones = _mm_set1_epi16(1);
+	while (i + 8 <= count){
+		__m128i s = _mm_setzero_si128(), s2 = _mm_setzero_si128();
+		for (int n = 0; n < 128 && i + 8 <= count; n++, i += 8){
+			__m128i d = _mm_loadu_si128((const __m128i *) (depth + i));
+			s = _mm_add_epi32(s, _mm_madd_epi16(d, ones));
+			s2 = _mm_add_epi32(s2, _mm_madd_epi16(d, d));
+		}
+		unsigned int a[4], b[4];
+		_mm_storeu_si128((__m128i *) a, s);
+		_mm_storeu_si128((__m128i *) b, s2);
+		sum += (unsigned long long) a[0] + a[1] + a[2] + a[3];
+		sum2 += (unsigned long long) b[0] + b[1] + b[2] + b[3];
+	}
+#endif
+	for (; i < count; i++){
+		sum += depth[i];
+		sum2 += depth[i] * depth[i];
+	}
+}
+
+//--------------------------------------------------------------
+blobLabeller::blobLabeller() {
+	width = height = 0;
+	labelCount = 0;
+	prevY = -2;
+	prevCount = 0;
+	bDepth = false;
+}
+
+//--------------------------------------------------------------
+void blobLabeller::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+
+	// a row has at most one run for every other pixel
+	int runs = (width + 1) / 2;
+	prevStart.resize(runs);
+	prevEnd.resize(runs);
+	prevLabel.resize(runs);
+	curStart.resize(runs);
+	curEnd.resize(runs);
+	curLabel.resize(runs);
+
+	// enough labels for a busy frame, more are added if it ever runs out
+	int labels = max(width * height / 64, 256);
+	parent.resize(labels);
+	area.resize(labels);
+	minX.resize(labels);
+	minY.resize(labels);
+	maxX.resize(labels);
+	maxY.resize(labels);
+	sumX.resize(labels);
+	sumY.resize(labels);
+	sumDepth.resize(labels);
+	sumDepth2.resize(labels);
+}
+
+//--------------------------------------------------------------
+int blobLabeller::newLabel(int y) {
+	if (labelCount == (int) parent.size()) {
+		int labels = labelCount * 2;
+		parent.resize(labels);
+		area.resize(labels);
+		minX.resize(labels);
+		minY.resize(labels);
+		maxX.resize(labels);
+		maxY.resize(labels);
+		sumX.resize(labels);
+		sumY.resize(labels);
+		sumDepth.resize(labels);
+		sumDepth2.resize(labels);
+	}
+	int l = labelCount++;
+	parent[l] = l;
+	area[l] = 0;
+	minX[l] = width;
+	maxX[l] = -1;
+	minY[l] = maxY[l] = y;
+	sumX[l] = sumY[l] = 0;
+	sumDepth[l] = sumDepth2[l] = 0;
+	return l;
+}
+
+//--------------------------------------------------------------
+int blobLabeller::findRoot(int label) {
+	// path halving, every other label on the way up skips a level
+	while (parent[label] != label) {
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
+}
+
+//--------------------------------------------------------------
+int blobLabeller::join(int a, int b) {
+	a = findRoot(a);
+	b = findRoot(b);
+	if (a == b)
+		return a;
+	// the older label stays the root, and takes on the other's totals
+	if (b < a)
+		std::swap(a, b);
+	parent[b] = a;
+	area[a] += area[b];
+	minX[a] = min(minX[a], minX[b]);
+	maxX[a] = max(maxX[a], maxX[b]);
+	minY[a] = min(minY[a], minY[b]);
+	maxY[a] = max(maxY[a], maxY[b]);
+	sumX[a] += sumX[b];
+	sumY[a] += sumY[b];
+	sumDepth[a] += sumDepth[b];
+	sumDepth2[a] += sumDepth2[b];
+	return a;
+}
+
+//--------------------------------------------------------------
+int blobLabeller::find(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+					   const unsigned short * depth) {
+	begin();
+	for (int y = 0; y < height; y++)
+		addRow(mask + y*width, depth != NULL ? depth + y*width : NULL, y, 0, width);
+	return end(blobs, minArea, maxArea, maxBlobs);
+}
+
+//--------------------------------------------------------------
+void blobLabeller::begin() {
+	labelCount = 0;
+	prevCount = 0;
+	prevY = -2;
+	bDepth = false;
+}
+
+//--------------------------------------------------------------
+void blobLabeller::addRow(const unsigned char * maskRow, const unsigned short * depthRow, int y, int x0, int x1) {
+	// runs only join up with the row directly above
+	if (y != prevY + 1)
+		prevCount = 0;
+	if (depthRow != NULL)
+		bDepth = true;
+
+	int curCount = 0;
+	// the first run in the row above that can still touch a run here
+	int p = 0;
+	int x = x0;
+	while (x < x1){
+		// skip to the start of the next run
+#if defined(__SSE2__)
+		while (x + 16 <= x1 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (maskRow + x)), _mm_setzero_si128())) == 0xffff)
+			x += 16;
+#endif
+		while (x < x1 && maskRow[x] == 0)
+			x++;
+		if (x == x1)
+			break;
+		int start = x;
+		// and to its end
+#if defined(__SSE2__)
+		while (x + 16 <= x1 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (maskRow + x)), _mm_setzero_si128())) == 0)
+			x += 16;
+#endif
+		while (x < x1 && maskRow[x] != 0)
+			x++;
+		int end = x;
+
+		// 8-connected, so a run above touches this one if it reaches
+		// from start-1 to end (runs are start to end-1)
+		while (p < prevCount && prevEnd[p] < start)
+			p++;
+		int label = -1;
+		int q = p;
+		for (; q < prevCount && prevStart[q] <= end; q++)
+			label = label < 0 ? findRoot(prevLabel[q]) : join(label, prevLabel[q]);
+		// the last run above can reach past this one into the next
+		if (q > p)
+			p = q - 1;
+		if (label < 0)
+			label = newLabel(y);
+
+		int length = end - start;
+		area[label] += length;
+		minX[label] = min(minX[label], start);
+		maxX[label] = max(maxX[label], end - 1);
+		maxY[label] = y;
+		sumX[label] += (long long) (start + end - 1) * length / 2;
+		sumY[label] += (long long) y * length;
+		if (depthRow != NULL)
+			depthMoments(depthRow + start, length, sumDepth[label], sumDepth2[label]);
+
+		curStart[curCount] = start;
+		curEnd[curCount] = end;
+		curLabel[curCount] = label;
+		curCount++;
+	}
+	prevStart.swap(curStart);
+	prevEnd.swap(curEnd);
+	prevLabel.swap(curLabel);
+	prevCount = curCount;
+	prevY = y;
+}
+
+//--------------------------------------------------------------
+int blobLabeller::end(blobList & blobs, int minArea, int maxArea, int maxBlobs) {
+	// keep the biggest maxBlobs of the blobs that pass the area filter, by
+	// inserting each one into the short sorted list of the best so far
+	maxBlobs = min(maxBlobs, BLOB_LIST_SIZE);
+	int best[BLOB_LIST_SIZE];
+	int count = 0;
+	for (int l = 0; l < labelCount; l++){
+		if (parent[l] != l || area[l] < minArea || area[l] > maxArea)
+			continue;
+		if (count == maxBlobs && (count == 0 || area[l] <= area[best[count-1]]))
+			continue;
+		int i = count < maxBlobs ? count++ : count - 1;
+		while (i > 0 && area[best[i-1]] < area[l]){
+			best[i] = best[i-1];
+			i--;
+		}
+		best[i] = l;
+	}
+
+	blobs.count = count;
+	for (int i = 0; i < count; i++){
+		int l = best[i];
+		float n = (float) area[l];
+		blobs.area[i] = area[l];
+		blobs.centroidX[i] = sumX[l] / n;
+		blobs.centroidY[i] = sumY[l] / n;
+		blobs.minX[i] = minX[l];
+		blobs.minY[i] = minY[l];
+		blobs.maxX[i] = maxX[l];
+		blobs.maxY[i] = maxY[l];
+		if (bDepth) {
+			double mean = (double) sumDepth[l] / area[l];
+			blobs.depth[i] = (float) mean;
+			blobs.depthVariance[i] = (float) ((double) sumDepth2[l] / area[l] - mean * mean);
+		} else {
+			blobs.depth[i] = blobs.depthVariance[i] = 0;
+		}
+	}
+	return count;
+}
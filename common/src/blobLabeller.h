@@ -0,0 +1,90 @@
+#ifndef _BLOB_LABELLER
+#define _BLOB_LABELLER
+
+#include <stddef.h>
+#include <vector>
+
+// The most blobs a blobList can hold
+#define BLOB_LIST_SIZE 16
+
+// The blobs found by blobLabeller, biggest first. Kept as a structure of
+// arrays with a fixed size, so it can be copied around (eg. into a
+// frameResult) without allocating.
+struct blobList {
+	int count;
+	// number of pixels
+	int area[BLOB_LIST_SIZE];
+	float centroidX[BLOB_LIST_SIZE];
+	float centroidY[BLOB_LIST_SIZE];
+	// bounding box, inclusive
+	int minX[BLOB_LIST_SIZE];
+	int minY[BLOB_LIST_SIZE];
+	int maxX[BLOB_LIST_SIZE];
+	int maxY[BLOB_LIST_SIZE];
+	// mean and variance of the raw depth under the blob, 0 if no depth
+	// map was given
+	float depth[BLOB_LIST_SIZE];
+	float depthVariance[BLOB_LIST_SIZE];
+};
+
+// Finds the 8-connected blobs in a mask in a single pass, in place of
+// ofxCvContourFinder when only the centroid, area and bounding box are
+// needed. Each row is cut into runs of set pixels (skipping 16 pixels at
+// a time with SSE2), every run is joined to the runs it touches in the
+// row above with union-find, and the blob's area, centroid, bounding box
+// and depth moments are added up as the runs come in. Nothing is traced
+// and no label image is written.
+//
+// Blobs outside minArea..maxArea are dropped, and only the maxBlobs
+// biggest are kept, picked without sorting all of them. Areas are pixel
+// counts, so they come out a little bigger than ofxCvContourFinder's
+// contour areas.
+//
+// Rows can also be fed in one at a time with begin(), addRow() and end(),
+// so a mask can be labelled while it is being made (see regionSegmenter.h).
+class blobLabeller {
+
+	public:
+		blobLabeller();
+
+		void setup(int width, int height);
+
+		// Finds the blobs in mask (anything non zero is set) and puts them in
+		// blobs. depth is the raw depth map for the depth moments, or NULL.
+		// Returns the number of blobs found.
+		int find(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+				 const unsigned short * depth = NULL);
+
+		// find() a row at a time. maskRow and depthRow (or NULL) are row y
+		// of the mask and the depth map, and only pixels x0 to x1-1 of it
+		// are looked at. Rows must come in order, top to bottom.
+		void begin();
+		void addRow(const unsigned char * maskRow, const unsigned short * depthRow, int y, int x0, int x1);
+		int end(blobList & blobs, int minArea, int maxArea, int maxBlobs);
+
+	private:
+		int newLabel(int y);
+		int findRoot(int label);
+		int join(int a, int b);
+
+		int width;
+		int height;
+		int labelCount;
+		// the row the runs in prev came from, and how many there are
+		int prevY;
+		int prevCount;
+		bool bDepth;
+
+		// the runs in the row above and in this one
+		std::vector<int> prevStart, prevEnd, prevLabel;
+		std::vector<int> curStart, curEnd, curLabel;
+
+		// per label, only meaningful for the roots
+		std::vector<int> parent;
+		std::vector<int> area;
+		std::vector<int> minX, minY, maxX, maxY;
+		std::vector<long long> sumX, sumY;
+		std::vector<unsigned long long> sumDepth, sumDepth2;
+};
+
+#endif
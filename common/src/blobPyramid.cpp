@@ -0,0 +1,274 @@
+#include "blobPyramid.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+using std::min;
+using std::max;
+
+//--------------------------------------------------------------
+// Halves a mask, a pixel of dst is 255 if any of the 2x2 pixels of src
+// under it are set, 0 otherwise. dst is (width+1)/2 by (height+1)/2, and
+// an odd last row or column is taken on its own.
+static void halveMask(const unsigned char * src, int width, int height, unsigned char * dst) {
+	int dstWidth = (width + 1) / 2;
+	int dstHeight = (height + 1) / 2;
+	for (int y = 0; y < dstHeight; y++){
+		const unsigned char * a = src + 2*y*width;
+		const unsigned char * b = 2*y + 1 < height ? a + width : a;
+		unsigned char * out = dst + y*dstWidth;
+		int x = 0;
+
+		// Or the two rows together, then each pair of bytes is one 16 bit
+		// lane, which is zero only if both pixels are
+#if defined(__AVX2__)
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i ones = _mm256_set1_epi8(-1);
+		for (; 2*x + 64 <= width; x += 32){
+			__m256i v0 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (a + 2*x)), _mm256_loadu_si256((const __m256i *) (b + 2*x)));
+			__m256i v1 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (a + 2*x + 32)), _mm256_loadu_si256((const __m256i *) (b + 2*x + 32)));
+			__m256i empty = _mm256_packs_epi16(_mm256_cmpeq_epi16(v0, zero), _mm256_cmpeq_epi16(v1, zero));
+			// the pack works within each 128 bit half, put the quarters back
+			// in order
+			empty = _mm256_permute4x64_epi64(empty, 0xd8);
+			_mm256_storeu_si256((__m256i *) (out + x), _mm256_xor_si256(empty, ones));
+		}
+#elif defined(__SSE2__)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi8(-1);
+		for (; 2*x + 32 <= width; x += 16){
+			__m128i v0 = _mm_or_si128(_mm_loadu_si128((const __m128i *) (a + 2*x)), _mm_loadu_si128((const __m128i *) (b + 2*x)));
+			__m128i v1 = _mm_or_si128(_mm_loadu_si128((const __m128i *) (a + 2*x + 16)), _mm_loadu_si128((const __m128i *) (b + 2*x + 16)));
+			__m128i empty = _mm_packs_epi16(_mm_cmpeq_epi16(v0, zero), _mm_cmpeq_epi16(v1, zero));
+			_mm_storeu_si128((__m128i *) (out + x), _mm_xor_si128(empty, ones));
+		}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		for (; 2*x + 32 <= width; x += 16){
+			uint8x16_t v0 = vorrq_u8(vld1q_u8(a + 2*x), vld1q_u8(b + 2*x));
+			uint8x16_t v1 = vorrq_u8(vld1q_u8(a + 2*x + 16), vld1q_u8(b + 2*x + 16));
+			uint8x8_t e0 = vmovn_u16(vceqq_u16(vreinterpretq_u16_u8(v0), vdupq_n_u16(0)));
+			uint8x8_t e1 = vmovn_u16(vceqq_u16(vreinterpretq_u16_u8(v1), vdupq_n_u16(0)));
+			vst1q_u8(out + x, vmvnq_u8(vcombine_u8(e0, e1)));
+		}
+#endif
+
+		for (; x < dstWidth; x++){
+			unsigned char any = a[2*x] | b[2*x];
+			if (2*x + 1 < width)
+				any |= a[2*x + 1] | b[2*x + 1];
+			out[x] = any != 0 ? 255 : 0;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+int joinBoxes(int * x0, int * y0, int * x1, int * y1, int count) {
+	bool bJoined = true;
+	while (bJoined) {
+		// a grown box can overlap ones already passed over, so go round
+		// again until nothing is joined
+		bJoined = false;
+		for (int i = 0; i < count; i++){
+			for (int j = i + 1; j < count; j++){
+				if (x0[j] >= x1[i] || x0[i] >= x1[j] || y0[j] >= y1[i] || y0[i] >= y1[j])
+					continue;
+				x0[i] = min(x0[i], x0[j]);
+				y0[i] = min(y0[i], y0[j]);
+				x1[i] = max(x1[i], x1[j]);
+				y1[i] = max(y1[i], y1[j]);
+				count--;
+				x0[j] = x0[count];
+				y0[j] = y0[count];
+				x1[j] = x1[count];
+				y1[j] = y1[count];
+				j--;
+				bJoined = true;
+			}
+		}
+	}
+	return count;
+}
+
+//--------------------------------------------------------------
+blobPyramid::blobPyramid() {
+	width = 0;
+	height = 0;
+	levels = 1;
+	refined = 0;
+	coarseBlobs.count = 0;
+	boxBlobs.count = 0;
+	for (int l = 0; l <= BLOB_PYRAMID_MAX_LEVELS; l++)
+		widths[l] = heights[l] = 0;
+}
+
+//--------------------------------------------------------------
+void blobPyramid::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+	widths[0] = width;
+	heights[0] = height;
+	for (int l = 1; l <= BLOB_PYRAMID_MAX_LEVELS; l++){
+		widths[l] = (widths[l-1] + 1) / 2;
+		heights[l] = (heights[l-1] + 1) / 2;
+		masks[l].assign(widths[l] * heights[l], 0);
+	}
+	fine.setup(width, height);
+	coarse.setup(widths[levels], heights[levels]);
+}
+
+//--------------------------------------------------------------
+void blobPyramid::setLevels(int levels) {
+	this->levels = max(0, min(levels, BLOB_PYRAMID_MAX_LEVELS));
+	if (width > 0)
+		coarse.setup(widths[this->levels], heights[this->levels]);
+}
+
+//--------------------------------------------------------------
+int blobPyramid::getLevels() {
+	return levels;
+}
+
+//--------------------------------------------------------------
+// Copies blob i of src into blob j of dst
+static void copyBlob(const blobList & src, int i, blobList & dst, int j) {
+	dst.area[j] = src.area[i];
+	dst.centroidX[j] = src.centroidX[i];
+	dst.centroidY[j] = src.centroidY[i];
+	dst.minX[j] = src.minX[i];
+	dst.minY[j] = src.minY[i];
+	dst.maxX[j] = src.maxX[i];
+	dst.maxY[j] = src.maxY[i];
+	dst.depth[j] = src.depth[i];
+	dst.depthVariance[j] = src.depthVariance[i];
+}
+
+//--------------------------------------------------------------
+// Whether blob i of a goes before blob j of b: bigger first, and blobs of
+// the same size top to bottom and left to right, like blobLabeller
+static bool bigger(const blobList & a, int i, const blobList & b, int j) {
+	if (a.area[i] != b.area[j])
+		return a.area[i] > b.area[j];
+	if (a.minY[i] != b.minY[j])
+		return a.minY[i] < b.minY[j];
+	return a.minX[i] < b.minX[j];
+}
+
+//--------------------------------------------------------------
+int blobPyramid::find(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+					  const unsigned short * depth) {
+	if (levels == 0 || width == 0) {
+		refined = width * height;
+		return fine.find(mask, blobs, minArea, maxArea, maxBlobs, depth);
+	}
+
+	for (int l = 1; l <= levels; l++)
+		halveMask(l == 1 ? mask : &masks[l-1][0], widths[l-1], heights[l-1], &masks[l][0]);
+
+	// A blob of area a covers at least a/scale^2 coarse pixels, so nothing
+	// under minArea/scale^2 can be one worth keeping
+	int scale = 1 << levels;
+	coarse.find(&masks[levels][0], coarseBlobs, minArea / (scale*scale), widths[levels] * heights[levels], BLOB_LIST_SIZE);
+
+	// The boxes to label again, in full resolution pixels (x1 and y1 one
+	// past the end). Boxes that overlap are joined, so no blob is cut in
+	// two by the edge of a box or found twice. Only blobs under the
+	// minimum area can be cut by a box: the blobs of the coarse blobs that
+	// were dropped.
+	int x0[BLOB_LIST_SIZE], y0[BLOB_LIST_SIZE], x1[BLOB_LIST_SIZE], y1[BLOB_LIST_SIZE];
+	int boxes = 0;
+	for (int c = 0; c < coarseBlobs.count; c++){
+		x0[boxes] = coarseBlobs.minX[c] * scale;
+		y0[boxes] = coarseBlobs.minY[c] * scale;
+		x1[boxes] = min((coarseBlobs.maxX[c] + 1) * scale, width);
+		y1[boxes] = min((coarseBlobs.maxY[c] + 1) * scale, height);
+		boxes++;
+	}
+	boxes = joinBoxes(x0, y0, x1, y1, boxes);
+
+	// A noisy mask can join up into coarse blobs that cover most of the
+	// frame, then it is quicker to label the whole thing once
+	refined = 0;
+	for (int b = 0; b < boxes; b++)
+		refined += (x1[b] - x0[b]) * (y1[b] - y0[b]);
+	if (refined > width*height / 2) {
+		refined = width * height;
+		return fine.find(mask, blobs, minArea, maxArea, maxBlobs, depth);
+	}
+	return labelBoxes(mask, blobs, minArea, maxArea, maxBlobs, depth, x0, y0, x1, y1, boxes);
+}
+
+//--------------------------------------------------------------
+int blobPyramid::findInBoxes(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+							 const unsigned short * depth, const int * x0, const int * y0, const int * x1, const int * y1, int count) {
+	// clipped to the frame and joined where they overlap
+	int bx0[BLOB_LIST_SIZE], by0[BLOB_LIST_SIZE], bx1[BLOB_LIST_SIZE], by1[BLOB_LIST_SIZE];
+	int boxes = 0;
+	for (int b = 0; b < min(count, BLOB_LIST_SIZE); b++){
+		bx0[boxes] = max(x0[b], 0);
+		by0[boxes] = max(y0[b], 0);
+		bx1[boxes] = min(x1[b], width);
+		by1[boxes] = min(y1[b], height);
+		if (bx0[boxes] < bx1[boxes] && by0[boxes] < by1[boxes])
+			boxes++;
+	}
+	boxes = joinBoxes(bx0, by0, bx1, by1, boxes);
+
+	refined = 0;
+	for (int b = 0; b < boxes; b++)
+		refined += (bx1[b] - bx0[b]) * (by1[b] - by0[b]);
+	return labelBoxes(mask, blobs, minArea, maxArea, maxBlobs, depth, bx0, by0, bx1, by1, boxes);
+}
+
+//--------------------------------------------------------------
+int blobPyramid::labelBoxes(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+							const unsigned short * depth, const int * x0, const int * y0, const int * x1, const int * y1, int boxes) {
+	// label each box at full resolution, keeping the biggest maxBlobs over
+	// all of them, biggest first
+	maxBlobs = min(maxBlobs, BLOB_LIST_SIZE);
+	blobs.count = 0;
+	for (int b = 0; b < boxes; b++){
+		fine.begin();
+		for (int y = y0[b]; y < y1[b]; y++)
+			fine.addRow(mask + y*width, depth != NULL ? depth + y*width : NULL, y, x0[b], x1[b]);
+		fine.end(boxBlobs, minArea, maxArea, BLOB_LIST_SIZE);
+
+		for (int k = 0; k < boxBlobs.count; k++){
+			if (blobs.count == maxBlobs && (maxBlobs == 0 || !bigger(boxBlobs, k, blobs, maxBlobs-1)))
+				continue;
+			int i = blobs.count < maxBlobs ? blobs.count++ : blobs.count - 1;
+			while (i > 0 && bigger(boxBlobs, k, blobs, i-1)){
+				copyBlob(blobs, i-1, blobs, i);
+				i--;
+			}
+			copyBlob(boxBlobs, k, blobs, i);
+		}
+	}
+	return blobs.count;
+}
+
+//--------------------------------------------------------------
+const unsigned char * blobPyramid::getCoarseMask() {
+	return levels > 0 ? &masks[levels][0] : NULL;
+}
+
+//--------------------------------------------------------------
+int blobPyramid::getCoarseWidth() {
+	return widths[levels];
+}
+
+//--------------------------------------------------------------
+int blobPyramid::getCoarseHeight() {
+	return heights[levels];
+}
+
+//--------------------------------------------------------------
+int blobPyramid::getRefinedPixels() {
+	return refined;
+}
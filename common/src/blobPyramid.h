@@ -0,0 +1,85 @@
+#ifndef _BLOB_PYRAMID
+#define _BLOB_PYRAMID
+
+#include <vector>
+
+#include "blobLabeller.h"
+
+// The most times a blobPyramid can halve the mask
+#define BLOB_PYRAMID_MAX_LEVELS 3
+
+// Joins boxes that overlap (x1 and y1 one past the end) until none do,
+// and returns how many are left
+int joinBoxes(int * x0, int * y0, int * x1, int * y1, int count);
+
+// Finds the same blobs as blobLabeller::find(), coarse to fine, for masks
+// where every blob worth keeping is big (eg. hands, with a minimum area
+// of 1000 pixels at 640x480).
+//
+// The mask is halved setLevels() times (320x240 or 160x120 for the
+// kinect), with a pixel set when any of the 2x2 pixels under it is, using
+// SIMD. That is labelled instead of the full mask, which takes a quarter
+// or a sixteenth of the work. Halving like this never splits a blob or
+// shrinks it below its area over 4^levels, so the coarse blobs under that
+// area can be dropped without losing any real ones. Then only the
+// bounding boxes of the surviving coarse blobs are labelled again at full
+// resolution, so the areas, centroids, boxes and depths are exact. If
+// the boxes add up to more than half the frame (eg. a mask full of
+// speckles, which halving joins up) the full mask is labelled instead.
+//
+// Blobs closer than 2^levels pixels can be joined at the coarse level, so
+// every full resolution blob in a box is kept, and boxes that overlap are
+// joined so none is found twice. The result is the same as
+// blobLabeller::find() on the full mask, as long as there are at most
+// BLOB_LIST_SIZE coarse blobs over the minimum area.
+class blobPyramid {
+
+	public:
+		blobPyramid();
+
+		void setup(int width, int height);
+		// How many times the mask is halved before it is labelled, 0 labels
+		// the full mask directly. The default is 1.
+		void setLevels(int levels);
+		int getLevels();
+
+		// Same as blobLabeller::find()
+		int find(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+				 const unsigned short * depth = NULL);
+		// The same, but only labelling inside the boxes (in pixels, x1 and
+		// y1 one past the end, at most BLOB_LIST_SIZE), eg. the windows
+		// around the hands from trackWindows. The mask should be empty
+		// outside them, or blobs crossing their edges are cut.
+		int findInBoxes(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+						const unsigned short * depth, const int * x0, const int * y0, const int * x1, const int * y1, int count);
+
+		// The coarsest mask the last find() labelled (NULL with no levels),
+		// and its size
+		const unsigned char * getCoarseMask();
+		int getCoarseWidth();
+		int getCoarseHeight();
+		// Pixels looked at at full resolution by the last find() or findInBoxes()
+		int getRefinedPixels();
+
+	private:
+		// labels the boxes at full resolution, which mustn't overlap
+		int labelBoxes(const unsigned char * mask, blobList & blobs, int minArea, int maxArea, int maxBlobs,
+					   const unsigned short * depth, const int * x0, const int * y0, const int * x1, const int * y1, int boxes);
+
+		int width;
+		int height;
+		int levels;
+
+		// the halved masks, 1 to levels (0 is the input)
+		std::vector<unsigned char> masks[BLOB_PYRAMID_MAX_LEVELS + 1];
+		int widths[BLOB_PYRAMID_MAX_LEVELS + 1];
+		int heights[BLOB_PYRAMID_MAX_LEVELS + 1];
+
+		blobLabeller fine;
+		blobLabeller coarse;
+		blobList coarseBlobs;
+		blobList boxBlobs;
+		int refined;
+};
+
+#endif
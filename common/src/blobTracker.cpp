@@ -0,0 +1,195 @@
+#include "blobTracker.h"
+
+#include <algorithm>
+
+//--------------------------------------------------------------
+blobTracker::blobTracker() {
+	nextId = 0;
+	gate = 80;
+	maxMisses = 5;
+	setNoise(2, 2000);
+	setDepthNoise(2, 200);
+	clear();
+}
+
+//--------------------------------------------------------------
+void blobTracker::setGate(float pixels) {
+	gate = pixels;
+}
+
+//--------------------------------------------------------------
+void blobTracker::setMaxMisses(int frames) {
+	maxMisses = frames < 0 ? 0 : frames;
+}
+
+//--------------------------------------------------------------
+void blobTracker::setNoise(float measurement, float acceleration) {
+	r = measurement * measurement;
+	q = acceleration * acceleration;
+}
+
+//--------------------------------------------------------------
+void blobTracker::setDepthNoise(float measurement, float acceleration) {
+	depthR = measurement * measurement;
+	depthQ = acceleration * acceleration;
+}
+
+//--------------------------------------------------------------
+void blobTracker::clear() {
+	tracks.count = 0;
+}
+
+//--------------------------------------------------------------
+void blobTracker::predictAxis(axis & s, float dt, float q) {
+	// x' = F x and P' = F P F^T + Q, with F = [1 dt; 0 1] and Q the
+	// covariance of a random acceleration over dt
+	float dt2 = dt * dt;
+	s.p += s.v * dt;
+	s.a += 2 * dt * s.b + dt2 * s.c + q * dt2 * dt2 / 4;
+	s.b += dt * s.c + q * dt2 * dt / 2;
+	s.c += q * dt2;
+}
+
+//--------------------------------------------------------------
+void blobTracker::correctAxis(axis & s, float z, float r) {
+	// only the position is measured, so the gain is just P's first column
+	// over the innovation variance
+	float k0 = s.a / (s.a + r);
+	float k1 = s.b / (s.a + r);
+	float e = z - s.p;
+	s.p += k0 * e;
+	s.v += k1 * e;
+	s.c -= k1 * s.b;
+	s.a *= 1 - k0;
+	s.b *= 1 - k0;
+}
+
+//--------------------------------------------------------------
+void blobTracker::startAxis(axis & s, float z, float r, float q) {
+	// the position is as good as one measurement, and the velocity could
+	// be anything a second of acceleration could reach
+	s.p = z;
+	s.v = 0;
+	s.a = r;
+	s.b = 0;
+	s.c = q;
+}
+
+//--------------------------------------------------------------
+void blobTracker::update(const blobList & blobs, float dt) {
+	int n = tracks.count;
+
+	// move every track on to now
+	for (int t = 0; t < n; t++){
+		predictAxis(ax[t], dt, q);
+		predictAxis(ay[t], dt, q);
+		predictAxis(az[t], dt, depthQ);
+		tracks.blob[t] = -1;
+	}
+
+	// every track/blob pair inside the gate, closest first
+	struct pair {
+		float distance;
+		int track, blob;
+		bool operator < (const pair & o) const { return distance < o.distance; }
+	};
+	pair pairs[TRACK_LIST_SIZE * BLOB_LIST_SIZE];
+	int pairCount = 0;
+	float gate2 = gate * gate;
+	for (int t = 0; t < n; t++){
+		for (int b = 0; b < blobs.count; b++){
+			float dx = blobs.centroidX[b] - ax[t].p;
+			float dy = blobs.centroidY[b] - ay[t].p;
+			float d = dx*dx + dy*dy;
+			if (d <= gate2) {
+				pairs[pairCount].distance = d;
+				pairs[pairCount].track = t;
+				pairs[pairCount].blob = b;
+				pairCount++;
+			}
+		}
+	}
+	std::sort(pairs, pairs + pairCount);
+
+	bool blobUsed[BLOB_LIST_SIZE] = { false };
+	for (int i = 0; i < pairCount; i++){
+		int t = pairs[i].track, b = pairs[i].blob;
+		if (tracks.blob[t] >= 0 || blobUsed[b])
+			continue;
+		tracks.blob[t] = b;
+		blobUsed[b] = true;
+	}
+
+	// take the matched blobs in, and drop tracks that have been gone too
+	// long, keeping the rest in order
+	int kept = 0;
+	for (int t = 0; t < n; t++){
+		int b = tracks.blob[t];
+		if (b >= 0) {
+			correctAxis(ax[t], blobs.centroidX[b], r);
+			correctAxis(ay[t], blobs.centroidY[b], r);
+			correctAxis(az[t], blobs.depth[b], depthR);
+			tracks.misses[t] = 0;
+			tracks.area[t] = blobs.area[b];
+		} else if (++tracks.misses[t] > maxMisses) {
+			continue;
+		}
+		tracks.age[t]++;
+		if (kept != t) {
+			ax[kept] = ax[t];
+			ay[kept] = ay[t];
+			az[kept] = az[t];
+			tracks.id[kept] = tracks.id[t];
+			tracks.blob[kept] = tracks.blob[t];
+			tracks.age[kept] = tracks.age[t];
+			tracks.misses[kept] = tracks.misses[t];
+			tracks.area[kept] = tracks.area[t];
+		}
+		kept++;
+	}
+
+	// the leftover blobs start new tracks, biggest first while there's room
+	for (int b = 0; b < blobs.count && kept < TRACK_LIST_SIZE; b++){
+		if (blobUsed[b])
+			continue;
+		startAxis(ax[kept], blobs.centroidX[b], r, q);
+		startAxis(ay[kept], blobs.centroidY[b], r, q);
+		startAxis(az[kept], blobs.depth[b], depthR, depthQ);
+		tracks.id[kept] = nextId++;
+		tracks.blob[kept] = b;
+		tracks.age[kept] = 1;
+		tracks.misses[kept] = 0;
+		tracks.area[kept] = blobs.area[b];
+		kept++;
+	}
+	tracks.count = kept;
+
+	for (int t = 0; t < kept; t++){
+		tracks.x[t] = ax[t].p;
+		tracks.y[t] = ay[t].p;
+		tracks.depth[t] = az[t].p;
+		tracks.vx[t] = ax[t].v;
+		tracks.vy[t] = ay[t].v;
+		tracks.vdepth[t] = az[t].v;
+	}
+}
+
+//--------------------------------------------------------------
+trackList & blobTracker::getTracks() {
+	return tracks;
+}
+
+//--------------------------------------------------------------
+int blobTracker::find(int id) {
+	for (int t = 0; t < tracks.count; t++)
+		if (tracks.id[t] == id)
+			return t;
+	return -1;
+}
+
+//--------------------------------------------------------------
+void blobTracker::predict(int i, float seconds, float & x, float & y, float & depth) {
+	x = tracks.x[i] + tracks.vx[i] * seconds;
+	y = tracks.y[i] + tracks.vy[i] * seconds;
+	depth = tracks.depth[i] + tracks.vdepth[i] * seconds;
+}
@@ -0,0 +1,104 @@
+#ifndef _BLOB_TRACKER
+#define _BLOB_TRACKER
+
+#include "blobLabeller.h"
+
+// The most tracks a blobTracker keeps
+#define TRACK_LIST_SIZE BLOB_LIST_SIZE
+
+// The tracks kept by blobTracker, oldest first, so the first two are the
+// hands that have been there longest whatever order the blobs came in.
+// A structure of arrays with a fixed size, like blobList.
+struct trackList {
+	int count;
+	// stays the same for as long as the track lives, never reused
+	int id[TRACK_LIST_SIZE];
+	// the blob in the last blobList the track was matched to, -1 if it
+	// wasn't seen this frame and is coasting on its prediction
+	int blob[TRACK_LIST_SIZE];
+	// frames since the track started, and frames in a row it wasn't seen
+	int age[TRACK_LIST_SIZE];
+	int misses[TRACK_LIST_SIZE];
+	// smoothed centroid in pixels and mean raw depth, and their
+	// velocities per second
+	float x[TRACK_LIST_SIZE];
+	float y[TRACK_LIST_SIZE];
+	float depth[TRACK_LIST_SIZE];
+	float vx[TRACK_LIST_SIZE];
+	float vy[TRACK_LIST_SIZE];
+	float vdepth[TRACK_LIST_SIZE];
+	// the last matched blob's area
+	int area[TRACK_LIST_SIZE];
+};
+
+// Follows the blobs from blobLabeller from frame to frame, so each hand
+// keeps the same id however the blobs happen to be ordered, and smooths
+// their positions.
+//
+// Every track runs a constant velocity Kalman filter on its centroid and
+// depth, one 2 state filter per axis. Each frame the tracks are moved on
+// to where they should be now, and matched to the new blobs greedily,
+// closest pair first, as long as they are within the gate distance. With
+// at most TRACK_LIST_SIZE of each this is a handful of compares, and
+// nothing is allocated. Matched tracks take in their blob's position, the
+// rest coast on the prediction for up to maxMisses frames before they are
+// dropped, and blobs left over start new tracks.
+//
+// The filter gives the best estimate for the frame just processed, with
+// no frames held back, and predict() runs it forward to any time ahead
+// (eg. to make up for the latency between the camera and the screen).
+class blobTracker {
+
+	public:
+		blobTracker();
+
+		// Farthest a blob can be from a track's predicted position, in
+		// pixels, and still be matched to it
+		void setGate(float pixels);
+		// Frames a track can go unseen before it is dropped
+		void setMaxMisses(int frames);
+		// How much the filter trusts the blobs: measurement is the blob
+		// centroid's jitter and acceleration how sharply hands change speed,
+		// both standard deviations, in pixels and pixels per second squared
+		void setNoise(float measurement, float acceleration);
+		// The same for the depth, in raw steps
+		void setDepthNoise(float measurement, float acceleration);
+
+		// Drops every track
+		void clear();
+
+		// Takes in the blobs of a new frame, dt seconds after the last one
+		void update(const blobList & blobs, float dt);
+
+		trackList & getTracks();
+		// The index in getTracks() of the track with this id, or -1
+		int find(int id);
+		// Where track i should be seconds after the last update()
+		void predict(int i, float seconds, float & x, float & y, float & depth);
+
+	private:
+		// one axis of one track's filter, position p and velocity v with
+		// covariance [a b; b c]
+		struct axis {
+			float p, v;
+			float a, b, c;
+		};
+		void predictAxis(axis & s, float dt, float q);
+		void correctAxis(axis & s, float z, float r);
+		void startAxis(axis & s, float z, float r, float q);
+
+		// the filters, in the same order as tracks
+		axis ax[TRACK_LIST_SIZE];
+		axis ay[TRACK_LIST_SIZE];
+		axis az[TRACK_LIST_SIZE];
+
+		trackList tracks;
+		int nextId;
+		float gate;
+		int maxMisses;
+		// variances of the measurements and the accelerations
+		float r, q;
+		float depthR, depthQ;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "captureThread.h"
+#include "depthConversion.h"
+#include "timer.h"
+
+#include <string.h>
+
+//--------------------------------------------------------------
+const unsigned char * capturedFrame::getDepth() {
+	return depth.read();
+}
+
+//--------------------------------------------------------------
+const unsigned short * capturedFrame::getRawDepth() {
+	return (const unsigned short *) rawDepth.read();
+}
+
+//--------------------------------------------------------------
+const unsigned char * capturedFrame::getRGB() {
+	return rgb.read();
+}
+
+//--------------------------------------------------------------
+float capturedFrame::getDistanceAt(int x, int y) {
+	if (x < 0 || y < 0 || x >= width || y >= height)
+		return 0;
+	return rawDepthToCentimeters(getRawDepth()[y*width + x]);
+}
+
+//--------------------------------------------------------------
+captureThread::captureThread() {
+	source = NULL;
+	buffers = NULL;
+	frameNumber = 0;
+}
+
+//--------------------------------------------------------------
+captureThread::~captureThread() {
+	stopThread();
+}
+
+//--------------------------------------------------------------
+void captureThread::setup(frameSource * source, frameBufferPool * buffers) {
+	this->source = source;
+	this->buffers = buffers;
+	int w = source->getWidth();
+	int h = source->getHeight();
+	for (int i = 0; i < 3; i++){
+		capturedFrame & frame = frames.getBuffer(i);
+		frame.width = w;
+		frame.height = h;
+		frame.depth = buffers->acquire(w*h);
+		frame.rawDepth = buffers->acquire(w*h*sizeof(unsigned short));
+		frame.rgb = buffers->acquire(w*h*3);
+		memset(frame.depth.write(), 0, w*h);
+		memset(frame.rawDepth.write(), 0, w*h*sizeof(unsigned short));
+		memset(frame.rgb.write(), 0, w*h*3);
+		frame.rgbRegistered = source->isRGBRegistered();
+		frame.timestamp = 0;
+		frame.number = 0;
+	}
+}
+
+//--------------------------------------------------------------
+bool captureThread::waitForFrame(unsigned long long timeoutMicros) {
+	if (frames.update())
+		return true;
+	newFrame.wait(timeoutMicros);
+	return frames.update();
+}
+
+//--------------------------------------------------------------
+capturedFrame & captureThread::getFrame() {
+	return frames.getReadBuffer();
+}
+
+//--------------------------------------------------------------
+void captureThread::threadedFunction() {
+	while (isThreadRunning()) {
+		// neither ofxKinect nor the clips can tell us when a frame is
+		// ready, so poll often enough not to add noticeable latency
+		if (!source->update()) {
+			timerSleepMicros(500);
+			continue;
+		}
+
+		// The source's pixels are only good until its next update(), so
+		// this is the one copy every frame has to have. Pixels the
+		// processing still holds from an earlier frame are left alone.
+		capturedFrame & frame = frames.getWriteBuffer();
+		int count = frame.width*frame.height;
+		memcpy(frame.depth.overwrite(), source->getDepthPixels(), count);
+		memcpy(frame.rawDepth.overwrite(), source->getRawDepthPixels(), count*sizeof(unsigned short));
+		memcpy(frame.rgb.overwrite(), source->getRGBPixels(), count*3);
+		buffers->countCopy(count*(1 + sizeof(unsigned short) + 3));
+		frame.timestamp = source->getTimestamp();
+		frame.number = ++frameNumber;
+
+		frames.publish();
+		newFrame.signal();
+	}
+}
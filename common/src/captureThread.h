@@ -0,0 +1,65 @@
+#ifndef _CAPTURE_THREAD
+#define _CAPTURE_THREAD
+
+#include "frameSource.h"
+#include "frameBufferPool.h"
+#include "tripleBuffer.h"
+#include "workerThread.h"
+
+// A copy of one frame from a frameSource. The pixels are frameBuffers
+// (see frameBufferPool.h), so the processing can keep hold of them, eg. to
+// hand the RGB on to draw(), without copying them: the capture thread
+// fills in new ones rather than writing over pixels someone still holds.
+struct capturedFrame {
+	int width;
+	int height;
+	frameBuffer depth;
+	frameBuffer rawDepth;
+	// as the colour camera saw it, unless rgbRegistered (see
+	// frameSource::isRGBRegistered())
+	frameBuffer rgb;
+	bool rgbRegistered;
+	// capture time, in timerMicros() time
+	unsigned long long timestamp;
+	// counts up by one for every frame the source produced
+	unsigned int number;
+
+	// The pixels, read only
+	const unsigned char * getDepth();
+	const unsigned short * getRawDepth();
+	const unsigned char * getRGB();
+
+	// Distance in cm of the point at x,y of the depth map
+	float getDistanceAt(int x, int y);
+};
+
+// Pulls frames from a frameSource on its own thread, so the processing
+// thread can start on a frame as soon as it arrives. Only the newest frame
+// is kept: if processing falls behind, it skips straight to the latest one.
+class captureThread : public workerThread {
+
+	public:
+		captureThread();
+		~captureThread();
+
+		// The frames' pixels come from buffers, which counts the copies
+		// out of the source
+		void setup(frameSource * source, frameBufferPool * buffers);
+
+		// Consumer side. Waits up to timeoutMicros for a frame newer than the
+		// last one returned, and makes it the one getFrame() returns
+		bool waitForFrame(unsigned long long timeoutMicros);
+		capturedFrame & getFrame();
+
+	protected:
+		void threadedFunction();
+
+	private:
+		frameSource * source;
+		frameBufferPool * buffers;
+		tripleBuffer<capturedFrame> frames;
+		waitableEvent newFrame;
+		unsigned int frameNumber;
+};
+
+#endif
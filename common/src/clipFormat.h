@@ -0,0 +1,50 @@
+#ifndef _CLIP_FORMAT
+#define _CLIP_FORMAT
+
+#include <stdint.h>
+
+// Layout of a recorded kinect clip (.kdc), as written by clipWriter and
+// read back by fileFrameSource. Everything is stored in host byte order.
+//
+// The file is a clipHeader followed by fixed size frames. Each frame is
+// a clipFrameHeader and then the raw depth (16 bit), 8 bit depth and RGB
+// planes, back to back. The headers are 16 bytes and a frame's pixel count
+// has to be a multiple of 16 (640x480 is), so every plane stays aligned
+// when the file is memory mapped.
+//
+// The RGB plane is what the colour camera saw. Clips from before the
+// registration moved into depthRegistration have the older magic, and
+// their RGB is already lined up with the depth map.
+
+#define CLIP_MAGIC "KDCLIP02"
+#define CLIP_MAGIC_REGISTERED "KDCLIP01"
+
+// The largest width or height a clip can have, well above the kinect's
+// 640x480 but small enough that a frame's pixel counts fit in an int
+#define CLIP_MAX_SIDE 4096
+
+struct clipHeader {
+	char magic[8];
+	uint32_t width;
+	uint32_t height;
+	uint8_t reserved[16];
+};
+
+struct clipFrameHeader {
+	// capture time in microseconds, relative to the first frame
+	uint64_t timestamp;
+	uint8_t reserved[8];
+};
+
+// Whether a clip can have frames this size: not empty, no side over
+// CLIP_MAX_SIDE, and a pixel count that keeps the planes aligned
+inline bool clipFrameSizeValid(uint32_t width, uint32_t height) {
+	return width > 0 && height > 0 && width <= CLIP_MAX_SIDE && height <= CLIP_MAX_SIDE
+		&& (width * height) % 16 == 0;
+}
+
+inline uint64_t clipFrameSize(uint32_t width, uint32_t height) {
+	return sizeof(clipFrameHeader) + (uint64_t) width * height * (2 + 1 + 3);
+}
+
+#endif
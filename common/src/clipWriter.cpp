@@ -0,0 +1,99 @@
+#include "clipWriter.h"
+#include "clipFormat.h"
+
+#include <string.h>
+
+//--------------------------------------------------------------
+clipWriter::clipWriter() {
+	file = NULL;
+	width = 0;
+	height = 0;
+	frameCount = 0;
+	firstTimestamp = 0;
+}
+
+//--------------------------------------------------------------
+clipWriter::~clipWriter() {
+	close();
+}
+
+//--------------------------------------------------------------
+bool clipWriter::open(const char * path, int width, int height, bool rgbRegistered) {
+	close();
+
+	// fileFrameSource wouldn't read it back
+	if (width < 0 || height < 0 || !clipFrameSizeValid(width, height)) {
+		fprintf(stderr, "clipWriter: can't record %dx%d frames\n", width, height);
+		return false;
+	}
+
+	file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "clipWriter: could not open %s\n", path);
+		return false;
+	}
+
+	clipHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, rgbRegistered ? CLIP_MAGIC_REGISTERED : CLIP_MAGIC, sizeof(header.magic));
+	header.width = width;
+	header.height = height;
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		close();
+		return false;
+	}
+
+	this->width = width;
+	this->height = height;
+	frameCount = 0;
+	return true;
+}
+
+//--------------------------------------------------------------
+void clipWriter::close() {
+	if (file != NULL)
+		fclose(file);
+	file = NULL;
+}
+
+//--------------------------------------------------------------
+bool clipWriter::isOpen() {
+	return file != NULL;
+}
+
+//--------------------------------------------------------------
+bool clipWriter::addFrame(const unsigned short * rawDepth, const unsigned char * depth, const unsigned char * rgb, unsigned long long timestamp) {
+	if (file == NULL)
+		return false;
+
+	if (frameCount == 0)
+		firstTimestamp = timestamp;
+
+	clipFrameHeader header;
+	memset(&header, 0, sizeof(header));
+	header.timestamp = timestamp - firstTimestamp;
+
+	int count = width*height;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(rawDepth, sizeof(unsigned short), count, file) == (size_t) count
+		&& fwrite(depth, 1, count, file) == (size_t) count
+		&& fwrite(rgb, 3, count, file) == (size_t) count;
+
+	if (!ok) {
+		fprintf(stderr, "clipWriter: write failed, stopping recording\n");
+		close();
+		return false;
+	}
+	frameCount++;
+	return true;
+}
+
+//--------------------------------------------------------------
+bool clipWriter::addFrame(frameSource & source) {
+	return addFrame(source.getRawDepthPixels(), source.getDepthPixels(), source.getRGBPixels(), source.getTimestamp());
+}
+
+//--------------------------------------------------------------
+int clipWriter::getFrameCount() {
+	return frameCount;
+}
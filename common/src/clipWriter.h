@@ -0,0 +1,36 @@
+#ifndef _CLIP_WRITER
+#define _CLIP_WRITER
+
+#include <stdio.h>
+#include "frameSource.h"
+
+// Records frames to a clip file that fileFrameSource can play back,
+// see clipFormat.h for the layout
+class clipWriter {
+
+	public:
+		clipWriter();
+		~clipWriter();
+
+		// rgbRegistered says the RGB is already lined up with the depth
+		// (see frameSource::isRGBRegistered()), which only old clips are
+		bool open(const char * path, int width, int height, bool rgbRegistered = false);
+		void close();
+		bool isOpen();
+
+		// Appends the current frame of source. timestamp is in timerMicros()
+		// time and is stored relative to the first frame written
+		bool addFrame(const unsigned short * rawDepth, const unsigned char * depth, const unsigned char * rgb, unsigned long long timestamp);
+		bool addFrame(frameSource & source);
+
+		int getFrameCount();
+
+	private:
+		FILE * file;
+		int width;
+		int height;
+		int frameCount;
+		unsigned long long firstTimestamp;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "depthConversion.h"
+
+#include <math.h>
+
+#define RAW_DEPTH_VALUES 2048
+
+struct depthTables {
+	unsigned short millimeters[RAW_DEPTH_VALUES];
+	unsigned char display[RAW_DEPTH_VALUES];
+	// the last raw value with a real distance, every value after it is "far"
+	int lastValidRaw;
+
+	depthTables() {
+		lastValidRaw = -1;
+		for (int raw = 0; raw < RAW_DEPTH_VALUES; raw++){
+			float mm = 1000 * (0.1236f * tanf(raw / 2842.5f + 1.1863f) - 0.0370f);
+			// past raw ~1090 the tan goes through infinity and comes back
+			// negative, so stop at the first value that is out of range
+			bool valid = raw < RAW_DEPTH_VALUES - 1 && mm > 0 && mm <= DEPTH_MAX_MILLIMETERS
+				&& lastValidRaw == raw - 1;
+			if (!valid) {
+				millimeters[raw] = 0;
+				display[raw] = 0;
+				continue;
+			}
+			lastValidRaw = raw;
+			millimeters[raw] = (unsigned short) (mm + 0.5f);
+
+			float near = (DEPTH_DISPLAY_FAR - mm) / (DEPTH_DISPLAY_FAR - DEPTH_DISPLAY_NEAR);
+			near = near < 0 ? 0 : (near > 1 ? 1 : near);
+			display[raw] = (unsigned char) (near * 255 + 0.5f);
+		}
+	}
+};
+
+//--------------------------------------------------------------
+// Fills the tables the first time anything converts a depth, so they are
+// ready even for the constructors of other static objects that build
+// their own tables from them (depthRegistration, pointCloud, headTracker).
+// Those are all made on the main thread, before the capture and processing
+// threads start, so the tables are already there by the time they're shared.
+static const depthTables & getTables() {
+	static const depthTables tables;
+	return tables;
+}
+
+//--------------------------------------------------------------
+unsigned short rawDepthToMillimeters(unsigned short raw) {
+	return raw < RAW_DEPTH_VALUES ? getTables().millimeters[raw] : 0;
+}
+
+//--------------------------------------------------------------
+float rawDepthToCentimeters(unsigned short raw) {
+	return rawDepthToMillimeters(raw) * 0.1f;
+}
+
+//--------------------------------------------------------------
+unsigned short millimetersToRawDepth(float mm) {
+	// the table is increasing up to lastValidRaw, so binary search it
+	const depthTables & t = getTables();
+	int lo = 0, hi = t.lastValidRaw + 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (t.millimeters[mid] < mm)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (unsigned short) lo;
+}
+
+//--------------------------------------------------------------
+void rawDepthToMillimeters(const unsigned short * raw, unsigned short * mm, int count) {
+	const unsigned short * millimetersTable = getTables().millimeters;
+	for (int i = 0; i < count; i++)
+		mm[i] = millimetersTable[raw[i] & (RAW_DEPTH_VALUES - 1)];
+}
+
+//--------------------------------------------------------------
+void rawDepthToDisplay(const unsigned short * raw, unsigned char * display, int count) {
+	const unsigned char * displayTable = getTables().display;
+	for (int i = 0; i < count; i++)
+		display[i] = displayTable[raw[i] & (RAW_DEPTH_VALUES - 1)];
+}
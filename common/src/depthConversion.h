@@ -0,0 +1,33 @@
+#ifndef _DEPTH_CONVERSION
+#define _DEPTH_CONVERSION
+
+// Conversions for 11 bit raw kinect depth values, all done with tables
+// built once at startup from the same formula as ofxKinect.
+//
+// Raw values get bigger with distance, so the segmentation works on them
+// directly and only thresholds are converted. 2047 means no reading, and
+// so do the few values past where the formula stops making sense (further
+// than DEPTH_MAX_MILLIMETERS); they all count as far away.
+
+#define DEPTH_MAX_MILLIMETERS 10000
+
+// The 8 bit display view: DEPTH_DISPLAY_NEAR mm and nearer is white,
+// fading to black at DEPTH_DISPLAY_FAR, and no reading is black
+#define DEPTH_DISPLAY_NEAR 500
+#define DEPTH_DISPLAY_FAR 4000
+
+// Distance in millimeters, 0 for no reading
+unsigned short rawDepthToMillimeters(unsigned short raw);
+// Distance in centimeters, 0 for no reading
+float rawDepthToCentimeters(unsigned short raw);
+
+// The smallest raw value at least mm away, so a pixel is nearer than mm
+// exactly when its raw value is below this. Used to turn thresholds in
+// millimeters into raw ones.
+unsigned short millimetersToRawDepth(float mm);
+
+// Whole buffers at once, count is the number of pixels
+void rawDepthToMillimeters(const unsigned short * raw, unsigned short * mm, int count);
+void rawDepthToDisplay(const unsigned short * raw, unsigned char * display, int count);
+
+#endif
@@ -0,0 +1,330 @@
+#include "depthFilter.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+using std::min;
+using std::max;
+
+typedef void (*rowOp)(const unsigned short * a, const unsigned short * b, unsigned short * out, int count);
+
+// Raw values fit in 15 bits, so the signed 16 bit min/max of SSE2 will do
+
+//--------------------------------------------------------------
+static void rowMax(const unsigned short * a, const unsigned short * b, unsigned short * out, int count) {
+	int i = 0;
+#if defined(__AVX2__)
+	for (; i + 16 <= count; i += 16){
+		__m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+		_mm256_storeu_si256((__m256i *) (out + i), _mm256_max_epi16(va, vb));
+	}
+#elif defined(__SSE2__)
+	for (; i + 8 <= count; i += 8){
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+		_mm_storeu_si128((__m128i *) (out + i), _mm_max_epi16(va, vb));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for (; i + 8 <= count; i += 8)
+		vst1q_u16(out + i, vmaxq_u16(vld1q_u16(a + i), vld1q_u16(b + i)));
+#endif
+	for (; i < count; i++)
+		out[i] = max(a[i], b[i]);
+}
+
+//--------------------------------------------------------------
+static void rowMin(const unsigned short * a, const unsigned short * b, unsigned short * out, int count) {
+	int i = 0;
+#if defined(__AVX2__)
+	for (; i + 16 <= count; i += 16){
+		__m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+		_mm256_storeu_si256((__m256i *) (out + i), _mm256_min_epi16(va, vb));
+	}
+#elif defined(__SSE2__)
+	for (; i + 8 <= count; i += 8){
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+		_mm_storeu_si128((__m128i *) (out + i), _mm_min_epi16(va, vb));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for (; i + 8 <= count; i += 8)
+		vst1q_u16(out + i, vminq_u16(vld1q_u16(a + i), vld1q_u16(b + i)));
+#endif
+	for (; i < count; i++)
+		out[i] = min(a[i], b[i]);
+}
+
+//--------------------------------------------------------------
+// van Herk/Gil-Werman down the columns. rows holds count + 2*radius
+// input rows of width pixels, and output row j is the max (or min) of
+// rows j to j + 2*radius. The input is cut into blocks of one kernel
+// height, and any window covers the end of one block and the start of
+// the next, so it is the max of a suffix and a prefix of those blocks.
+static void verticalPass(const unsigned short ** rows, int count, int radius, int width, rowOp op,
+						 unsigned short * out, int outStride, unsigned short * prefix, unsigned short * suffix) {
+	if (radius == 0) {
+		for (int j = 0; j < count; j++)
+			memcpy(out + j*outStride, rows[j], width * sizeof(unsigned short));
+		return;
+	}
+	int k = 2*radius + 1;
+	int length = count + 2*radius;
+	for (int b = 0; b < length; b += k){
+		int e = min(b + k, length);
+		memcpy(prefix + b*width, rows[b], width * sizeof(unsigned short));
+		for (int i = b + 1; i < e; i++)
+			op(prefix + (i-1)*width, rows[i], prefix + i*width, width);
+		memcpy(suffix + (e-1)*width, rows[e-1], width * sizeof(unsigned short));
+		for (int i = e - 2; i >= b; i--)
+			op(suffix + (i+1)*width, rows[i], suffix + i*width, width);
+	}
+	for (int j = 0; j < count; j++)
+		op(suffix + j*width, prefix + (j+k-1)*width, out + j*outStride, width);
+}
+
+//--------------------------------------------------------------
+// Writes the transpose of the rows x cols image src into dst. The
+// horizontal passes are done as vertical ones on the transposed image,
+// so they get the same vector code.
+static void transpose(const unsigned short * src, int srcStride, unsigned short * dst, int dstStride, int rows, int cols) {
+	int r = 0;
+#if defined(__SSE2__)
+	// 8x8 blocks, by interleaving pixels, then pairs and quads
+	for (; r + 8 <= rows; r += 8){
+		int c = 0;
+		for (; c + 8 <= cols; c += 8){
+			__m128i a[8], b[8];
+			for (int i = 0; i < 8; i++)
+				a[i] = _mm_loadu_si128((const __m128i *) (src + (r+i)*srcStride + c));
+			for (int i = 0; i < 4; i++){
+				b[2*i] = _mm_unpacklo_epi16(a[2*i], a[2*i+1]);
+				b[2*i+1] = _mm_unpackhi_epi16(a[2*i], a[2*i+1]);
+			}
+			for (int g = 0; g < 2; g++){
+				a[4*g] = _mm_unpacklo_epi32(b[4*g], b[4*g+2]);
+				a[4*g+1] = _mm_unpackhi_epi32(b[4*g], b[4*g+2]);
+				a[4*g+2] = _mm_unpacklo_epi32(b[4*g+1], b[4*g+3]);
+				a[4*g+3] = _mm_unpackhi_epi32(b[4*g+1], b[4*g+3]);
+			}
+			for (int j = 0; j < 4; j++){
+				b[2*j] = _mm_unpacklo_epi64(a[j], a[j+4]);
+				b[2*j+1] = _mm_unpackhi_epi64(a[j], a[j+4]);
+			}
+			for (int i = 0; i < 8; i++)
+				_mm_storeu_si128((__m128i *) (dst + (c+i)*dstStride + r), b[i]);
+		}
+		for (; c < cols; c++){
+			for (int i = 0; i < 8; i++)
+				dst[c*dstStride + r + i] = src[(r+i)*srcStride + c];
+		}
+	}
+#endif
+	for (; r < rows; r++){
+		for (int c = 0; c < cols; c++)
+			dst[c*dstStride + r] = src[r*srcStride + c];
+	}
+}
+
+//--------------------------------------------------------------
+depthFilter::depthFilter() {
+	kernelWidth = 3;
+	kernelHeight = 3;
+}
+
+//--------------------------------------------------------------
+void depthFilter::setKernel(int kernelWidth, int kernelHeight) {
+	this->kernelWidth = max(kernelWidth, 1) | 1;
+	this->kernelHeight = max(kernelHeight, 1) | 1;
+}
+
+//--------------------------------------------------------------
+int depthFilter::getKernelWidth() {
+	return kernelWidth;
+}
+
+//--------------------------------------------------------------
+int depthFilter::getKernelHeight() {
+	return kernelHeight;
+}
+
+//--------------------------------------------------------------
+int depthFilter::getReachX() {
+	return 2 * (kernelWidth / 2);
+}
+
+//--------------------------------------------------------------
+int depthFilter::getReachY() {
+	return 2 * (kernelHeight / 2);
+}
+
+//--------------------------------------------------------------
+void depthFilter::close(const unsigned short * src, unsigned short * dst, int width, int height) {
+	close(src, dst, width, height, 0, 0, width, height);
+}
+
+//--------------------------------------------------------------
+void depthFilter::close(const unsigned short * src, unsigned short * dst, int width, int height, int x0, int y0, int x1, int y1) {
+	if (x0 >= x1 || y0 >= y1)
+		return;
+	int rx = kernelWidth / 2;
+	int ry = kernelHeight / 2;
+
+	// The erode needs the dilate over the rectangle plus the kernel
+	// radius, and the dilate needs src over that plus the radius again.
+	// The passes go:
+	//   min down the columns of src                  -> vertical
+	//   transpose                                    -> transposed
+	//   min down the columns (ie. along the rows)    -> dilated
+	//   max down the columns (ie. along the rows)    -> transposed
+	//   transpose back                               -> vertical
+	//   max down the columns                         -> dst
+	int dx0 = max(x0 - rx, 0), dx1 = min(x1 + rx, width);
+	int dy0 = max(y0 - ry, 0), dy1 = min(y1 + ry, height);
+	int sx0 = max(dx0 - rx, 0), sx1 = min(dx1 + rx, width);
+	int srcWidth = sx1 - sx0, dilatedWidth = dx1 - dx0, outWidth = x1 - x0;
+	int dilatedRows = dy1 - dy0, outRows = y1 - y0;
+
+	// carve the scratch space up
+	int padSize = max(srcWidth, max(dilatedRows, outWidth));
+	int scanSize = max(max((dilatedRows + 2*ry) * srcWidth, (outRows + 2*ry) * outWidth),
+					   (dilatedWidth + 2*rx) * dilatedRows);
+	int rowCount = max(max(dilatedRows, outRows) + 2*ry, dilatedWidth + 2*rx);
+	size_t size = 2*padSize + 2*scanSize + 2*dilatedRows*srcWidth + dilatedRows*dilatedWidth;
+	if (buffer.size() < size)
+		buffer.resize(size);
+	if ((int) rows.size() < rowCount)
+		rows.resize(rowCount);
+	unsigned short * nearest = &buffer[0];
+	unsigned short * farthest = nearest + padSize;
+	unsigned short * prefix = farthest + padSize;
+	unsigned short * suffix = prefix + scanSize;
+	unsigned short * vertical = suffix + scanSize;
+	unsigned short * transposed = vertical + dilatedRows*srcWidth;
+	unsigned short * dilated = transposed + dilatedRows*srcWidth;
+	std::fill(nearest, nearest + padSize, 0);
+	std::fill(farthest, farthest + padSize, 0x7fff);
+
+	// dilate, anything outside the image counts as far away so it never wins
+	for (int i = 0; i < dilatedRows + 2*ry; i++){
+		int y = dy0 - ry + i;
+		rows[i] = (y < 0 || y >= height) ? farthest : src + y*width + sx0;
+	}
+	verticalPass(&rows[0], dilatedRows, ry, srcWidth, rowMin, vertical, srcWidth, prefix, suffix);
+	transpose(vertical, srcWidth, transposed, dilatedRows, dilatedRows, srcWidth);
+	for (int i = 0; i < dilatedWidth + 2*rx; i++){
+		int x = dx0 - rx + i;
+		rows[i] = (x < sx0 || x >= sx1) ? farthest : transposed + (x - sx0)*dilatedRows;
+	}
+	verticalPass(&rows[0], dilatedWidth, rx, dilatedRows, rowMin, dilated, dilatedRows, prefix, suffix);
+
+	// erode, outside the image counts as right up against the camera
+	for (int i = 0; i < outWidth + 2*rx; i++){
+		int x = x0 - rx + i;
+		rows[i] = (x < dx0 || x >= dx1) ? nearest : dilated + (x - dx0)*dilatedRows;
+	}
+	verticalPass(&rows[0], outWidth, rx, dilatedRows, rowMax, transposed, dilatedRows, prefix, suffix);
+	transpose(transposed, dilatedRows, vertical, outWidth, outWidth, dilatedRows);
+	for (int i = 0; i < outRows + 2*ry; i++){
+		int y = y0 - ry + i;
+		rows[i] = (y < 0 || y >= height) ? nearest : vertical + (y - dy0)*outWidth;
+	}
+	verticalPass(&rows[0], outRows, ry, outWidth, rowMax, dst + y0*width + x0, width, prefix, suffix);
+}
+
+//--------------------------------------------------------------
+void depthCloseScalar(const unsigned short * src, unsigned short * dst, int width, int height, int kernelWidth, int kernelHeight) {
+	int rx = kernelWidth / 2, ry = kernelHeight / 2;
+	std::vector<unsigned short> dilated(width*height);
+	for (int y = 0; y < height; y++){
+		for (int x = 0; x < width; x++){
+			unsigned short v = 0x7fff;
+			for (int ky = max(y - ry, 0); ky <= min(y + ry, height - 1); ky++)
+				for (int kx = max(x - rx, 0); kx <= min(x + rx, width - 1); kx++)
+					v = min(v, src[ky*width + kx]);
+			dilated[y*width + x] = v;
+		}
+	}
+	for (int y = 0; y < height; y++){
+		for (int x = 0; x < width; x++){
+			unsigned short v = 0;
+			for (int ky = max(y - ry, 0); ky <= min(y + ry, height - 1); ky++)
+				for (int kx = max(x - rx, 0); kx <= min(x + rx, width - 1); kx++)
+					v = max(v, dilated[ky*width + kx]);
+			dst[y*width + x] = v;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+bool depthStabilize(const unsigned short * depth, unsigned short * stable, int count, int deadband) {
+	if (deadband <= 0) {
+		bool changed = memcmp(depth, stable, count * sizeof(unsigned short)) != 0;
+		memcpy(stable, depth, count * sizeof(unsigned short));
+		return changed;
+	}
+
+	// a pixel moves when |depth - stable| - deadband, with saturating
+	// subtraction, is non zero
+	unsigned short band = (unsigned short) min(deadband, 0xffff);
+	bool changed = false;
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i vband = _mm256_set1_epi16((short) band);
+	const __m256i zero = _mm256_setzero_si256();
+	for (; i + 16 <= count; i += 16){
+		__m256i d = _mm256_loadu_si256((const __m256i *) (depth + i));
+		__m256i s = _mm256_loadu_si256((const __m256i *) (stable + i));
+		__m256i diff = _mm256_or_si256(_mm256_subs_epu16(d, s), _mm256_subs_epu16(s, d));
+		__m256i keep = _mm256_cmpeq_epi16(_mm256_subs_epu16(diff, vband), zero);
+		if (_mm256_movemask_epi8(keep) != -1) {
+			changed = true;
+			_mm256_storeu_si256((__m256i *) (stable + i), _mm256_blendv_epi8(d, s, keep));
+		}
+	}
+#elif defined(__SSE2__)
+	const __m128i vband = _mm_set1_epi16((short) band);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8){
+		__m128i d = _mm_loadu_si128((const __m128i *) (depth + i));
+		__m128i s = _mm_loadu_si128((const __m128i *) (stable + i));
+		__m128i diff = _mm_or_si128(_mm_subs_epu16(d, s), _mm_subs_epu16(s, d));
+		__m128i keep = _mm_cmpeq_epi16(_mm_subs_epu16(diff, vband), zero);
+		if (_mm_movemask_epi8(keep) != 0xffff) {
+			changed = true;
+			_mm_storeu_si128((__m128i *) (stable + i), _mm_or_si128(_mm_and_si128(keep, s), _mm_andnot_si128(keep, d)));
+		}
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const uint16x8_t vband = vdupq_n_u16(band);
+	for (; i + 8 <= count; i += 8){
+		uint16x8_t d = vld1q_u16(depth + i);
+		uint16x8_t s = vld1q_u16(stable + i);
+		uint16x8_t move = vcgtq_u16(vabdq_u16(d, s), vband);
+		uint64x2_t any = vreinterpretq_u64_u16(move);
+		if (vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) {
+			changed = true;
+			vst1q_u16(stable + i, vbslq_u16(move, d, s));
+		}
+	}
+#endif
+
+	for (; i < count; i++){
+		int diff = depth[i] - stable[i];
+		if (diff > deadband || -diff > deadband) {
+			stable[i] = depth[i];
+			changed = true;
+		}
+	}
+	return changed;
+}
@@ -0,0 +1,61 @@
+#ifndef _DEPTH_FILTER
+#define _DEPTH_FILTER
+
+#include <vector>
+
+// The noise filter for the raw depth map: a morphological closing of the
+// near things (dilate, then erode) with a kernelWidth x kernelHeight
+// rectangle, which fills in the small dropouts and far specks inside a
+// hand. Raw values get smaller as things get nearer, so on the raw values
+// themselves the dilate is a min and the erode a max. 3x3 gives the same
+// result as the old ofxCvGrayscaleImage::dilate() followed by erode() on
+// the 8 bit view, bigger kernels close bigger holes.
+//
+// Each of the four passes (vertical and horizontal min, then max) uses
+// the van Herk/Gil-Werman algorithm, which costs 3 max/min per pixel
+// whatever the kernel size. Every pass works on whole rows at a time with
+// SSE2/NEON, 8 or 16 pixels per vector, the horizontal ones by transposing
+// the image in between. The dilate and erode are done in one go over the
+// rectangle, so the intermediate images stay small. Pixels outside the
+// image are ignored. Values must fit in 15 bits, which raw depth does.
+class depthFilter {
+
+	public:
+		depthFilter();
+
+		// Sizes are rounded up to odd, the default is 3x3
+		void setKernel(int kernelWidth, int kernelHeight);
+		int getKernelWidth();
+		int getKernelHeight();
+
+		// How many pixels outside the rectangle close() reads from src
+		int getReachX();
+		int getReachY();
+
+		// Filters the rectangle x0,y0 to x1-1,y1-1 of src into the same
+		// rectangle of dst, leaving the rest of dst alone. src and dst are
+		// both width x height images and must not overlap.
+		void close(const unsigned short * src, unsigned short * dst, int width, int height, int x0, int y0, int x1, int y1);
+		// The whole image
+		void close(const unsigned short * src, unsigned short * dst, int width, int height);
+
+	private:
+		int kernelWidth;
+		int kernelHeight;
+
+		// scratch space, kept so nothing is allocated per frame
+		std::vector<unsigned short> buffer;
+		std::vector<const unsigned short *> rows;
+};
+
+// The closing done the obvious way, looking at every pixel under the
+// kernel. Slow, used to check depthFilter against.
+void depthCloseScalar(const unsigned short * src, unsigned short * dst, int width, int height, int kernelWidth, int kernelHeight);
+
+// Temporal filter: a pixel of stable only follows depth when they differ
+// by more than deadband (in raw units), so flicker of a step or two is held steady
+// while real movement goes straight through. Updates stable in place and
+// returns whether any pixel of it changed. count is the number of pixels.
+bool depthStabilize(const unsigned short * depth, unsigned short * stable, int count, int deadband);
+
+#endif
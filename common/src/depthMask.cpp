@@ -0,0 +1,79 @@
+#include "depthMask.h"
+#include "depthConversion.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+//--------------------------------------------------------------
+void depthMaskScalar(const unsigned short * depth, const unsigned short * limits, unsigned char * mask, int count, unsigned short cutoff, unsigned short closest) {
+	for (int i = 0; i < count; i++){
+		unsigned short limit = limits[i] < cutoff ? limits[i] : cutoff;
+		mask[i] = depth[i] < limit && depth[i] >= closest ? 255 : 0;
+	}
+}
+
+//--------------------------------------------------------------
+void depthMask(const unsigned short * depth, const unsigned short * limits, unsigned char * mask, int count, unsigned short cutoff, unsigned short closest) {
+	// Raw values are only 11 bits, so the signed 16 bit compares are safe.
+	// The 0xffff/0 lanes of two compares pack down to one vector of bytes.
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i vcut = _mm256_set1_epi16((short) cutoff);
+	const __m256i vclose = _mm256_set1_epi16((short) closest);
+	for (; i + 32 <= count; i += 32){
+		__m256i d0 = _mm256_loadu_si256((const __m256i *) (depth + i));
+		__m256i d1 = _mm256_loadu_si256((const __m256i *) (depth + i + 16));
+		__m256i l0 = _mm256_min_epi16(_mm256_loadu_si256((const __m256i *) (limits + i)), vcut);
+		__m256i l1 = _mm256_min_epi16(_mm256_loadu_si256((const __m256i *) (limits + i + 16)), vcut);
+		__m256i p0 = _mm256_andnot_si256(_mm256_cmpgt_epi16(vclose, d0), _mm256_cmpgt_epi16(l0, d0));
+		__m256i p1 = _mm256_andnot_si256(_mm256_cmpgt_epi16(vclose, d1), _mm256_cmpgt_epi16(l1, d1));
+		__m256i packed = _mm256_packs_epi16(p0, p1);
+		// packs works within each 128 bit half, put the quarters back in order
+		_mm256_storeu_si256((__m256i *) (mask + i), _mm256_permute4x64_epi64(packed, 0xd8));
+	}
+#elif defined(__SSE2__)
+	const __m128i vcut = _mm_set1_epi16((short) cutoff);
+	const __m128i vclose = _mm_set1_epi16((short) closest);
+	for (; i + 16 <= count; i += 16){
+		__m128i d0 = _mm_loadu_si128((const __m128i *) (depth + i));
+		__m128i d1 = _mm_loadu_si128((const __m128i *) (depth + i + 8));
+		__m128i l0 = _mm_min_epi16(_mm_loadu_si128((const __m128i *) (limits + i)), vcut);
+		__m128i l1 = _mm_min_epi16(_mm_loadu_si128((const __m128i *) (limits + i + 8)), vcut);
+		__m128i p0 = _mm_andnot_si128(_mm_cmplt_epi16(d0, vclose), _mm_cmplt_epi16(d0, l0));
+		__m128i p1 = _mm_andnot_si128(_mm_cmplt_epi16(d1, vclose), _mm_cmplt_epi16(d1, l1));
+		_mm_storeu_si128((__m128i *) (mask + i), _mm_packs_epi16(p0, p1));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const uint16x8_t vcut = vdupq_n_u16(cutoff);
+	const uint16x8_t vclose = vdupq_n_u16(closest);
+	for (; i + 16 <= count; i += 16){
+		uint16x8_t d0 = vld1q_u16(depth + i), d1 = vld1q_u16(depth + i + 8);
+		uint16x8_t p0 = vandq_u16(vcltq_u16(d0, vminq_u16(vld1q_u16(limits + i), vcut)), vcgeq_u16(d0, vclose));
+		uint16x8_t p1 = vandq_u16(vcltq_u16(d1, vminq_u16(vld1q_u16(limits + i + 8), vcut)), vcgeq_u16(d1, vclose));
+		vst1q_u8(mask + i, vcombine_u8(vmovn_u16(p0), vmovn_u16(p1)));
+	}
+#endif
+
+	// finish off whatever doesn't fill a whole vector
+	depthMaskScalar(depth + i, limits + i, mask + i, count - i, cutoff, closest);
+}
+
+//--------------------------------------------------------------
+void depthMaskLimits(const unsigned short * bg, unsigned short * limits, int count, int margin) {
+	// there are only 2048 possible background values, so work the limit
+	// out for each of them once
+	unsigned short table[2048];
+	for (int raw = 0; raw < 2048; raw++){
+		unsigned short mm = rawDepthToMillimeters(raw);
+		// no reading in the background, let anything through
+		table[raw] = mm == 0 ? 2047 : millimetersToRawDepth(mm - margin);
+	}
+	for (int i = 0; i < count; i++)
+		limits[i] = table[bg[i] & 2047];
+}
@@ -0,0 +1,28 @@
+#ifndef _DEPTH_MASK
+#define _DEPTH_MASK
+
+// Builds the foreground mask from the current raw depth frame and the
+// captured background in a single pass over memory. A pixel is 255 when
+// it is nearer than the cutoff but no nearer than closest, and at least a
+// margin nearer than the background was there (anything with a reading
+// passes where the background had none), and 0 otherwise.
+//
+// Both tests are done on raw values (see depthConversion.h). The cutoff
+// and closest are converted once with millimetersToRawDepth(), and the background test
+// is folded into a per pixel limit by depthMaskLimits() when the
+// background is captured, so each pixel is just
+// closest <= depth < min(limit, cutoff).
+//
+// count is the number of pixels, so to mask only part of a frame just
+// offset the pointers by whole rows.
+void depthMask(const unsigned short * depth, const unsigned short * limits, unsigned char * mask, int count, unsigned short cutoff, unsigned short closest = 0);
+
+// Plain C version of the above, used on cpus without SSE2/NEON and
+// as a reference to check the vectorized path against
+void depthMaskScalar(const unsigned short * depth, const unsigned short * limits, unsigned char * mask, int count, unsigned short cutoff, unsigned short closest = 0);
+
+// Works out the limits for depthMask() from a raw background frame, with
+// the margin in millimeters
+void depthMaskLimits(const unsigned short * bg, unsigned short * limits, int count, int margin = 25);
+
+#endif
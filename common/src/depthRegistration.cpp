@@ -0,0 +1,271 @@
+#include "depthRegistration.h"
+#include "depthConversion.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+const cameraIntrinsics KINECT_DEPTH_INTRINSICS = { 594.21434f, 591.04054f, 339.30781f, 242.73914f };
+const cameraIntrinsics KINECT_COLOR_INTRINSICS = { 529.21508f, 525.56394f, 328.94272f, 267.48068f };
+
+// and where the colour camera sits relative to the depth camera
+static const float defaultRotation[9] = {
+	 0.99984629f,  0.00126354f, -0.01748723f,
+	-0.00147791f,  0.99992386f, -0.01225138f,
+	 0.01747042f,  0.01227534f,  0.99977202f
+};
+static const float defaultTranslation[3] = { 19.985242f, -0.744237f, -10.916736f };
+
+//--------------------------------------------------------------
+depthRegistration::depthRegistration() {
+	width = 0;
+	height = 0;
+	depth = KINECT_DEPTH_INTRINSICS;
+	color = KINECT_COLOR_INTRINSICS;
+	memcpy(rotation, defaultRotation, sizeof(rotation));
+	memcpy(translation, defaultTranslation, sizeof(translation));
+	offsetX = 0;
+	offsetY = 0;
+	bDirty = true;
+	bx = by = bz = 0;
+	for (int raw = 0; raw < 2048; raw++)
+		depthTable[raw] = rawDepthToMillimeters(raw);
+}
+
+//--------------------------------------------------------------
+void depthRegistration::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+	ax.assign(width*height, 0);
+	ay.assign(width*height, 0);
+	az.assign(width*height, 0);
+	bDirty = true;
+	update();
+}
+
+//--------------------------------------------------------------
+void depthRegistration::setDepthIntrinsics(const cameraIntrinsics & intrinsics) {
+	depth = intrinsics;
+	bDirty = true;
+}
+
+//--------------------------------------------------------------
+void depthRegistration::setColorIntrinsics(const cameraIntrinsics & intrinsics) {
+	color = intrinsics;
+	bDirty = true;
+}
+
+//--------------------------------------------------------------
+void depthRegistration::setExtrinsics(const float * rotation, const float * translation) {
+	memcpy(this->rotation, rotation, sizeof(this->rotation));
+	memcpy(this->translation, translation, sizeof(this->translation));
+	bDirty = true;
+}
+
+//--------------------------------------------------------------
+void depthRegistration::setColorOffset(float x, float y) {
+	offsetX = x;
+	offsetY = y;
+	bDirty = true;
+}
+
+//--------------------------------------------------------------
+bool depthRegistration::update() {
+	if (!bDirty || width == 0)
+		return false;
+	// cleared first, so a change made while building still gets picked
+	// up next time
+	bDirty = false;
+	build();
+	return true;
+}
+
+//--------------------------------------------------------------
+void depthRegistration::build() {
+	// The offset moves the colour camera's principal point. For a depth
+	// pixel's ray r (z = 1) and depth z, the point in the colour camera is
+	// z*(R*r) + T, which projects to
+	//   u = (fx*(z*Rr.x + T.x) + cx*(z*Rr.z + T.z)) / (z*Rr.z + T.z)
+	// and the same for v, so everything but z goes into the table.
+	float cx = color.cx + offsetX;
+	float cy = color.cy + offsetY;
+	const float * R = rotation;
+	const float * T = translation;
+	for (int v = 0; v < height; v++){
+		float dy = (v - depth.cy) / depth.fy;
+		for (int u = 0; u < width; u++){
+			float dx = (u - depth.cx) / depth.fx;
+			float rx = R[0]*dx + R[1]*dy + R[2];
+			float ry = R[3]*dx + R[4]*dy + R[5];
+			float rz = R[6]*dx + R[7]*dy + R[8];
+			int i = v*width + u;
+			ax[i] = color.fx*rx + cx*rz;
+			ay[i] = color.fy*ry + cy*rz;
+			az[i] = rz;
+		}
+	}
+	bx = color.fx*T[0] + cx*T[2];
+	by = color.fy*T[1] + cy*T[2];
+	bz = T[2];
+}
+
+//--------------------------------------------------------------
+void depthRegistration::applyPixels(const unsigned short * rawDepth, const unsigned char * rgb, unsigned char * registered, int start, int end) {
+	for (int i = start; i < end; i++){
+		float z = depthTable[rawDepth[i] & 2047];
+		float w = z*az[i] + bz;
+		// rounded to the nearest colour pixel, NaNs (w == 0) fail the
+		// compares too
+		float x = (z*ax[i] + bx) / w + 0.5f;
+		float y = (z*ay[i] + by) / w + 0.5f;
+		unsigned char * out = registered + i*3;
+		if (z > 0 && x >= 0 && x < width && y >= 0 && y < height) {
+			const unsigned char * in = rgb + ((int) y*width + (int) x)*3;
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+		} else {
+			out[0] = out[1] = out[2] = 0;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void depthRegistration::applyScalar(const unsigned short * rawDepth, const unsigned char * rgb, unsigned char * registered, int y0, int y1) {
+	if (y1 < 0)
+		y1 = height;
+	applyPixels(rawDepth, rgb, registered, y0*width, y1*width);
+}
+
+//--------------------------------------------------------------
+void depthRegistration::apply(const unsigned short * rawDepth, const unsigned char * rgb, unsigned char * registered, int y0, int y1) {
+	if (y1 < 0)
+		y1 = height;
+	int i = y0*width;
+	int end = y1*width;
+	const float * pax = &ax[0];
+	const float * pay = &ay[0];
+	const float * paz = &az[0];
+
+#if defined(__AVX2__)
+	// 8 pixels at a time, gathering the colour pixels as 32 bits each.
+	// The last colour pixel would read a byte past the image, so its
+	// offset is pulled back and the extra byte shifted out.
+	const __m256 vbx = _mm256_set1_ps(bx), vby = _mm256_set1_ps(by), vbz = _mm256_set1_ps(bz);
+	const __m256 half = _mm256_set1_ps(0.5f), zero = _mm256_setzero_ps();
+	const __m256 vwidth = _mm256_set1_ps((float) width), vheight = _mm256_set1_ps((float) height);
+	const __m256i rowStride = _mm256_set1_epi32(width);
+	const __m256i lastOffset = _mm256_set1_epi32(width*height*3 - 4);
+	// the three colour bytes of each 32 bit lane, packed to the bottom of
+	// each 128 bit half
+	const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; i + 8 <= end; i += 8){
+		// plain loads measured well ahead of a gather for the depths, the
+		// table is small enough to stay in L1
+		const unsigned short * r = rawDepth + i;
+		__m256 z = _mm256_setr_ps(depthTable[r[0] & 2047], depthTable[r[1] & 2047], depthTable[r[2] & 2047], depthTable[r[3] & 2047],
+			depthTable[r[4] & 2047], depthTable[r[5] & 2047], depthTable[r[6] & 2047], depthTable[r[7] & 2047]);
+		__m256 w = _mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(paz + i)), vbz);
+		__m256 x = _mm256_add_ps(_mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(pax + i)), vbx), w), half);
+		__m256 y = _mm256_add_ps(_mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(pay + i)), vby), w), half);
+		__m256 valid = _mm256_and_ps(_mm256_cmp_ps(z, zero, _CMP_GT_OQ),
+			_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ), _mm256_cmp_ps(x, vwidth, _CMP_LT_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_GE_OQ), _mm256_cmp_ps(y, vheight, _CMP_LT_OQ))));
+		__m256i validMask = _mm256_castps_si256(valid);
+
+		// pixels that don't land anywhere read pixel 0 and are blacked out
+		__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(y), rowStride), _mm256_cvttps_epi32(x));
+		index = _mm256_and_si256(index, validMask);
+		__m256i offset = _mm256_add_epi32(_mm256_add_epi32(index, index), index);
+		__m256i clamped = _mm256_min_epi32(offset, lastOffset);
+		__m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(offset, clamped), 3);
+		__m256i pixels = _mm256_i32gather_epi32((const int *) rgb, clamped, 1);
+		pixels = _mm256_and_si256(_mm256_srlv_epi32(pixels, shift), validMask);
+		pixels = _mm256_shuffle_epi8(pixels, pack);
+
+		// 12 bytes from each half, without writing past the strip
+		unsigned char * out = registered + i*3;
+		__m128i lo = _mm256_castsi256_si128(pixels);
+		__m128i hi = _mm256_extracti128_si256(pixels, 1);
+		_mm_storel_epi64((__m128i *) out, lo);
+		int word = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+		memcpy(out + 8, &word, 4);
+		_mm_storel_epi64((__m128i *) (out + 12), hi);
+		word = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+		memcpy(out + 20, &word, 4);
+	}
+#elif defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+	// 4 pixels at a time for the projection, there is no gather so the
+	// colour pixels are then copied one by one
+	int index[4];
+	int valid[4];
+#if defined(__SSE2__)
+	const __m128 vbx = _mm_set1_ps(bx), vby = _mm_set1_ps(by), vbz = _mm_set1_ps(bz);
+	const __m128 half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps();
+	const __m128 vwidth = _mm_set1_ps((float) width), vheight = _mm_set1_ps((float) height);
+#else
+	const float32x4_t vbx = vdupq_n_f32(bx), vby = vdupq_n_f32(by), vbz = vdupq_n_f32(bz);
+	const float32x4_t half = vdupq_n_f32(0.5f), zero = vdupq_n_f32(0);
+	const float32x4_t vwidth = vdupq_n_f32((float) width), vheight = vdupq_n_f32((float) height);
+#endif
+	for (; i + 4 <= end; i += 4){
+		float z0 = depthTable[rawDepth[i] & 2047], z1 = depthTable[rawDepth[i + 1] & 2047];
+		float z2 = depthTable[rawDepth[i + 2] & 2047], z3 = depthTable[rawDepth[i + 3] & 2047];
+#if defined(__SSE2__)
+		__m128 z = _mm_setr_ps(z0, z1, z2, z3);
+		__m128 w = _mm_add_ps(_mm_mul_ps(z, _mm_loadu_ps(paz + i)), vbz);
+		__m128 x = _mm_add_ps(_mm_div_ps(_mm_add_ps(_mm_mul_ps(z, _mm_loadu_ps(pax + i)), vbx), w), half);
+		__m128 y = _mm_add_ps(_mm_div_ps(_mm_add_ps(_mm_mul_ps(z, _mm_loadu_ps(pay + i)), vby), w), half);
+		__m128 ok = _mm_and_ps(_mm_cmpgt_ps(z, zero),
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmplt_ps(x, vwidth)),
+				_mm_and_ps(_mm_cmpge_ps(y, zero), _mm_cmplt_ps(y, vheight))));
+		// the row times the width is exact in floats for any kinect sized image
+		__m128 row = _mm_cvtepi32_ps(_mm_cvttps_epi32(y));
+		__m128 column = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		_mm_storeu_si128((__m128i *) index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(row, vwidth), column)));
+		_mm_storeu_si128((__m128i *) valid, _mm_castps_si128(ok));
+#else
+		float zs[4] = { z0, z1, z2, z3 };
+		float32x4_t z = vld1q_f32(zs);
+		float32x4_t w = vaddq_f32(vmulq_f32(z, vld1q_f32(paz + i)), vbz);
+		float32x4_t x = vaddq_f32(vdivq_f32(vaddq_f32(vmulq_f32(z, vld1q_f32(pax + i)), vbx), w), half);
+		float32x4_t y = vaddq_f32(vdivq_f32(vaddq_f32(vmulq_f32(z, vld1q_f32(pay + i)), vby), w), half);
+		uint32x4_t ok = vandq_u32(vcgtq_f32(z, zero),
+			vandq_u32(vandq_u32(vcgeq_f32(x, zero), vcltq_f32(x, vwidth)),
+				vandq_u32(vcgeq_f32(y, zero), vcltq_f32(y, vheight))));
+		vst1q_s32(index, vmlaq_s32(vcvtq_s32_f32(x), vcvtq_s32_f32(y), vdupq_n_s32(width)));
+		vst1q_s32(valid, vreinterpretq_s32_u32(ok));
+#endif
+		// without branches, pixels that don't land anywhere read pixel 0
+		// and are blacked out
+		for (int k = 0; k < 4; k++){
+			const unsigned char * in = rgb + (index[k] & valid[k])*3;
+			unsigned char keep = (unsigned char) valid[k];
+			unsigned char * out = registered + (i + k)*3;
+			out[0] = in[0] & keep;
+			out[1] = in[1] & keep;
+			out[2] = in[2] & keep;
+		}
+	}
+#endif
+
+	// finish off whatever doesn't fill a whole vector
+	applyPixels(rawDepth, rgb, registered, i, end);
+}
+
+//--------------------------------------------------------------
+int depthRegistration::getWidth() {
+	return width;
+}
+
+//--------------------------------------------------------------
+int depthRegistration::getHeight() {
+	return height;
+}
@@ -0,0 +1,95 @@
+#ifndef _DEPTH_REGISTRATION
+#define _DEPTH_REGISTRATION
+
+#include <vector>
+
+// Pinhole model of a camera: focal lengths and principal point, in pixels
+struct cameraIntrinsics {
+	float fx, fy;
+	float cx, cy;
+};
+
+// The calibration most kinects come close to, from Nicolas Burrus'
+// kinect calibration page
+extern const cameraIntrinsics KINECT_DEPTH_INTRINSICS;
+extern const cameraIntrinsics KINECT_COLOR_INTRINSICS;
+
+// Lines the RGB image up with the depth map. ofxKinect did this with a
+// 2D translation (the calibration offsets we used to tune with the arrow
+// keys), worked out again for every pixel of every frame. This does the
+// full job instead: each depth pixel is turned into a 3D point with the
+// depth camera's intrinsics, moved into the colour camera with the
+// extrinsics, and projected with the colour camera's intrinsics.
+//
+// Everything that doesn't depend on the depth is worked out once into a
+// table with three floats per depth pixel, so a frame is one pass of
+//
+//   u = (z*ax + bx) / (z*az + bz),  v = (z*ay + by) / (z*az + bz)
+//
+// and a gather of the colour pixel at u,v. The table is only rebuilt by
+// update() when the calibration changed. The defaults are the usual kinect
+// calibration, which is close enough for most kinects; setColorOffset()
+// nudges the colour image for the rest.
+//
+// The colour image is taken to be the same size as the depth map, which
+// is how the kinect (and ofxKinect) hands them out.
+class depthRegistration {
+
+	public:
+		depthRegistration();
+
+		// Allocates the table for depth maps of this size
+		void setup(int width, int height);
+
+		void setDepthIntrinsics(const cameraIntrinsics & intrinsics);
+		void setColorIntrinsics(const cameraIntrinsics & intrinsics);
+		// Where the colour camera is: a point seen by the depth camera is at
+		// rotation * point + translation for the colour camera. rotation is
+		// 3x3, row major, translation is in millimeters.
+		void setExtrinsics(const float * rotation, const float * translation);
+		// Extra shift of the colour image in pixels, to tune it by hand.
+		// Safe to call from any thread.
+		void setColorOffset(float x, float y);
+
+		// Rebuilds the table if the calibration changed, returns true if it
+		// did. Call it from the thread that calls apply(), before a frame
+		// rather than between its strips.
+		bool update();
+
+		// Builds the registered RGB image for rows y0 to y1 (-1 for the
+		// bottom) of a raw depth map, from the image the colour camera saw.
+		// Pixels with no depth reading, or that land outside the colour
+		// image, are black. Strips of rows can run on different threads.
+		void apply(const unsigned short * rawDepth, const unsigned char * rgb, unsigned char * registered, int y0 = 0, int y1 = -1);
+		// Same thing without SIMD, to check apply() against
+		void applyScalar(const unsigned short * rawDepth, const unsigned char * rgb, unsigned char * registered, int y0 = 0, int y1 = -1);
+
+		int getWidth();
+		int getHeight();
+
+	private:
+		void build();
+		void applyPixels(const unsigned short * rawDepth, const unsigned char * rgb, unsigned char * registered, int start, int end);
+
+		int width;
+		int height;
+
+		cameraIntrinsics depth;
+		cameraIntrinsics color;
+		float rotation[9];
+		float translation[3];
+		volatile float offsetX;
+		volatile float offsetY;
+		// set when any of the above changes, update() rebuilds the table
+		volatile bool bDirty;
+
+		// per depth pixel, see above
+		std::vector<float> ax;
+		std::vector<float> ay;
+		std::vector<float> az;
+		float bx, by, bz;
+		// millimeters for every raw depth value, 0 for no reading
+		float depthTable[2048];
+};
+
+#endif
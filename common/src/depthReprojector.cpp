@@ -0,0 +1,304 @@
+#include "depthReprojector.h"
+#include "depthConversion.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// A z-buffer key is the raw depth in the top 11 bits and the source pixel
+// in the rest, so smaller is nearer. Raw 2047 (no reading) is never
+// warped, so no key is ever all ones.
+#define KEY_EMPTY 0xffffffffu
+#define KEY_INDEX_BITS 21
+#define KEY_INDEX_MASK ((1u << KEY_INDEX_BITS) - 1)
+
+// shift for raw values with no depth, far enough that nothing lands
+#define NO_SHIFT (1 << 24)
+
+//--------------------------------------------------------------
+// Fills the hole at keys[i] from the nearest keys within FILL_RADIUS
+// steps before and after it, if there are any on both sides. before and
+// after are how many steps there are to the edge of the image.
+static inline unsigned int fillKey(const unsigned int * keys, int i, int step, int before, int after) {
+	unsigned int k = keys[i];
+	if (k != KEY_EMPTY)
+		return k;
+	unsigned int a = KEY_EMPTY, b = KEY_EMPTY;
+	for (int r = FILL_RADIUS; r >= 1; r--){
+		if (r <= before && keys[i - r*step] != KEY_EMPTY)
+			a = keys[i - r*step];
+		if (r <= after && keys[i + r*step] != KEY_EMPTY)
+			b = keys[i + r*step];
+	}
+	// the farther of the two, and still empty if either side is
+	return a > b ? a : b;
+}
+
+//--------------------------------------------------------------
+// fillKey() for keys start to end-1, which all have FILL_RADIUS steps
+// on both sides. The output goes to out, which mustn't be keys.
+static void fillKeys(const unsigned int * keys, unsigned int * out, int start, int end, int step) {
+	int i = start;
+
+#if defined(__AVX2__)
+	const __m256i empty = _mm256_set1_epi32(-1);
+	for (; i + 8 <= end; i += 8){
+		__m256i a = empty, b = empty;
+		for (int r = FILL_RADIUS; r >= 1; r--){
+			__m256i ka = _mm256_loadu_si256((const __m256i *) (keys + i - r*step));
+			__m256i kb = _mm256_loadu_si256((const __m256i *) (keys + i + r*step));
+			a = _mm256_blendv_epi8(ka, a, _mm256_cmpeq_epi32(ka, empty));
+			b = _mm256_blendv_epi8(kb, b, _mm256_cmpeq_epi32(kb, empty));
+		}
+		__m256i k = _mm256_loadu_si256((const __m256i *) (keys + i));
+		__m256i fill = _mm256_max_epu32(a, b);
+		_mm256_storeu_si256((__m256i *) (out + i), _mm256_blendv_epi8(k, fill, _mm256_cmpeq_epi32(k, empty)));
+	}
+#elif defined(__SSE2__)
+	// no blend or unsigned max, so select with and/andnot, and compare
+	// with the sign bits flipped
+	const __m128i empty = _mm_set1_epi32(-1);
+	const __m128i sign = _mm_set1_epi32((int) 0x80000000u);
+	for (; i + 4 <= end; i += 4){
+		__m128i a = empty, b = empty;
+		for (int r = FILL_RADIUS; r >= 1; r--){
+			__m128i ka = _mm_loadu_si128((const __m128i *) (keys + i - r*step));
+			__m128i kb = _mm_loadu_si128((const __m128i *) (keys + i + r*step));
+			__m128i ea = _mm_cmpeq_epi32(ka, empty), eb = _mm_cmpeq_epi32(kb, empty);
+			a = _mm_or_si128(_mm_and_si128(ea, a), _mm_andnot_si128(ea, ka));
+			b = _mm_or_si128(_mm_and_si128(eb, b), _mm_andnot_si128(eb, kb));
+		}
+		__m128i aGreater = _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+		__m128i fill = _mm_or_si128(_mm_and_si128(aGreater, a), _mm_andnot_si128(aGreater, b));
+		__m128i k = _mm_loadu_si128((const __m128i *) (keys + i));
+		__m128i e = _mm_cmpeq_epi32(k, empty);
+		_mm_storeu_si128((__m128i *) (out + i), _mm_or_si128(_mm_and_si128(e, fill), _mm_andnot_si128(e, k)));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const uint32x4_t empty = vdupq_n_u32(KEY_EMPTY);
+	for (; i + 4 <= end; i += 4){
+		uint32x4_t a = empty, b = empty;
+		for (int r = FILL_RADIUS; r >= 1; r--){
+			uint32x4_t ka = vld1q_u32(keys + i - r*step);
+			uint32x4_t kb = vld1q_u32(keys + i + r*step);
+			a = vbslq_u32(vceqq_u32(ka, empty), a, ka);
+			b = vbslq_u32(vceqq_u32(kb, empty), b, kb);
+		}
+		uint32x4_t k = vld1q_u32(keys + i);
+		vst1q_u32(out + i, vbslq_u32(vceqq_u32(k, empty), vmaxq_u32(a, b), k));
+	}
+#endif
+
+	// finish off whatever doesn't fill a whole vector
+	for (; i < end; i++)
+		out[i] = fillKey(keys, i, step, FILL_RADIUS, FILL_RADIUS);
+}
+
+//--------------------------------------------------------------
+depthReprojector::depthReprojector() {
+	width = 0;
+	height = 0;
+	intrinsics = KINECT_DEPTH_INTRINSICS;
+	pool = NULL;
+	rawDepth = NULL;
+	mask = NULL;
+	rgb = NULL;
+	warped = 0;
+	filledIn = 0;
+	setViewpoint(0, 0, 0);
+}
+
+//--------------------------------------------------------------
+void depthReprojector::setup(int width, int height) {
+	if (width*height > (1 << KEY_INDEX_BITS)) {
+		fprintf(stderr, "depthReprojector: %dx%d is too big\n", width, height);
+		return;
+	}
+	this->width = width;
+	this->height = height;
+	keys.assign(width*height, KEY_EMPTY);
+	filled.assign(width*height, KEY_EMPTY);
+	color.assign(width*height*3, 0);
+	alpha.assign(width*height, 0);
+}
+
+//--------------------------------------------------------------
+void depthReprojector::setIntrinsics(const cameraIntrinsics & intrinsics) {
+	this->intrinsics = intrinsics;
+	setViewpoint(viewX, viewY, viewPivot);
+}
+
+//--------------------------------------------------------------
+void depthReprojector::setPool(threadPool * pool) {
+	this->pool = pool;
+}
+
+//--------------------------------------------------------------
+void depthReprojector::setViewpoint(float x, float y, float pivot) {
+	viewX = x;
+	viewY = y;
+	viewPivot = pivot;
+	float invPivot = pivot > 0 ? 1 / pivot : 0;
+	minShiftY = 0;
+	maxShiftY = 0;
+	for (int raw = 0; raw < 2048; raw++){
+		unsigned short mm = rawDepthToMillimeters(raw);
+		if (mm == 0) {
+			shiftX[raw] = NO_SHIFT;
+			shiftY[raw] = NO_SHIFT;
+			continue;
+		}
+		float parallax = 1000.0f / mm - invPivot;
+		shiftX[raw] = (int) floorf(-intrinsics.fx * x * parallax + 0.5f);
+		shiftY[raw] = (int) floorf(-intrinsics.fy * y * parallax + 0.5f);
+		if (shiftY[raw] < minShiftY)
+			minShiftY = shiftY[raw];
+		if (shiftY[raw] > maxShiftY)
+			maxShiftY = shiftY[raw];
+	}
+}
+
+//--------------------------------------------------------------
+void depthReprojector::update(const unsigned short * rawDepth, const unsigned char * mask, const unsigned char * rgb) {
+	if (width == 0)
+		return;
+	this->rawDepth = rawDepth;
+	this->mask = mask;
+	this->rgb = rgb;
+	warped = 0;
+	filledIn = 0;
+	// what each pass reads and writes per output row
+	runStrips(width*(1 + 2 + 4), &depthReprojector::warpStrip);
+	runStrips(width*(4 + 4), &depthReprojector::fillRowStrip);
+	runStrips(width*(4*(2*FILL_RADIUS + 1) + 4 + 3 + 3 + 1), &depthReprojector::fillColumnStrip);
+}
+
+//--------------------------------------------------------------
+void depthReprojector::runStrips(int rowBytes, void (depthReprojector::*method)(int, int, int)) {
+	if (pool != NULL)
+		pool->forStrips(height, rowBytes, this, method);
+	else
+		(this->*method)(0, height, 0);
+}
+
+//--------------------------------------------------------------
+void depthReprojector::warpStrip(int y0, int y1, int thread) {
+	unsigned int * out = &keys[0];
+	for (int i = y0*width; i < y1*width; i++)
+		out[i] = KEY_EMPTY;
+
+	// the source rows that can land in y0..y1
+	int s0 = y0 - maxShiftY, s1 = y1 - minShiftY;
+	s0 = s0 < 0 ? 0 : s0;
+	s1 = s1 > height ? height : s1;
+	int count = 0;
+	for (int v = s0; v < s1; v++){
+		const unsigned char * maskRow = mask + v*width;
+		int u = 0;
+		while (u < width){
+			// skip 8 unmasked pixels at a time
+			uint64_t eight;
+			if (u + 8 <= width) {
+				memcpy(&eight, maskRow + u, 8);
+				if (eight == 0) {
+					u += 8;
+					continue;
+				}
+			}
+			int end = u + 8 < width ? u + 8 : width;
+			for (; u < end; u++){
+				if (maskRow[u] == 0)
+					continue;
+				int i = v*width + u;
+				int raw = rawDepth[i] & 2047;
+				int tv = v + shiftY[raw];
+				int tu = u + shiftX[raw];
+				if (tv < y0 || tv >= y1 || tu < 0 || tu >= width)
+					continue;
+				unsigned int key = ((unsigned int) raw << KEY_INDEX_BITS) | i;
+				unsigned int & k = out[tv*width + tu];
+				count += k == KEY_EMPTY;
+				k = key < k ? key : k;
+			}
+		}
+	}
+	__sync_fetch_and_add(&warped, count);
+}
+
+//--------------------------------------------------------------
+void depthReprojector::fillRowStrip(int y0, int y1, int thread) {
+	const unsigned int * in = &keys[0];
+	unsigned int * out = &filled[0];
+	int r = FILL_RADIUS < width ? FILL_RADIUS : width;
+	for (int y = y0; y < y1; y++){
+		int row = y*width;
+		// the ends of the row, where the neighbours run out
+		for (int x = 0; x < r; x++)
+			out[row + x] = fillKey(in, row + x, 1, x, width - 1 - x);
+		for (int x = width - r > r ? width - r : r; x < width; x++)
+			out[row + x] = fillKey(in, row + x, 1, x, width - 1 - x);
+		if (width > 2*r)
+			fillKeys(in, out, row + r, row + width - r, 1);
+	}
+}
+
+//--------------------------------------------------------------
+void depthReprojector::fillColumnStrip(int y0, int y1, int thread) {
+	const unsigned int * in = &filled[0];
+	unsigned int * out = &keys[0];
+	int count = 0;
+	for (int y = y0; y < y1; y++){
+		int row = y*width;
+		if (y >= FILL_RADIUS && y < height - FILL_RADIUS)
+			fillKeys(in, out, row, row + width, width);
+		else {
+			for (int x = 0; x < width; x++)
+				out[row + x] = fillKey(in, row + x, width, y, height - 1 - y);
+		}
+
+		// and the colour of whichever source pixel ended up here, with
+		// empty pixels reading pixel 0 and blacked out
+		unsigned char * c = &color[row*3];
+		unsigned char * a = &alpha[row];
+		for (int x = 0; x < width; x++){
+			unsigned int k = out[row + x];
+			unsigned char keep = k != KEY_EMPTY ? 255 : 0;
+			const unsigned char * src = rgb + (keep ? k & KEY_INDEX_MASK : 0)*3;
+			c[x*3  ] = src[0] & keep;
+			c[x*3+1] = src[1] & keep;
+			c[x*3+2] = src[2] & keep;
+			a[x] = keep;
+			count += keep & 1;
+		}
+	}
+	__sync_fetch_and_add(&filledIn, count);
+}
+
+//--------------------------------------------------------------
+unsigned char * depthReprojector::getColor() {
+	return &color[0];
+}
+
+//--------------------------------------------------------------
+unsigned char * depthReprojector::getAlpha() {
+	return &alpha[0];
+}
+
+//--------------------------------------------------------------
+int depthReprojector::getWarpedCount() {
+	return warped;
+}
+
+//--------------------------------------------------------------
+int depthReprojector::getFilledCount() {
+	return filledIn - warped;
+}
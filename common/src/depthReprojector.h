@@ -0,0 +1,111 @@
+#ifndef _DEPTH_REPROJECTOR
+#define _DEPTH_REPROJECTOR
+
+#include <vector>
+
+#include "depthRegistration.h"
+#include "threadPool.h"
+
+// How far (in pixels) fill looks either side of a hole, so cracks up to
+// 2*FILL_RADIUS-1 pixels wide are closed
+#define FILL_RADIUS 2
+
+// Redraws the masked part of a colour image as it would look from a
+// camera moved sideways and up or down, moving every pixel by its own
+// depth. That is the parallax demo's effect done properly: rather than
+// the whole foreground sliding as one flat layer, near parts move more
+// than far ones.
+//
+// For a camera moved by x,y (and not turned) a pixel at depth z moves by
+// -fx*x/z, -fy*y/z. So that the background stays put, the shift is taken
+// relative to a pivot distance, where things don't move at all (like the
+// plane of the screen). There are only 2048 raw depths, so the shifts are
+// worked out per raw value whenever the viewpoint changes, and each pixel
+// is one table lookup and an add.
+//
+// update() runs three passes, each over the whole frame before the next:
+//
+// - warp: every masked pixel is moved to where it lands. When several
+//   land on the same spot the nearest wins, going by a z-buffer that holds
+//   the raw depth and the source pixel in one 32 bit key, so the nearer
+//   (and then the earlier) pixel wins whatever order they land in. Runs
+//   of unmasked pixels are skipped 8 at a time.
+// - fill: a warped surface that got stretched has cracks. A pixel with
+//   nothing on it but something within FILL_RADIUS on both sides takes the
+//   farther of the two, first along rows and then down columns, both with
+//   SIMD. Holes bigger than that, and the space around the foreground,
+//   are left empty.
+// - colour: the RGB and alpha of whichever source pixel each key points
+//   at, in the same pass as the fill down columns.
+//
+// Given a threadPool each pass is split into strips of output rows. A
+// strip of the warp reads every source row that could land in it, going
+// by the biggest vertical shift, and only writes its own rows, so the
+// output is exactly the same as on one thread.
+//
+// Frames can have up to 2^21 pixels.
+class depthReprojector {
+
+	public:
+		depthReprojector();
+
+		void setup(int width, int height);
+		// The depth camera's intrinsics, KINECT_DEPTH_INTRINSICS by default
+		void setIntrinsics(const cameraIntrinsics & intrinsics);
+		// Runs the passes on the pool's threads, NULL (the default) runs
+		// them on the calling thread
+		void setPool(threadPool * pool);
+
+		// Where the virtual camera is, in meters from the real one (x right,
+		// y down), and the distance in meters that stays put
+		void setViewpoint(float x, float y, float pivot);
+
+		// Reprojects the pixels of rgb that are set in mask, using the raw
+		// depth map they line up with. Everything should be width*height.
+		void update(const unsigned short * rawDepth, const unsigned char * mask, const unsigned char * rgb);
+
+		// The reprojected image, and its alpha: 255 where something landed
+		// (or was filled in), 0 elsewhere, where the RGB is black
+		unsigned char * getColor();
+		unsigned char * getAlpha();
+		// Pixels that something landed on, and that were filled in, in the
+		// last update()
+		int getWarpedCount();
+		int getFilledCount();
+
+	private:
+		void warpStrip(int y0, int y1, int thread);
+		void fillRowStrip(int y0, int y1, int thread);
+		void fillColumnStrip(int y0, int y1, int thread);
+		void runStrips(int rowBytes, void (depthReprojector::*method)(int, int, int));
+
+		int width;
+		int height;
+		cameraIntrinsics intrinsics;
+		threadPool * pool;
+
+		// how far a pixel at each raw depth moves, in whole pixels, and the
+		// range of the vertical shifts over real depths
+		int shiftX[2048];
+		int shiftY[2048];
+		int minShiftY, maxShiftY;
+		float viewX, viewY, viewPivot;
+
+		// the z-buffer keys: after the warp, after filling along rows, and
+		// after filling down columns (back in the first one)
+		std::vector<unsigned int> keys;
+		std::vector<unsigned int> filled;
+		std::vector<unsigned char> color;
+		std::vector<unsigned char> alpha;
+
+		// this frame's input, for the strips
+		const unsigned short * rawDepth;
+		const unsigned char * mask;
+		const unsigned char * rgb;
+
+		// counted up by the strips
+		volatile int warped;
+		volatile int filledIn;
+};
+
+#endif
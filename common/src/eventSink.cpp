@@ -0,0 +1,131 @@
+#include "eventSink.h"
+#include "timer.h"
+
+//--------------------------------------------------------------
+recordingEventSink::recordingEventSink() {
+	pthread_mutex_init(&mutex, NULL);
+}
+
+//--------------------------------------------------------------
+recordingEventSink::~recordingEventSink() {
+	pthread_mutex_destroy(&mutex);
+}
+
+//--------------------------------------------------------------
+void recordingEventSink::send(const keyEvent * events, int count) {
+	pthread_mutex_lock(&mutex);
+	this->events.insert(this->events.end(), events, events + count);
+	pthread_mutex_unlock(&mutex);
+}
+
+//--------------------------------------------------------------
+std::vector<keyEvent> recordingEventSink::getEvents() {
+	pthread_mutex_lock(&mutex);
+	std::vector<keyEvent> copy = events;
+	pthread_mutex_unlock(&mutex);
+	return copy;
+}
+
+//--------------------------------------------------------------
+int recordingEventSink::getCount() {
+	pthread_mutex_lock(&mutex);
+	int count = (int) events.size();
+	pthread_mutex_unlock(&mutex);
+	return count;
+}
+
+//--------------------------------------------------------------
+void recordingEventSink::clear() {
+	pthread_mutex_lock(&mutex);
+	events.clear();
+	pthread_mutex_unlock(&mutex);
+}
+
+//--------------------------------------------------------------
+eventDispatcher::eventDispatcher() : latency("capture to sink", 500, 200) {
+	sink = NULL;
+	for (int k = 0; k < INPUT_KEY_COUNT; k++)
+		keyDown[k] = false;
+	coalesced = 0;
+	dropped = 0;
+}
+
+//--------------------------------------------------------------
+eventDispatcher::~eventDispatcher() {
+	stopThread();
+}
+
+//--------------------------------------------------------------
+void eventDispatcher::setup(eventSink * sink) {
+	this->sink = sink;
+}
+
+//--------------------------------------------------------------
+bool eventDispatcher::post(int key, bool down, unsigned long long timestamp) {
+	keyEvent event;
+	event.key = key;
+	event.down = down;
+	event.timestamp = timestamp;
+	if (!queue.push(event)) {
+		dropped++;
+		return false;
+	}
+	newEvent.signal();
+	return true;
+}
+
+//--------------------------------------------------------------
+bool eventDispatcher::isDown(int key) {
+	return keyDown[key];
+}
+
+//--------------------------------------------------------------
+latencyHistogram & eventDispatcher::getLatency() {
+	return latency;
+}
+
+//--------------------------------------------------------------
+int eventDispatcher::getCoalescedCount() {
+	return coalesced;
+}
+
+//--------------------------------------------------------------
+int eventDispatcher::getDroppedCount() {
+	return dropped;
+}
+
+//--------------------------------------------------------------
+void eventDispatcher::threadedFunction() {
+	while (isThreadRunning()) {
+		// the timeout only matters for noticing stopThread()
+		newEvent.wait(10000);
+		dispatch();
+	}
+	// send whatever was posted while stopping
+	dispatch();
+}
+
+//--------------------------------------------------------------
+void eventDispatcher::dispatch() {
+	// a batch at a time until the queue is empty
+	keyEvent event;
+	bool more = true;
+	while (more) {
+		int count = 0;
+		while (count < 256 && (more = queue.pop(event))){
+			if (event.key < 0 || event.key >= INPUT_KEY_COUNT || keyDown[event.key] == event.down) {
+				coalesced++;
+				continue;
+			}
+			keyDown[event.key] = event.down;
+			batch[count++] = event;
+		}
+		if (count == 0 || sink == NULL)
+			continue;
+
+		sink->send(batch, count);
+		unsigned long long now = timerMicros();
+		for (int i = 0; i < count; i++)
+			latency.add(now > batch[i].timestamp ? now - batch[i].timestamp : 0);
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef _EVENT_SINK
+#define _EVENT_SINK
+
+#include <pthread.h>
+#include <vector>
+
+#include "lockFreeQueue.h"
+#include "workerThread.h"
+#include "latencyHistogram.h"
+
+// The keys the demos can press, mapped to real key codes by each sink
+enum inputKey {
+	INPUT_KEY_LEFT,
+	INPUT_KEY_RIGHT,
+	INPUT_KEY_UP,
+	INPUT_KEY_DOWN,
+	INPUT_KEY_Z,
+	INPUT_KEY_X,
+	INPUT_KEY_SPACE,
+	INPUT_KEY_RETURN,
+	INPUT_KEY_COUNT
+};
+
+// One key going down or up. timestamp is the capture time (timerMicros())
+// of the frame that caused it, so the latency can be followed all the way
+// to the sink.
+struct keyEvent {
+	int key;
+	bool down;
+	unsigned long long timestamp;
+};
+
+// Where key events end up, eg. the OS (macEventSink, uinputEventSink) or
+// a list for checking them (recordingEventSink). send() gets a batch of
+// events in order, and is only ever called from the dispatcher's thread.
+class eventSink {
+
+	public:
+		virtual ~eventSink() {}
+
+		virtual void send(const keyEvent * events, int count) = 0;
+};
+
+// Keeps every event it is sent, for tests and the benchmark
+class recordingEventSink : public eventSink {
+
+	public:
+		recordingEventSink();
+		~recordingEventSink();
+
+		void send(const keyEvent * events, int count);
+
+		// A copy of what was sent so far, safe from any thread
+		std::vector<keyEvent> getEvents();
+		int getCount();
+		void clear();
+
+	private:
+		pthread_mutex_t mutex;
+		std::vector<keyEvent> events;
+};
+
+// Takes key events from the processing loop and hands them to a sink on
+// its own thread, so a slow sink never holds up a frame. post() only puts
+// the event in a lock free queue (see lockFreeQueue.h). The dispatcher
+// wakes up, takes everything that is queued, drops the events that
+// wouldn't change anything (a key going down that is already down, or up
+// that is already up), and sends the rest to the sink as one batch.
+//
+// Only one thread may post().
+class eventDispatcher : public workerThread {
+
+	public:
+		eventDispatcher();
+		~eventDispatcher();
+
+		// The sink has to outlive the dispatcher, or be swapped out while
+		// the thread isn't running
+		void setup(eventSink * sink);
+
+		// Queues a key event, returns false if the queue is full and it
+		// was dropped
+		bool post(int key, bool down, unsigned long long timestamp);
+
+		// Whether the dispatcher has sent key down (to the sink)
+		bool isDown(int key);
+
+		// Capture to sink times of the events sent. Only read them once
+		// the thread has stopped.
+		latencyHistogram & getLatency();
+		// events dropped because they changed nothing or the queue was full
+		int getCoalescedCount();
+		int getDroppedCount();
+
+	protected:
+		void threadedFunction();
+
+	private:
+		void dispatch();
+
+		eventSink * sink;
+		lockFreeQueue<keyEvent, 256> queue;
+		waitableEvent newEvent;
+		// the state of every key as the sink last saw it
+		volatile bool keyDown[INPUT_KEY_COUNT];
+		keyEvent batch[256];
+		latencyHistogram latency;
+		int coalesced;
+		volatile int dropped;
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "fileFrameSource.h"
+#include "timer.h"
+#include "depthConversion.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//--------------------------------------------------------------
+fileFrameSource::fileFrameSource() {
+	data = NULL;
+	dataSize = 0;
+	frameSize = 0;
+	width = 0;
+	height = 0;
+	frameCount = 0;
+	currentFrame = -1;
+	bRealtime = true;
+	bLoop = true;
+	bFinished = false;
+	bRGBRegistered = false;
+	startTime = 0;
+	timestamp = 0;
+}
+
+//--------------------------------------------------------------
+fileFrameSource::~fileFrameSource() {
+	close();
+}
+
+//--------------------------------------------------------------
+bool fileFrameSource::open(const char * path) {
+	close();
+
+#ifdef _WIN32
+	fprintf(stderr, "fileFrameSource: clip playback is not supported on windows\n");
+	return false;
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "fileFrameSource: could not open %s\n", path);
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(clipHeader)) {
+		fprintf(stderr, "fileFrameSource: %s is not a clip\n", path);
+		::close(fd);
+		return false;
+	}
+
+	// Mapped private and writable so that if anyone does scribble on the
+	// pixels they get their own copy of the page rather than a crash
+	void * mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		fprintf(stderr, "fileFrameSource: could not map %s\n", path);
+		return false;
+	}
+	madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+	clipHeader * header = (clipHeader *) mapping;
+	bool registered = memcmp(header->magic, CLIP_MAGIC_REGISTERED, sizeof(header->magic)) == 0;
+	if (!registered && memcmp(header->magic, CLIP_MAGIC, sizeof(header->magic)) != 0) {
+		fprintf(stderr, "fileFrameSource: %s is not a clip\n", path);
+		munmap(mapping, st.st_size);
+		return false;
+	}
+
+	// A corrupt header could have the demos allocate nothing, overflow
+	// working out how much to allocate, or hand out unaligned planes
+	if (!clipFrameSizeValid(header->width, header->height)) {
+		fprintf(stderr, "fileFrameSource: %s has a bad frame size (%ux%u)\n",
+			path, (unsigned) header->width, (unsigned) header->height);
+		munmap(mapping, st.st_size);
+		return false;
+	}
+	// The frame count comes from the file size, so a clip that was cut
+	// short (app crashed while recording) still plays up to the last
+	// complete frame
+	uint64_t size = clipFrameSize(header->width, header->height);
+	uint64_t frames = ((uint64_t) st.st_size - sizeof(clipHeader)) / size;
+	if (frames == 0) {
+		fprintf(stderr, "fileFrameSource: %s has no complete frames\n", path);
+		munmap(mapping, st.st_size);
+		return false;
+	}
+
+	data = (unsigned char *) mapping;
+	dataSize = st.st_size;
+	width = header->width;
+	height = header->height;
+	bRGBRegistered = registered;
+	frameSize = size;
+	frameCount = frames > INT_MAX ? INT_MAX : (int) frames;
+
+	currentFrame = -1;
+	bFinished = false;
+	return true;
+#endif
+}
+
+//--------------------------------------------------------------
+void fileFrameSource::close() {
+#ifndef _WIN32
+	if (data != NULL)
+		munmap(data, dataSize);
+#endif
+	data = NULL;
+	dataSize = 0;
+	frameCount = 0;
+	currentFrame = -1;
+}
+
+//--------------------------------------------------------------
+bool fileFrameSource::isOpen() {
+	return data != NULL;
+}
+
+//--------------------------------------------------------------
+void fileFrameSource::setRealtime(bool realtime) {
+	bRealtime = realtime;
+	// restart the clock so playback continues from the current frame
+	if (currentFrame >= 0)
+		startTime = timerMicros() - frameTime(currentFrame);
+}
+
+//--------------------------------------------------------------
+void fileFrameSource::setLoop(bool loop) {
+	bLoop = loop;
+}
+
+//--------------------------------------------------------------
+int fileFrameSource::getFrameCount() {
+	return frameCount;
+}
+
+//--------------------------------------------------------------
+int fileFrameSource::getCurrentFrame() {
+	return currentFrame;
+}
+
+//--------------------------------------------------------------
+bool fileFrameSource::isFinished() {
+	return bFinished;
+}
+
+//--------------------------------------------------------------
+bool fileFrameSource::update() {
+	if (frameCount == 0 || bFinished)
+		return false;
+
+	int next = currentFrame;
+	if (bRealtime) {
+		// skip ahead to the newest frame that is due, like a live
+		// camera would if we fell behind
+		if (currentFrame < 0)
+			startTime = timerMicros();
+		unsigned long long elapsed = timerMicros() - startTime;
+		if (elapsed >= clipLength()) {
+			if (!bLoop) {
+				bFinished = true;
+				return false;
+			}
+			startTime = timerMicros();
+			elapsed = 0;
+			next = -1;
+		}
+		if (next < 0)
+			next = 0;
+		while (next + 1 < frameCount && frameTime(next + 1) <= elapsed)
+			next++;
+	} else {
+		next++;
+		if (next >= frameCount) {
+			if (!bLoop) {
+				bFinished = true;
+				return false;
+			}
+			next = 0;
+		}
+	}
+
+	if (next == currentFrame)
+		return false;
+
+	currentFrame = next;
+	timestamp = timerMicros();
+	return true;
+}
+
+//--------------------------------------------------------------
+int fileFrameSource::getWidth() {
+	return width;
+}
+
+//--------------------------------------------------------------
+int fileFrameSource::getHeight() {
+	return height;
+}
+
+//--------------------------------------------------------------
+unsigned char * fileFrameSource::frameData(int index) {
+	return data + sizeof(clipHeader) + frameSize * (index < 0 ? 0 : index);
+}
+
+//--------------------------------------------------------------
+uint64_t fileFrameSource::frameTime(int index) {
+	return ((clipFrameHeader *) frameData(index))->timestamp;
+}
+
+//--------------------------------------------------------------
+uint64_t fileFrameSource::clipLength() {
+	// the last frame is shown for one (average) frame period
+	uint64_t last = frameTime(frameCount - 1);
+	if (frameCount < 2 || last == 0)
+		return last + 33333;
+	return last + last / (frameCount - 1);
+}
+
+//--------------------------------------------------------------
+unsigned short * fileFrameSource::getRawDepthPixels() {
+	if (frameCount == 0)
+		return NULL;
+	return (unsigned short *) (frameData(currentFrame) + sizeof(clipFrameHeader));
+}
+
+//--------------------------------------------------------------
+unsigned char * fileFrameSource::getDepthPixels() {
+	if (frameCount == 0)
+		return NULL;
+	return frameData(currentFrame) + sizeof(clipFrameHeader) + width*height*2;
+}
+
+//--------------------------------------------------------------
+unsigned char * fileFrameSource::getRGBPixels() {
+	if (frameCount == 0)
+		return NULL;
+	return frameData(currentFrame) + sizeof(clipFrameHeader) + width*height*3;
+}
+
+//--------------------------------------------------------------
+bool fileFrameSource::isRGBRegistered() {
+	return bRGBRegistered;
+}
+
+//--------------------------------------------------------------
+float fileFrameSource::getDistanceAt(int x, int y) {
+	if (frameCount == 0 || x < 0 || y < 0 || x >= width || y >= height)
+		return 0;
+	return rawDepthToCentimeters(getRawDepthPixels()[y*width + x]);
+}
+
+//--------------------------------------------------------------
+unsigned long long fileFrameSource::getTimestamp() {
+	return timestamp;
+}
@@ -0,0 +1,69 @@
+#ifndef _FILE_FRAME_SOURCE
+#define _FILE_FRAME_SOURCE
+
+#include <stddef.h>
+#include "frameSource.h"
+#include "clipFormat.h"
+
+// Plays back a clip recorded with clipWriter. The file is memory mapped
+// and the pixel pointers point straight into the mapping, so handing out
+// a frame doesn't copy anything. Lets the demos (and the benchmarks) run
+// without a kinect plugged in.
+class fileFrameSource : public frameSource {
+
+	public:
+		fileFrameSource();
+		~fileFrameSource();
+
+		bool open(const char * path);
+		void close();
+		bool isOpen();
+
+		// In realtime mode (the default) frames are handed out at the rate
+		// they were recorded, otherwise every update() moves to the next
+		// frame, so the pipeline runs as fast as the cpu allows
+		void setRealtime(bool realtime);
+		// Start over from the first frame when the end is reached (default on)
+		void setLoop(bool loop);
+
+		int getFrameCount();
+		int getCurrentFrame();
+		// true once the last frame has been handed out and looping is off
+		bool isFinished();
+
+		bool update();
+		int getWidth();
+		int getHeight();
+		unsigned char * getDepthPixels();
+		unsigned short * getRawDepthPixels();
+		unsigned char * getRGBPixels();
+		bool isRGBRegistered();
+		float getDistanceAt(int x, int y);
+		unsigned long long getTimestamp();
+
+	private:
+		unsigned char * frameData(int index);
+		uint64_t frameTime(int index);
+		uint64_t clipLength();
+
+		unsigned char * data;
+		size_t dataSize;
+		uint64_t frameSize;
+
+		int width;
+		int height;
+		int frameCount;
+		int currentFrame;
+
+		bool bRealtime;
+		bool bLoop;
+		bool bFinished;
+		// an old clip, see clipFormat.h
+		bool bRGBRegistered;
+
+		// timerMicros() of when playback (re)started, for realtime mode
+		unsigned long long startTime;
+		unsigned long long timestamp;
+};
+
+#endif
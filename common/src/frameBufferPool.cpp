@@ -0,0 +1,178 @@
+#include "frameBufferPool.h"
+#include "alignedMemory.h"
+
+#include <string.h>
+
+//--------------------------------------------------------------
+frameBuffer::frameBuffer() {
+	block = NULL;
+}
+
+//--------------------------------------------------------------
+frameBuffer::frameBuffer(frameBlock * block) {
+	this->block = block;
+}
+
+//--------------------------------------------------------------
+frameBuffer::frameBuffer(const frameBuffer & other) {
+	block = other.block;
+	if (block != NULL) {
+		__sync_add_and_fetch(&block->refs, 1);
+		block->pool->countShare(block->size);
+	}
+}
+
+//--------------------------------------------------------------
+frameBuffer::~frameBuffer() {
+	release();
+}
+
+//--------------------------------------------------------------
+frameBuffer & frameBuffer::operator=(const frameBuffer & other) {
+	if (other.block == block)
+		return *this;
+	// take the new reference before dropping the old one
+	frameBlock * old = block;
+	block = other.block;
+	if (block != NULL) {
+		__sync_add_and_fetch(&block->refs, 1);
+		block->pool->countShare(block->size);
+	}
+	if (old != NULL && __sync_sub_and_fetch(&old->refs, 1) == 0)
+		old->pool->recycle(old);
+	return *this;
+}
+
+//--------------------------------------------------------------
+void frameBuffer::release() {
+	if (block != NULL && __sync_sub_and_fetch(&block->refs, 1) == 0)
+		block->pool->recycle(block);
+	block = NULL;
+}
+
+//--------------------------------------------------------------
+bool frameBuffer::isEmpty() const {
+	return block == NULL;
+}
+
+//--------------------------------------------------------------
+size_t frameBuffer::getSize() const {
+	return block != NULL ? block->size : 0;
+}
+
+//--------------------------------------------------------------
+bool frameBuffer::isShared() const {
+	return block != NULL && block->refs > 1;
+}
+
+//--------------------------------------------------------------
+const unsigned char * frameBuffer::read() const {
+	return block != NULL ? block->data : NULL;
+}
+
+//--------------------------------------------------------------
+unsigned char * frameBuffer::write() {
+	if (block == NULL || block->refs == 1)
+		return block != NULL ? block->data : NULL;
+	// someone else still has these pixels, carry on with a copy of them
+	frameBlock * copy = block->pool->take(block->size);
+	memcpy(copy->data, block->data, block->size);
+	copy->pool->countCopy(block->size);
+	release();
+	block = copy;
+	return block->data;
+}
+
+//--------------------------------------------------------------
+unsigned char * frameBuffer::overwrite() {
+	if (block == NULL || block->refs == 1)
+		return block != NULL ? block->data : NULL;
+	frameBlock * fresh = block->pool->take(block->size);
+	release();
+	block = fresh;
+	return block->data;
+}
+
+//--------------------------------------------------------------
+frameBufferPool::frameBufferPool() {
+	pthread_mutex_init(&mutex, NULL);
+	freeBlocks = NULL;
+	blocks = 0;
+	bytesCopied = 0;
+	bytesShared = 0;
+}
+
+//--------------------------------------------------------------
+frameBufferPool::~frameBufferPool() {
+	while (freeBlocks != NULL) {
+		frameBlock * block = freeBlocks;
+		freeBlocks = block->next;
+		alignedFree(block->data);
+		delete block;
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+//--------------------------------------------------------------
+frameBuffer frameBufferPool::acquire(size_t bytes) {
+	return frameBuffer(take(bytes));
+}
+
+//--------------------------------------------------------------
+frameBlock * frameBufferPool::take(size_t bytes) {
+	// the demos only use a few sizes, so the first free block of the
+	// right size will do
+	pthread_mutex_lock(&mutex);
+	frameBlock ** link = &freeBlocks;
+	while (*link != NULL && (*link)->size != bytes)
+		link = &(*link)->next;
+	frameBlock * block = *link;
+	if (block != NULL)
+		*link = block->next;
+	else
+		blocks++;
+	pthread_mutex_unlock(&mutex);
+
+	if (block == NULL) {
+		block = new frameBlock;
+		block->pool = this;
+		block->size = bytes;
+		block->data = (unsigned char *) alignedMalloc(bytes > 0 ? bytes : 1);
+	}
+	block->refs = 1;
+	block->next = NULL;
+	return block;
+}
+
+//--------------------------------------------------------------
+void frameBufferPool::recycle(frameBlock * block) {
+	pthread_mutex_lock(&mutex);
+	block->next = freeBlocks;
+	freeBlocks = block;
+	pthread_mutex_unlock(&mutex);
+}
+
+//--------------------------------------------------------------
+void frameBufferPool::countCopy(size_t bytes) {
+	__sync_fetch_and_add(&bytesCopied, (unsigned long long) bytes);
+}
+
+//--------------------------------------------------------------
+void frameBufferPool::countShare(size_t bytes) {
+	__sync_fetch_and_add(&bytesShared, (unsigned long long) bytes);
+}
+
+//--------------------------------------------------------------
+unsigned long long frameBufferPool::getBytesCopied() {
+	return bytesCopied;
+}
+
+//--------------------------------------------------------------
+unsigned long long frameBufferPool::getBytesShared() {
+	return bytesShared;
+}
+
+//--------------------------------------------------------------
+int frameBufferPool::getBlockCount() {
+	return blocks;
+}
@@ -0,0 +1,107 @@
+#ifndef _FRAME_BUFFER_POOL
+#define _FRAME_BUFFER_POOL
+
+#include <stddef.h>
+#include <pthread.h>
+
+class frameBufferPool;
+
+// One block of pixels from a frameBufferPool, with a count of the
+// frameBuffers pointing at it
+struct frameBlock {
+	frameBufferPool * pool;
+	unsigned char * data;
+	size_t size;
+	volatile int refs;
+	// the next free block, while it is back in the pool
+	frameBlock * next;
+};
+
+// A reference counted handle to an image's pixels, so stages and threads
+// can share a frame rather than copy it. Copying a frameBuffer only shares
+// the pixels, and they go back to the pool when the last handle lets go.
+//
+// Shared pixels are read only. write() hands out pixels only this handle
+// sees, copying them first if anyone else still holds them (copy on
+// write), so whoever shared them keeps seeing what they were. overwrite()
+// does the same without the copy, for stages that fill in every pixel.
+//
+// The reference counts are atomic, so handles to the same pixels can be
+// held and dropped on any thread, but a single handle must not be used
+// from two threads at once.
+class frameBuffer {
+
+	public:
+		frameBuffer();
+		frameBuffer(const frameBuffer & other);
+		~frameBuffer();
+		frameBuffer & operator=(const frameBuffer & other);
+
+		// Lets go of the pixels, leaving the handle empty
+		void release();
+
+		bool isEmpty() const;
+		size_t getSize() const;
+		// Whether another frameBuffer holds the same pixels
+		bool isShared() const;
+
+		// The pixels, not to be written to (NULL when empty)
+		const unsigned char * read() const;
+		// The pixels to change, copied first if they are shared
+		unsigned char * write();
+		// The pixels to fill in from scratch, new (and not cleared) if they
+		// are shared
+		unsigned char * overwrite();
+
+	private:
+		friend class frameBufferPool;
+		explicit frameBuffer(frameBlock * block);
+
+		frameBlock * block;
+};
+
+// Hands out aligned blocks of pixels (see alignedMemory.h) as frameBuffers
+// and takes them back when they are let go, so the same few blocks are
+// reused frame after frame rather than allocated each time.
+//
+// It also counts the bytes copied by frameBuffer::write() and the bytes
+// shared instead of copied (any other copies can be added in with
+// countCopy()), so the cost of moving frames around can be reported per
+// frame.
+//
+// The pool must outlive every frameBuffer it handed out, so it should
+// be declared before anything that holds them.
+class frameBufferPool {
+
+	public:
+		frameBufferPool();
+		~frameBufferPool();
+
+		// A block of bytes, not cleared. Safe to call from any thread.
+		frameBuffer acquire(size_t bytes);
+
+		// Adds in a copy made outside the pool, eg. from a frameSource
+		void countCopy(size_t bytes);
+
+		// Totals since the pool was made
+		unsigned long long getBytesCopied();
+		unsigned long long getBytesShared();
+		// how many blocks have been allocated, in use or not
+		int getBlockCount();
+
+	private:
+		friend class frameBuffer;
+		// a block of bytes no one else holds, and back into the pool
+		frameBlock * take(size_t bytes);
+		void recycle(frameBlock * block);
+		void countShare(size_t bytes);
+
+		pthread_mutex_t mutex;
+		// blocks no one holds, ready to hand out again
+		frameBlock * freeBlocks;
+		int blocks;
+		volatile unsigned long long bytesCopied;
+		volatile unsigned long long bytesShared;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _FRAME_SOURCE
+#define _FRAME_SOURCE
+
+// Where the demos get their depth and RGB frames from. The calls mirror
+// the ones we used on ofxKinect, so either a live kinect (kinectFrameSource)
+// or a recorded clip (fileFrameSource) can sit behind them.
+//
+// The pixel pointers belong to the source, and stay valid until the
+// next call to update().
+class frameSource {
+
+	public:
+		virtual ~frameSource() {}
+
+		// Pulls in the next frame, returns true if it is a new one
+		virtual bool update() = 0;
+
+		virtual int getWidth() = 0;
+		virtual int getHeight() = 0;
+
+		// 8 bit depth map, near values are white
+		virtual unsigned char * getDepthPixels() = 0;
+		// 11 bit raw depth values as they come off the sensor
+		virtual unsigned short * getRawDepthPixels() = 0;
+		// RGB image as the colour camera saw it, see depthRegistration.h
+		// for lining it up with the depth map
+		virtual unsigned char * getRGBPixels() = 0;
+		// Whether getRGBPixels() is already lined up with the depth map, eg.
+		// clips recorded back when ofxKinect did that
+		virtual bool isRGBRegistered() { return false; }
+
+		// Distance in cm of the point at x,y of the depth map
+		virtual float getDistanceAt(int x, int y) = 0;
+
+		// When the current frame was captured, in timerMicros() time
+		virtual unsigned long long getTimestamp() = 0;
+};
+
+#endif
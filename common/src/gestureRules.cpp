@@ -0,0 +1,165 @@
+#include "gestureRules.h"
+#include "eventSink.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+const char * GESTURE_RULES_DEFAULT =
+	"# feature    op   on    off   holdMs  key\n"
+	"hand_dy      <    -50   -45   0       left\n"
+	"hand_dy      >    50    45    0       right\n"
+	"foot_count   >    0     0     0       z\n";
+
+// names for the config file, in gestureFeature order
+static const char * featureNames[GESTURE_FEATURE_COUNT] = {
+	"hand_count",
+	"hand_dy",
+	"hand_angle",
+	"hand_distance",
+	"hand_x",
+	"hand_y",
+	"hand_dz",
+	"foot_count"
+};
+
+// and for the keys, in inputKey order
+static const char * keyNames[INPUT_KEY_COUNT] = {
+	"left",
+	"right",
+	"up",
+	"down",
+	"z",
+	"x",
+	"space",
+	"return"
+};
+
+//--------------------------------------------------------------
+static int lookup(const char * name, const char ** names, int count) {
+	for (int i = 0; i < count; i++)
+		if (strcmp(name, names[i]) == 0)
+			return i;
+	return -1;
+}
+
+//--------------------------------------------------------------
+void gestureFeatures(blobTracker & hands, int footCount, float seconds, float * features) {
+	trackList & tracks = hands.getTracks();
+	features[GESTURE_HAND_COUNT] = (float) tracks.count;
+	features[GESTURE_FOOT_COUNT] = (float) footCount;
+	if (tracks.count < 2) {
+		for (int f = GESTURE_HAND_DY; f <= GESTURE_HAND_DZ; f++)
+			features[f] = NAN;
+		return;
+	}
+
+	// the two oldest tracks, p1 is always the leftmost
+	float x1, y1, z1, x2, y2, z2;
+	hands.predict(0, seconds, x1, y1, z1);
+	hands.predict(1, seconds, x2, y2, z2);
+	if (x2 < x1) {
+		float t;
+		t = x1; x1 = x2; x2 = t;
+		t = y1; y1 = y2; y2 = t;
+		t = z1; z1 = z2; z2 = t;
+	}
+	float dx = x2 - x1, dy = y1 - y2;
+	features[GESTURE_HAND_DY] = dy;
+	features[GESTURE_HAND_ANGLE] = atan2f(dy, dx) * 180.0f / 3.14159265f;
+	features[GESTURE_HAND_DISTANCE] = sqrtf(dx*dx + dy*dy);
+	features[GESTURE_HAND_X] = (x1 + x2) / 2;
+	features[GESTURE_HAND_Y] = (y1 + y2) / 2;
+	features[GESTURE_HAND_DZ] = z1 - z2;
+}
+
+//--------------------------------------------------------------
+gestureRules::gestureRules() {
+}
+
+//--------------------------------------------------------------
+bool gestureRules::load(const char * path) {
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "gestureRules: could not open %s\n", path);
+		return false;
+	}
+	std::stringstream text;
+	text << file.rdbuf();
+	return parse(text.str());
+}
+
+//--------------------------------------------------------------
+bool gestureRules::parse(const std::string & text) {
+	gestureRules rules;
+	std::istringstream lines(text);
+	std::string line;
+	for (int number = 1; std::getline(lines, line); number++){
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		char name[64], op[4], keyName[64], extra[2];
+		float onValue, offValue, holdMs;
+		int n = sscanf(line.c_str(), "%63s %3s %f %f %f %63s %1s", name, op, &onValue, &offValue, &holdMs, keyName, extra);
+		if (n <= 0)
+			continue;
+		int f = lookup(name, featureNames, GESTURE_FEATURE_COUNT);
+		int k = n >= 6 ? lookup(keyName, keyNames, INPUT_KEY_COUNT) : -1;
+		bool greater = strcmp(op, ">") == 0, less = strcmp(op, "<") == 0;
+		if (n != 6 || f < 0 || k < 0 || !(greater || less) || holdMs < 0) {
+			fprintf(stderr, "gestureRules: can't make sense of line %d: %s\n", number, line.c_str());
+			return false;
+		}
+		float s = greater ? 1 : -1;
+		rules.feature.push_back(f);
+		rules.sign.push_back(s);
+		rules.onThreshold.push_back(onValue * s);
+		rules.offThreshold.push_back(offValue * s);
+		rules.holdMicros.push_back((unsigned long long) (holdMs * 1000));
+		rules.key.push_back(k);
+	}
+
+	feature.swap(rules.feature);
+	sign.swap(rules.sign);
+	onThreshold.swap(rules.onThreshold);
+	offThreshold.swap(rules.offThreshold);
+	holdMicros.swap(rules.holdMicros);
+	key.swap(rules.key);
+	active.assign(feature.size(), 0);
+	on.assign(feature.size(), 0);
+	onSince.assign(feature.size(), 0);
+	return true;
+}
+
+//--------------------------------------------------------------
+int gestureRules::getRuleCount() {
+	return (int) feature.size();
+}
+
+//--------------------------------------------------------------
+unsigned int gestureRules::evaluate(const float * features, unsigned long long now) {
+	unsigned int keys = 0;
+	int count = (int) feature.size();
+	for (int i = 0; i < count; i++){
+		// every rule is "value > threshold" once multiplied by its sign,
+		// and NaN fails both compares
+		float v = features[feature[i]] * sign[i];
+		unsigned char isOn = v > onThreshold[i];
+		unsigned char stays = v > offThreshold[i];
+		// keep the time the on condition started holding, or restart it
+		onSince[i] = (on[i] & isOn) ? onSince[i] : now;
+		on[i] = isOn;
+		unsigned char held = isOn & (now - onSince[i] >= holdMicros[i]);
+		active[i] = (active[i] & stays) | held;
+		keys |= (unsigned int) active[i] << key[i];
+	}
+	return keys;
+}
+
+//--------------------------------------------------------------
+void gestureRules::reset() {
+	active.assign(active.size(), 0);
+	on.assign(on.size(), 0);
+}
@@ -0,0 +1,92 @@
+#ifndef _GESTURE_RULES
+#define _GESTURE_RULES
+
+#include <string>
+#include <vector>
+
+#include "blobTracker.h"
+
+// The features of the tracked hands (and foot) rules can look at. The
+// hand features need two hands, without them they are NaN, which no rule
+// matches.
+enum gestureFeature {
+	// number of hands being tracked
+	GESTURE_HAND_COUNT,
+	// y of the left hand minus y of the right one, in pixels (negative
+	// when the wheel is turned left)
+	GESTURE_HAND_DY,
+	// angle of the line from the left hand to the right one, in degrees,
+	// positive when turned right
+	GESTURE_HAND_ANGLE,
+	// distance between the hands, in pixels
+	GESTURE_HAND_DISTANCE,
+	// point between the hands, in pixels
+	GESTURE_HAND_X,
+	GESTURE_HAND_Y,
+	// raw depth of the left hand minus the right one
+	GESTURE_HAND_DZ,
+	// number of blobs in the foot region
+	GESTURE_FOOT_COUNT,
+	GESTURE_FEATURE_COUNT
+};
+
+// Works the features out from the two oldest hand tracks (run seconds
+// ahead, see blobTracker::predict()) and the foot blobs
+void gestureFeatures(blobTracker & hands, int footCount, float seconds, float * features);
+
+// Turns gestures into keys from rules in a text file, so the bindings can
+// be changed without a rebuild. Each line is
+//
+//   feature  op  on  off  holdMs  key
+//
+// eg. "hand_dy < -50 -40 0 left". The key goes down once "feature op on"
+// has held for holdMs, and stays down until "feature op off" stops
+// holding, so off a little short of on gives some hysteresis. op is < or
+// >, and # starts a comment. Several rules can press the same key.
+//
+// The rules are compiled into flat arrays (feature, thresholds scaled so
+// every rule is a >, hold time, key), and evaluate() runs through all of
+// them with the same few instructions and no branching on the rule, so
+// its cost only grows with the number of rules.
+class gestureRules {
+
+	public:
+		gestureRules();
+
+		// Replace the rules with the ones in a file or a string, returns
+		// false (and keeps the old rules) if anything doesn't parse
+		bool load(const char * path);
+		bool parse(const std::string & text);
+
+		int getRuleCount();
+
+		// Runs every rule over this frame's features, now in microseconds.
+		// Returns the keys that should be down, bit n for inputKey n.
+		unsigned int evaluate(const float * features, unsigned long long now);
+
+		// Releases everything, eg. when the tracking is lost
+		void reset();
+
+	private:
+		// one entry per rule
+		std::vector<int> feature;
+		// +1 for >, -1 for <, and the thresholds multiplied by it
+		std::vector<float> sign;
+		std::vector<float> onThreshold;
+		std::vector<float> offThreshold;
+		std::vector<unsigned long long> holdMicros;
+		std::vector<int> key;
+
+		// whether each rule is pressing its key, and since when its on
+		// condition has held
+		std::vector<unsigned char> active;
+		std::vector<unsigned char> on;
+		std::vector<unsigned long long> onSince;
+};
+
+// The rules mkart shipped with, if there is no gestures.txt: steer left
+// or right once the hands are 50 pixels apart in height, and press z
+// whenever there is a foot
+extern const char * GESTURE_RULES_DEFAULT;
+
+#endif
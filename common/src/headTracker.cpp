@@ -0,0 +1,211 @@
+#include "headTracker.h"
+#include "depthConversion.h"
+#include "timer.h"
+
+#include <math.h>
+
+// The one euro filter's cutoff for the speed itself, in Hz
+#define SPEED_CUTOFF 1.0f
+
+//--------------------------------------------------------------
+headTracker::headTracker() : timing("head tracker", 50, 100) {
+	width = 0;
+	height = 0;
+	intrinsics = KINECT_DEPTH_INTRINSICS;
+	blobs.count = 0;
+	for (int raw = 0; raw < 2048; raw++)
+		depthTable[raw] = rawDepthToMillimeters(raw) / 1000.0f;
+	minArea = 3000;
+	headSize = 0.25f;
+	setSmoothing(1.0f, 5.0f);
+	maxMisses = 15;
+	bTracking = false;
+	misses = 0;
+	startAxis(ax, 0);
+	startAxis(ay, 0);
+	startAxis(az, 0);
+	budget = 2000;
+	overBudget = 0;
+}
+
+//--------------------------------------------------------------
+void headTracker::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+	labeller.setup(width, height);
+	// people are thousands of pixels, so half the size is plenty
+	labeller.setLevels(1);
+	bTracking = false;
+}
+
+//--------------------------------------------------------------
+void headTracker::setIntrinsics(const cameraIntrinsics & intrinsics) {
+	this->intrinsics = intrinsics;
+}
+
+//--------------------------------------------------------------
+void headTracker::setMinArea(int pixels) {
+	minArea = pixels;
+}
+
+//--------------------------------------------------------------
+void headTracker::setHeadSize(float meters) {
+	headSize = meters;
+}
+
+//--------------------------------------------------------------
+void headTracker::setSmoothing(float minCutoff, float beta) {
+	this->minCutoff = minCutoff;
+	this->beta = beta;
+}
+
+//--------------------------------------------------------------
+void headTracker::setMaxMisses(int frames) {
+	maxMisses = frames < 0 ? 0 : frames;
+}
+
+//--------------------------------------------------------------
+void headTracker::setBudget(double micros) {
+	budget = micros;
+}
+
+//--------------------------------------------------------------
+// Smoothing factor of a first order low pass at cutoff Hz, over dt seconds
+static inline float smoothing(float cutoff, float dt) {
+	float tau = 1.0f / (2 * 3.14159265f * cutoff);
+	return 1.0f / (1.0f + tau / dt);
+}
+
+//--------------------------------------------------------------
+void headTracker::startAxis(axis & s, float x) {
+	s.x = x;
+	s.dx = 0;
+}
+
+//--------------------------------------------------------------
+void headTracker::filterAxis(axis & s, float x, float dt) {
+	// smooth the speed at a fixed cutoff, then the position at a cutoff
+	// that goes up with it
+	s.dx += smoothing(SPEED_CUTOFF, dt) * ((x - s.x) / dt - s.dx);
+	s.x += smoothing(minCutoff + beta * fabsf(s.dx), dt) * (x - s.x);
+}
+
+//--------------------------------------------------------------
+bool headTracker::findHead(const unsigned char * mask, const unsigned short * rawDepth, float & x, float & y, float & z) {
+	labeller.find(mask, blobs, minArea, width*height, BLOB_LIST_SIZE, rawDepth);
+
+	// the nearest person is the blob with the smallest mean raw depth
+	int nearest = -1;
+	for (int b = 0; b < blobs.count; b++){
+		if (blobs.depth[b] > 0 && (nearest < 0 || blobs.depth[b] < blobs.depth[nearest]))
+			nearest = b;
+	}
+	if (nearest < 0)
+		return false;
+
+	// one head height down from the top of the blob, in pixels at its depth
+	float meters = depthTable[(int) (blobs.depth[nearest] + 0.5f) & 2047];
+	int top = blobs.minY[nearest];
+	int rows = meters > 0 ? (int) (intrinsics.fy * headSize / meters + 0.5f) : (blobs.maxY[nearest] - top + 1) / 5;
+	int bottom = top + (rows > 1 ? rows : 1);
+	if (bottom > blobs.maxY[nearest] + 1)
+		bottom = blobs.maxY[nearest] + 1;
+
+	// Sums of z, z*u and z*v over the head's pixels, from which the mean
+	// point is worked out once at the end, rather than one point per pixel
+	int n = 0;
+	float sumZ = 0, sumZU = 0, sumZV = 0;
+	for (int v = top; v < bottom; v++){
+		int row = v*width;
+		float rowZ = 0, rowZU = 0;
+		for (int u = blobs.minX[nearest]; u <= blobs.maxX[nearest]; u++){
+			float d = mask[row + u] != 0 ? depthTable[rawDepth[row + u] & 2047] : 0;
+			n += d > 0;
+			rowZ += d;
+			rowZU += d * u;
+		}
+		sumZ += rowZ;
+		sumZU += rowZU;
+		sumZV += rowZ * v;
+	}
+	if (n == 0)
+		return false;
+
+	z = sumZ / n;
+	x = (sumZU / n - intrinsics.cx * z) / intrinsics.fx;
+	y = (sumZV / n - intrinsics.cy * z) / intrinsics.fy;
+	return true;
+}
+
+//--------------------------------------------------------------
+bool headTracker::update(const unsigned char * mask, const unsigned short * rawDepth, float dt) {
+	if (width == 0)
+		return false;
+	unsigned long long start = timerMicros();
+
+	float x, y, z;
+	bool bFound = findHead(mask, rawDepth, x, y, z);
+	if (bFound) {
+		// start again from the new position when the head was lost, so it
+		// doesn't slide over from wherever it was
+		if (!bTracking || dt <= 0) {
+			startAxis(ax, x);
+			startAxis(ay, y);
+			startAxis(az, z);
+		} else {
+			filterAxis(ax, x, dt);
+			filterAxis(ay, y, dt);
+			filterAxis(az, z, dt);
+		}
+		bTracking = true;
+		misses = 0;
+	} else if (bTracking && ++misses > maxMisses) {
+		bTracking = false;
+	}
+
+	unsigned long long took = timerMicros() - start;
+	timing.add(took);
+	if (took > budget)
+		overBudget++;
+	return bFound;
+}
+
+//--------------------------------------------------------------
+bool headTracker::isTracking() {
+	return bTracking;
+}
+
+//--------------------------------------------------------------
+float headTracker::getX() {
+	return ax.x;
+}
+
+//--------------------------------------------------------------
+float headTracker::getY() {
+	return ay.x;
+}
+
+//--------------------------------------------------------------
+float headTracker::getZ() {
+	return az.x;
+}
+
+//--------------------------------------------------------------
+float headTracker::getImageX() {
+	return az.x > 0 ? intrinsics.fx * ax.x / az.x + intrinsics.cx : 0;
+}
+
+//--------------------------------------------------------------
+float headTracker::getImageY() {
+	return az.x > 0 ? intrinsics.fy * ay.x / az.x + intrinsics.cy : 0;
+}
+
+//--------------------------------------------------------------
+latencyHistogram & headTracker::getTiming() {
+	return timing;
+}
+
+//--------------------------------------------------------------
+int headTracker::getOverBudgetCount() {
+	return overBudget;
+}
@@ -0,0 +1,104 @@
+#ifndef _HEAD_TRACKER
+#define _HEAD_TRACKER
+
+#include <vector>
+
+#include "blobPyramid.h"
+#include "depthRegistration.h"
+#include "latencyHistogram.h"
+
+// Finds the head of the person nearest the kinect in a foreground mask,
+// and follows it in 3D, in meters in the depth camera's frame (x to the
+// right, y down, z away from the camera), eg. to move parallax's virtual
+// camera with the viewer's head.
+//
+// Each frame the mask is labelled (coarse to fine, see blobPyramid.h),
+// the nearest blob big enough to be a person is picked (by its mean
+// depth), and the head is taken to be the top of it: the rows from the
+// top of the blob down to one head height (setHeadSize(), at the blob's
+// depth). The head's position is the mean
+// of the masked pixels with a depth reading in those rows, turned into 3D
+// with the depth camera's intrinsics.
+//
+// The position is smoothed with a one euro filter per axis (Casiez et
+// al., CHI 2012), whose cutoff frequency goes up with the speed: still
+// heads are smoothed a lot, so the viewpoint doesn't jitter, and moving
+// ones hardly at all, so it doesn't lag behind. If nobody is found the
+// last position is held for a few frames before the head counts as lost.
+//
+// The whole update is meant to take well under a couple of milliseconds
+// at 640x480. It times itself, and counts the frames that go over a
+// budget (setBudget()), so a slow frame shows up while the demo runs.
+class headTracker {
+
+	public:
+		headTracker();
+
+		void setup(int width, int height);
+		// The depth camera's intrinsics, KINECT_DEPTH_INTRINSICS by default
+		void setIntrinsics(const cameraIntrinsics & intrinsics);
+		// Smallest blob that counts as a person, in pixels
+		void setMinArea(int pixels);
+		// How tall a head is, in meters
+		void setHeadSize(float meters);
+		// The one euro filter's cutoff in Hz when the head is still, and
+		// how much it goes up per meter per second of speed
+		void setSmoothing(float minCutoff, float beta);
+		// Frames the head can go unseen before it is lost
+		void setMaxMisses(int frames);
+		// Time an update() may take, in microseconds
+		void setBudget(double micros);
+
+		// Looks for the head in a new frame, dt seconds after the last one.
+		// mask is the foreground (anything non zero is set) and rawDepth
+		// the raw depth map it was made from. Returns true if the head was
+		// found in this frame.
+		bool update(const unsigned char * mask, const unsigned short * rawDepth, float dt);
+
+		// Whether there is a head, seen in the last few frames
+		bool isTracking();
+		// The smoothed head position, in meters
+		float getX();
+		float getY();
+		float getZ();
+		// and where it is in the depth image, in pixels
+		float getImageX();
+		float getImageY();
+
+		// How long update() took, and how many times it went over budget
+		latencyHistogram & getTiming();
+		int getOverBudgetCount();
+
+	private:
+		// one axis of the one euro filter: the smoothed value and its
+		// smoothed rate of change
+		struct axis {
+			float x, dx;
+		};
+		void startAxis(axis & s, float x);
+		void filterAxis(axis & s, float x, float dt);
+		bool findHead(const unsigned char * mask, const unsigned short * rawDepth, float & x, float & y, float & z);
+
+		int width;
+		int height;
+		cameraIntrinsics intrinsics;
+		blobPyramid labeller;
+		blobList blobs;
+		// meters for every raw depth value, 0 for no reading
+		float depthTable[2048];
+
+		int minArea;
+		float headSize;
+		float minCutoff, beta;
+		int maxMisses;
+
+		axis ax, ay, az;
+		bool bTracking;
+		int misses;
+
+		latencyHistogram timing;
+		double budget;
+		int overBudget;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "kinectFrameSource.h"
+#include "timer.h"
+
+#include <stdlib.h>
+
+//--------------------------------------------------------------
+kinectFrameSource::kinectFrameSource() {
+	kinect = NULL;
+	timestamp = 0;
+}
+
+//--------------------------------------------------------------
+void kinectFrameSource::setup(ofxKinect * kinect) {
+	this->kinect = kinect;
+}
+
+//--------------------------------------------------------------
+bool kinectFrameSource::update() {
+	kinect->update();
+	if (!kinect->isFrameNew())
+		return false;
+	timestamp = timerMicros();
+	return true;
+}
+
+//--------------------------------------------------------------
+int kinectFrameSource::getWidth() {
+	return kinect->width;
+}
+
+//--------------------------------------------------------------
+int kinectFrameSource::getHeight() {
+	return kinect->height;
+}
+
+//--------------------------------------------------------------
+unsigned char * kinectFrameSource::getDepthPixels() {
+	return kinect->getDepthPixels();
+}
+
+//--------------------------------------------------------------
+unsigned short * kinectFrameSource::getRawDepthPixels() {
+	return kinect->getRawDepthPixels();
+}
+
+//--------------------------------------------------------------
+unsigned char * kinectFrameSource::getRGBPixels() {
+	return kinect->getPixels();
+}
+
+//--------------------------------------------------------------
+float kinectFrameSource::getDistanceAt(int x, int y) {
+	return kinect->getDistanceAt(x, y);
+}
+
+//--------------------------------------------------------------
+unsigned long long kinectFrameSource::getTimestamp() {
+	return timestamp;
+}
+
+//--------------------------------------------------------------
+frameSource * openFrameSource(ofxKinect & kinect, kinectFrameSource & kinectSource, fileFrameSource & clipSource) {
+	const char * clip = getenv("KINECT_CLIP");
+	if (clip != NULL && clipSource.open(clip))
+		return &clipSource;
+
+	// No textures: ofxKinect uploads them in update(), which runs on the
+	// capture thread where there is no GL context. The demos draw the
+	// previews from the captured frames instead.
+	kinect.init(false, false);
+	kinect.setVerbose(true);
+	kinect.open();
+	kinectSource.setup(&kinect);
+	return &kinectSource;
+}
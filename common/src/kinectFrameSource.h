@@ -0,0 +1,37 @@
+#ifndef _KINECT_FRAME_SOURCE
+#define _KINECT_FRAME_SOURCE
+
+#include "ofxKinect.h"
+#include "frameSource.h"
+#include "fileFrameSource.h"
+
+// Live frames from a kinect, through ofxKinect. The kinect itself is
+// still owned (and opened, calibrated, tilted...) by the app, this just
+// puts the frame calls behind the frameSource interface.
+class kinectFrameSource : public frameSource {
+
+	public:
+		kinectFrameSource();
+
+		void setup(ofxKinect * kinect);
+
+		bool update();
+		int getWidth();
+		int getHeight();
+		unsigned char * getDepthPixels();
+		unsigned short * getRawDepthPixels();
+		unsigned char * getRGBPixels();
+		float getDistanceAt(int x, int y);
+		unsigned long long getTimestamp();
+
+	private:
+		ofxKinect * kinect;
+		unsigned long long timestamp;
+};
+
+// Opens a recorded clip instead of the kinect if KINECT_CLIP is set (see
+// fileFrameSource.h), otherwise inits (without textures) and opens the
+// kinect. Returns whichever of the two sources frames should come from.
+frameSource * openFrameSource(ofxKinect & kinect, kinectFrameSource & kinectSource, fileFrameSource & clipSource);
+
+#endif
@@ -0,0 +1,95 @@
+#include "latencyHistogram.h"
+
+#include <stdio.h>
+
+//--------------------------------------------------------------
+latencyHistogram::latencyHistogram(const std::string & name, double bucketMicros, int buckets)
+	: name(name), bucketMicros(bucketMicros), counts(buckets > 0 ? buckets : 1, 0) {
+	count = 0;
+	total = 0;
+	max = 0;
+}
+
+//--------------------------------------------------------------
+void latencyHistogram::add(unsigned long long micros) {
+	int bucket = (int) (micros / bucketMicros);
+	if (bucket >= (int) counts.size())
+		bucket = (int) counts.size() - 1;
+	counts[bucket]++;
+	count++;
+	total += micros;
+	if (micros > max)
+		max = micros;
+}
+
+//--------------------------------------------------------------
+void latencyHistogram::clear() {
+	counts.assign(counts.size(), 0);
+	count = 0;
+	total = 0;
+	max = 0;
+}
+
+//--------------------------------------------------------------
+const std::string & latencyHistogram::getName() {
+	return name;
+}
+
+//--------------------------------------------------------------
+int latencyHistogram::getCount() {
+	return count;
+}
+
+//--------------------------------------------------------------
+double latencyHistogram::getMean() {
+	return count > 0 ? total / count : 0;
+}
+
+//--------------------------------------------------------------
+double latencyHistogram::getMax() {
+	return max;
+}
+
+//--------------------------------------------------------------
+double latencyHistogram::getPercentile(double p) {
+	if (count == 0)
+		return 0;
+	// nearest rank, like stageStats
+	double rank = p / 100.0 * count;
+	unsigned int seen = 0;
+	for (size_t b = 0; b < counts.size(); b++){
+		seen += counts[b];
+		if (seen > 0 && seen >= rank)
+			return (b + 1) * bucketMicros;
+	}
+	return counts.size() * bucketMicros;
+}
+
+//--------------------------------------------------------------
+std::string latencyHistogram::toString(int width) {
+	char line[256];
+	snprintf(line, sizeof(line), "%s: %d samples, mean %.2fms, p50 %.2fms, p99 %.2fms, max %.2fms\n", name.c_str(), count,
+			 getMean() / 1000, getPercentile(50) / 1000, getPercentile(99) / 1000, max / 1000);
+	std::string out = line;
+
+	int first = -1, last = -1;
+	unsigned int most = 0;
+	for (int b = 0; b < (int) counts.size(); b++){
+		if (counts[b] == 0)
+			continue;
+		if (first < 0)
+			first = b;
+		last = b;
+		if (counts[b] > most)
+			most = counts[b];
+	}
+	for (int b = first; b >= 0 && b <= last; b++){
+		int bar = (int) ((double) counts[b] * width / most + 0.5);
+		bool overflow = b == (int) counts.size() - 1;
+		snprintf(line, sizeof(line), "  %7.2f%s ms %8u ", b * bucketMicros / 1000, overflow ? "+" : " ", counts[b]);
+		out += line;
+		out += std::string(bar, '#');
+		out += "\n";
+	}
+	return out;
+}
@@ -0,0 +1,40 @@
+#ifndef _LATENCY_HISTOGRAM
+#define _LATENCY_HISTOGRAM
+
+#include <string>
+#include <vector>
+
+// Counts latencies (in microseconds) into fixed width buckets, for
+// following eg. how long it takes from a frame being captured to a key
+// being sent while a demo is running. Unlike stageStats it never grows,
+// so it can be left collecting for as long as the demo runs. Anything
+// past the last bucket is counted in it.
+class latencyHistogram {
+
+	public:
+		latencyHistogram(const std::string & name = "", double bucketMicros = 1000, int buckets = 100);
+
+		void add(unsigned long long micros);
+		void clear();
+
+		const std::string & getName();
+		int getCount();
+		double getMean();
+		double getMax();
+		// p is 0-100, rounded up to the end of the bucket it falls in
+		double getPercentile(double p);
+
+		// The histogram as text, one line per bucket from the first to the
+		// last one used, with bars up to width characters long
+		std::string toString(int width = 50);
+
+	private:
+		std::string name;
+		double bucketMicros;
+		std::vector<unsigned int> counts;
+		int count;
+		double total;
+		double max;
+};
+
+#endif
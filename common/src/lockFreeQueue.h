@@ -0,0 +1,58 @@
+#ifndef _LOCK_FREE_QUEUE
+#define _LOCK_FREE_QUEUE
+
+// Lock free first in first out queue from one producer thread to one
+// consumer thread, in a fixed ring of SIZE slots (a power of two). push()
+// never waits and never allocates, it just fails when the ring is full,
+// so it is safe to call from the processing loop.
+//
+// The read and write positions only ever count up, and each is written by
+// one side only, so the only synchronisation needed is a barrier between
+// filling a slot and moving the position past it.
+template <class T, int SIZE>
+class lockFreeQueue {
+
+	public:
+		lockFreeQueue() {
+			readPos = 0;
+			writePos = 0;
+		}
+
+		// producer side, returns false if the queue is full
+		bool push(const T & item) {
+			unsigned int w = writePos;
+			if (w - readPos == SIZE)
+				return false;
+			items[w & (SIZE - 1)] = item;
+			__sync_synchronize();
+			writePos = w + 1;
+			return true;
+		}
+
+		// consumer side, returns false if the queue is empty
+		bool pop(T & item) {
+			unsigned int r = readPos;
+			if (r == writePos)
+				return false;
+			__sync_synchronize();
+			item = items[r & (SIZE - 1)];
+			__sync_synchronize();
+			readPos = r + 1;
+			return true;
+		}
+
+		// either side, only a snapshot
+		bool empty() {
+			return readPos == writePos;
+		}
+
+	private:
+		// SIZE has to be a power of two for the positions to wrap around
+		typedef char sizeIsPowerOfTwo[(SIZE & (SIZE - 1)) == 0 ? 1 : -1];
+
+		T items[SIZE];
+		volatile unsigned int readPos;
+		volatile unsigned int writePos;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "macEventSink.h"
+
+#ifdef __APPLE__
+
+#include <Carbon/Carbon.h>
+
+// virtual key codes for each inputKey
+static const CGKeyCode keyCodes[INPUT_KEY_COUNT] = {
+	kVK_LeftArrow,
+	kVK_RightArrow,
+	kVK_UpArrow,
+	kVK_DownArrow,
+	kVK_ANSI_Z,
+	kVK_ANSI_X,
+	kVK_Space,
+	kVK_Return
+};
+
+//--------------------------------------------------------------
+macEventSink::macEventSink() {
+	systemWide = AXUIElementCreateSystemWide();
+}
+
+//--------------------------------------------------------------
+macEventSink::~macEventSink() {
+	CFRelease(systemWide);
+}
+
+//--------------------------------------------------------------
+void macEventSink::send(const keyEvent * events, int count) {
+	for (int i = 0; i < count; i++)
+		AXUIElementPostKeyboardEvent(systemWide, 0, keyCodes[events[i].key], events[i].down);
+}
+
+#endif
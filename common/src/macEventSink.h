@@ -0,0 +1,28 @@
+#ifndef _MAC_EVENT_SINK
+#define _MAC_EVENT_SINK
+
+#include "eventSink.h"
+
+#ifdef __APPLE__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+// Sends key events to the foreground application through the
+// accessibility API. Most emulators don't take input posted through Core
+// Foundation, so this is the only way they see the keys. The system wide
+// element is made once rather than for every key.
+class macEventSink : public eventSink {
+
+	public:
+		macEventSink();
+		~macEventSink();
+
+		void send(const keyEvent * events, int count);
+
+	private:
+		AXUIElementRef systemWide;
+};
+
+#endif
+
+#endif
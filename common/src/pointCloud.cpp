@@ -0,0 +1,154 @@
+#include "pointCloud.h"
+#include "depthConversion.h"
+
+//--------------------------------------------------------------
+pointCloud::pointCloud() {
+	width = 0;
+	height = 0;
+	intrinsics = KINECT_DEPTH_INTRINSICS;
+	count = 0;
+	blobCount = 0;
+	for (int raw = 0; raw < 2048; raw++)
+		depthTable[raw] = rawDepthToMillimeters(raw) / 1000.0f;
+}
+
+//--------------------------------------------------------------
+void pointCloud::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+	rayX.assign(width*height, 0);
+	rayY.assign(width*height, 0);
+	x.assign(width*height + 1, 0);
+	y.assign(width*height + 1, 0);
+	z.assign(width*height + 1, 0);
+	count = 0;
+	blobCount = 0;
+	setIntrinsics(intrinsics);
+}
+
+//--------------------------------------------------------------
+void pointCloud::setIntrinsics(const cameraIntrinsics & intrinsics) {
+	this->intrinsics = intrinsics;
+	for (int v = 0; v < height; v++){
+		float ry = (v - intrinsics.cy) / intrinsics.fy;
+		for (int u = 0; u < width; u++){
+			rayX[v*width + u] = (u - intrinsics.cx) / intrinsics.fx;
+			rayY[v*width + u] = ry;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+int pointCloud::update(const unsigned short * rawDepth, const unsigned char * mask, const blobList & blobs) {
+	count = 0;
+	blobCount = blobs.count;
+	float * px = &x[0];
+	float * py = &y[0];
+	float * pz = &z[0];
+	const float * rx = &rayX[0];
+	const float * ry = &rayY[0];
+	int capacity = width*height;
+
+	for (int b = 0; b < blobs.count; b++){
+		blobStart[b] = count;
+		int x0 = blobs.minX[b], x1 = blobs.maxX[b];
+		for (int v = blobs.minY[b]; v <= blobs.maxY[b]; v++){
+			// overlapping boxes could in theory add up to more than a
+			// frame, stop rather than run off the end
+			if (count + x1 - x0 + 1 > capacity)
+				break;
+			// Every pixel is written to the next free slot, and the count
+			// only moves past it if the pixel is kept, so there are no
+			// branches to mispredict on the edges of the mask
+			int n = count;
+			int row = v*width;
+			for (int u = x0; u <= x1; u++){
+				float d = depthTable[rawDepth[row + u] & 2047];
+				px[n] = d * rx[row + u];
+				py[n] = d * ry[row + u];
+				pz[n] = d;
+				n += (mask[row + u] != 0) & (d > 0);
+			}
+			count = n;
+		}
+		blobPoints[b] = count - blobStart[b];
+
+		// summed afterwards, over the kept points only
+		float sx = 0, sy = 0, sz = 0;
+		for (int i = blobStart[b]; i < count; i++){
+			sx += px[i];
+			sy += py[i];
+			sz += pz[i];
+		}
+		int n = blobPoints[b];
+		centroidX[b] = n > 0 ? sx / n : 0;
+		centroidY[b] = n > 0 ? sy / n : 0;
+		centroidZ[b] = n > 0 ? sz / n : 0;
+	}
+	return count;
+}
+
+//--------------------------------------------------------------
+int pointCloud::getCount() {
+	return count;
+}
+
+//--------------------------------------------------------------
+float * pointCloud::getX() {
+	return &x[0];
+}
+
+//--------------------------------------------------------------
+float * pointCloud::getY() {
+	return &y[0];
+}
+
+//--------------------------------------------------------------
+float * pointCloud::getZ() {
+	return &z[0];
+}
+
+//--------------------------------------------------------------
+int pointCloud::getBlobStart(int blob) {
+	return blob >= 0 && blob < blobCount ? blobStart[blob] : 0;
+}
+
+//--------------------------------------------------------------
+int pointCloud::getBlobCount(int blob) {
+	return blob >= 0 && blob < blobCount ? blobPoints[blob] : 0;
+}
+
+//--------------------------------------------------------------
+bool pointCloud::getCentroid(int blob, float & x, float & y, float & z) {
+	if (getBlobCount(blob) == 0) {
+		x = y = z = 0;
+		return false;
+	}
+	x = centroidX[blob];
+	y = centroidY[blob];
+	z = centroidZ[blob];
+	return true;
+}
+
+//--------------------------------------------------------------
+void pointCloud::unproject(float x, float y, float rawDepth, float & px, float & py, float & pz) {
+	int raw = (int) (rawDepth + 0.5f);
+	pz = depthTable[raw < 0 ? 0 : (raw > 2047 ? 2047 : raw)];
+	px = pz * (x - intrinsics.cx) / intrinsics.fx;
+	py = pz * (y - intrinsics.cy) / intrinsics.fy;
+}
+
+//--------------------------------------------------------------
+const float * pointCloud::getRayX() {
+	return &rayX[0];
+}
+
+//--------------------------------------------------------------
+const float * pointCloud::getRayY() {
+	return &rayY[0];
+}
+
+//--------------------------------------------------------------
+const float * pointCloud::getDepthTable() {
+	return depthTable;
+}
@@ -0,0 +1,81 @@
+#ifndef _POINT_CLOUD
+#define _POINT_CLOUD
+
+#include <vector>
+
+#include "depthRegistration.h"
+#include "blobLabeller.h"
+
+// Turns the foreground of a depth map into 3D points, in meters, in the
+// depth camera's frame: x to the right, y down and z away from the camera.
+//
+// The kinect's depth is the distance along the camera's axis, so a pixel's
+// point is its depth times the ray through it scaled to z = 1. The rays
+// only depend on the intrinsics, so they are worked out once into a table,
+// and a pixel costs a table lookup for the depth and a multiply for each
+// of x and y.
+//
+// Only the masked pixels in each blob's bounding box are turned into
+// points, kept as a structure of arrays with each blob's points together,
+// so hand positions, distances and angles can be worked out in meters
+// from the whole hand rather than one depth sample. A box can take in a
+// little of a neighbouring blob when two boxes overlap.
+class pointCloud {
+
+	public:
+		pointCloud();
+
+		// Allocates the ray table and the points for depth maps of this size
+		void setup(int width, int height);
+		// Rebuilds the ray table, the default is KINECT_DEPTH_INTRINSICS
+		void setIntrinsics(const cameraIntrinsics & intrinsics);
+
+		// Takes the masked pixels with a depth reading under each blob in
+		// blobs (from blobLabeller, on the same mask). Returns the number
+		// of points.
+		int update(const unsigned short * rawDepth, const unsigned char * mask, const blobList & blobs);
+
+		int getCount();
+		float * getX();
+		float * getY();
+		float * getZ();
+		// Where blob i's points are in the arrays, and how many there are
+		int getBlobStart(int blob);
+		int getBlobCount(int blob);
+		// Mean of blob i's points, false (and 0) if it has none
+		bool getCentroid(int blob, float & x, float & y, float & z);
+
+		// The point at pixel x,y with the given raw depth, for positions
+		// that have no points, eg. tracks coasting on their prediction
+		void unproject(float x, float y, float rawDepth, float & px, float & py, float & pz);
+
+		// The ray tables, x and y at z = 1 for each pixel
+		const float * getRayX();
+		const float * getRayY();
+		// Meters for every raw depth value, 0 for no reading
+		const float * getDepthTable();
+
+	private:
+		int width;
+		int height;
+		cameraIntrinsics intrinsics;
+
+		std::vector<float> rayX;
+		std::vector<float> rayY;
+		float depthTable[2048];
+
+		// the points, with room for one past the end (see update())
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		int count;
+
+		int blobCount;
+		int blobStart[BLOB_LIST_SIZE];
+		int blobPoints[BLOB_LIST_SIZE];
+		float centroidX[BLOB_LIST_SIZE];
+		float centroidY[BLOB_LIST_SIZE];
+		float centroidZ[BLOB_LIST_SIZE];
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "regionSegmenter.h"
+#include "depthMask.h"
+#include "depthConversion.h"
+
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+//--------------------------------------------------------------
+regionSegmenter::regionSegmenter() {
+	width = height = 0;
+}
+
+//--------------------------------------------------------------
+void regionSegmenter::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+	row.assign(width, 0);
+}
+
+//--------------------------------------------------------------
+int regionSegmenter::addRegion(const std::string & name, int x0, int y0, int x1, int y1, int nearMm, int farMm,
+							   int minArea, int maxArea, int maxBlobs) {
+	regions.push_back(region());
+	region & r = regions.back();
+	r.name = name;
+	r.x0 = max(x0, 0);
+	r.y0 = max(y0, 0);
+	r.x1 = x1 < 0 || x1 > width ? width : x1;
+	r.y1 = y1 < 0 || y1 > height ? height : y1;
+	r.minArea = minArea;
+	r.maxArea = maxArea;
+	r.maxBlobs = maxBlobs;
+	r.mask = NULL;
+	r.labeller.setup(width, height);
+	r.blobs.count = 0;
+	int index = regions.size() - 1;
+	setThresholds(index, nearMm, farMm);
+	return index;
+}
+
+//--------------------------------------------------------------
+int regionSegmenter::getRegion(const std::string & name) {
+	for (size_t r = 0; r < regions.size(); r++)
+		if (regions[r].name == name)
+			return r;
+	return -1;
+}
+
+//--------------------------------------------------------------
+int regionSegmenter::getRegionCount() {
+	return regions.size();
+}
+
+//--------------------------------------------------------------
+void regionSegmenter::setThresholds(int region, int nearMm, int farMm) {
+	regions[region].closest = nearMm > 0 ? millimetersToRawDepth(nearMm) : 0;
+	regions[region].cutoff = millimetersToRawDepth(farMm);
+}
+
+//--------------------------------------------------------------
+void regionSegmenter::setMaskOutput(int region, unsigned char * mask) {
+	regions[region].mask = mask;
+}
+
+//--------------------------------------------------------------
+void regionSegmenter::find(const unsigned short * depth, const unsigned short * limits) {
+	int count = regions.size();
+	for (int i = 0; i < count; i++)
+		regions[i].labeller.begin();
+
+	// row by row, so each row of depth and limits is still in the cache
+	// for every region after the first
+	for (int y = 0; y < height; y++){
+		for (int i = 0; i < count; i++){
+			region & r = regions[i];
+			if (y < r.y0 || y >= r.y1)
+				continue;
+			int offset = y*width;
+			unsigned char * out = r.mask != NULL ? r.mask + offset : &row[0];
+			depthMask(depth + offset + r.x0, limits + offset + r.x0, out + r.x0, r.x1 - r.x0, r.cutoff, r.closest);
+			r.labeller.addRow(out, depth + offset, y, r.x0, r.x1);
+		}
+	}
+
+	for (int i = 0; i < count; i++){
+		region & r = regions[i];
+		r.labeller.end(r.blobs, r.minArea, r.maxArea, r.maxBlobs);
+	}
+}
+
+//--------------------------------------------------------------
+blobList & regionSegmenter::getBlobs(int region) {
+	return regions[region].blobs;
+}
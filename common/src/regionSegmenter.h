@@ -0,0 +1,70 @@
+#ifndef _REGION_SEGMENTER
+#define _REGION_SEGMENTER
+
+#include <string>
+#include <vector>
+
+#include "blobLabeller.h"
+
+// Segments several named regions of the same depth frame at once, eg. in
+// mkart the hands over the whole frame and the foot over the bottom rows,
+// each with its own near and far thresholds and its own blobs.
+//
+// find() goes over the frame once, top to bottom. Each row is masked
+// (see depthMask.h) for every region that covers it and handed straight
+// to that region's blobLabeller, so the masks are never read back and no
+// region needs a pass of its own. A region's mask is only kept if it is
+// given somewhere to go with setMaskOutput() (eg. to show it), otherwise
+// every row is masked into the same small buffer.
+class regionSegmenter {
+
+	public:
+		regionSegmenter();
+
+		void setup(int width, int height);
+
+		// Adds a region (after setup()) covering pixels x0 to x1-1 of rows
+		// y0 to y1-1 (x1 or y1 < 0 means to the edge). Pixels count when they
+		// are in front of the background and between nearMm and farMm away.
+		// Blobs outside minArea..maxArea are dropped and only the biggest
+		// maxBlobs are kept (see blobLabeller.h). Returns the region's index.
+		int addRegion(const std::string & name, int x0, int y0, int x1, int y1, int nearMm, int farMm,
+					  int minArea, int maxArea, int maxBlobs);
+		// The index of the region with this name, or -1
+		int getRegion(const std::string & name);
+		int getRegionCount();
+
+		// Changes a region's thresholds, in millimeters
+		void setThresholds(int region, int nearMm, int farMm);
+		// Keeps the region's mask in mask, a whole frame. Only the pixels
+		// inside the region are written. NULL stops keeping it.
+		void setMaskOutput(int region, unsigned char * mask);
+
+		// Masks and labels every region of a filtered raw depth frame against
+		// the background limits (see backgroundModel.h)
+		void find(const unsigned short * depth, const unsigned short * limits);
+
+		// The blobs find() found in a region, biggest first
+		blobList & getBlobs(int region);
+
+	private:
+		struct region {
+			std::string name;
+			int x0, y0, x1, y1;
+			// thresholds as raw depth values
+			unsigned short closest;
+			unsigned short cutoff;
+			int minArea, maxArea, maxBlobs;
+			unsigned char * mask;
+			blobLabeller labeller;
+			blobList blobs;
+		};
+
+		int width;
+		int height;
+		std::vector<region> regions;
+		// where rows of regions without a mask output go
+		std::vector<unsigned char> row;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "rgbaPack.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// x*a/255, rounded to nearest, without a divide
+static inline unsigned char mulDiv255(unsigned char x, unsigned char a) {
+	unsigned int t = x * a + 128;
+	return (unsigned char) ((t + (t >> 8)) >> 8);
+}
+
+#if defined(__SSSE3__)
+// Same as mulDiv255 on 8 16 bit lanes
+static inline __m128i mulDiv255(__m128i x, __m128i a) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+//--------------------------------------------------------------
+void rgbaPackScalar(const unsigned char * rgb, const unsigned char * alpha, unsigned char * rgba, int count, bool premultiply) {
+	for (int i = 0; i < count; i++){
+		unsigned char a = alpha[i];
+		if (premultiply) {
+			rgba[i*4  ] = mulDiv255(rgb[i*3  ], a);
+			rgba[i*4+1] = mulDiv255(rgb[i*3+1], a);
+			rgba[i*4+2] = mulDiv255(rgb[i*3+2], a);
+		} else {
+			rgba[i*4  ] = rgb[i*3  ];
+			rgba[i*4+1] = rgb[i*3+1];
+			rgba[i*4+2] = rgb[i*3+2];
+		}
+		rgba[i*4+3] = a;
+	}
+}
+
+//--------------------------------------------------------------
+void rgbaPack(const unsigned char * rgb, const unsigned char * alpha, unsigned char * rgba, int count, bool premultiply) {
+	int i = 0;
+
+#if defined(__SSSE3__)
+	// 16 pixels per iteration: 48 bytes of RGB are cut into four groups of
+	// 4 pixels, each spread out to 16 bytes with a zero where alpha goes,
+	// then the alpha bytes are moved into place and or'ed in
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i zero = _mm_setzero_si128();
+	// replicates each pixel's alpha into its 3 color channels, and forces
+	// the alpha channel factor to 255 so alpha itself is left alone
+	const __m128i alphaFactor[4] = {
+		_mm_setr_epi8(0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1),
+		_mm_setr_epi8(4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1),
+		_mm_setr_epi8(8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11, -1),
+		_mm_setr_epi8(12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15, 15, -1)
+	};
+	const __m128i alphaSlot = _mm_setr_epi8(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+
+	for (; i + 16 <= count; i += 16){
+		const unsigned char * src = rgb + i*3;
+		__m128i a0 = _mm_loadu_si128((const __m128i *) (src));
+		__m128i a1 = _mm_loadu_si128((const __m128i *) (src + 16));
+		__m128i a2 = _mm_loadu_si128((const __m128i *) (src + 32));
+		__m128i al = _mm_loadu_si128((const __m128i *) (alpha + i));
+
+		__m128i px[4];
+		px[0] = _mm_shuffle_epi8(a0, spread);
+		px[1] = _mm_shuffle_epi8(_mm_alignr_epi8(a1, a0, 12), spread);
+		px[2] = _mm_shuffle_epi8(_mm_alignr_epi8(a2, a1, 8), spread);
+		px[3] = _mm_shuffle_epi8(_mm_srli_si128(a2, 4), spread);
+
+		__m128i lo = _mm_unpacklo_epi8(zero, al);
+		__m128i hi = _mm_unpackhi_epi8(zero, al);
+		__m128i alphas[4];
+		alphas[0] = _mm_unpacklo_epi16(zero, lo);
+		alphas[1] = _mm_unpackhi_epi16(zero, lo);
+		alphas[2] = _mm_unpacklo_epi16(zero, hi);
+		alphas[3] = _mm_unpackhi_epi16(zero, hi);
+
+		for (int k = 0; k < 4; k++){
+			__m128i out = _mm_or_si128(px[k], alphas[k]);
+			if (premultiply) {
+				__m128i f = _mm_or_si128(_mm_shuffle_epi8(al, alphaFactor[k]), alphaSlot);
+				__m128i l = mulDiv255(_mm_unpacklo_epi8(out, zero), _mm_unpacklo_epi8(f, zero));
+				__m128i h = mulDiv255(_mm_unpackhi_epi8(out, zero), _mm_unpackhi_epi8(f, zero));
+				out = _mm_packus_epi16(l, h);
+			}
+			_mm_storeu_si128((__m128i *) (rgba + i*4 + k*16), out);
+		}
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	// NEON has structured loads/stores, so the interleave is free
+	for (; i + 16 <= count; i += 16){
+		uint8x16x3_t in = vld3q_u8(rgb + i*3);
+		uint8x16x4_t out;
+		out.val[3] = vld1q_u8(alpha + i);
+		for (int c = 0; c < 3; c++){
+			if (premultiply) {
+				uint16x8_t l = vmull_u8(vget_low_u8(in.val[c]), vget_low_u8(out.val[3]));
+				uint16x8_t h = vmull_u8(vget_high_u8(in.val[c]), vget_high_u8(out.val[3]));
+				out.val[c] = vcombine_u8(vraddhn_u16(l, vrshrq_n_u16(l, 8)), vraddhn_u16(h, vrshrq_n_u16(h, 8)));
+			} else {
+				out.val[c] = in.val[c];
+			}
+		}
+		vst4q_u8(rgba + i*4, out);
+	}
+#endif
+
+	// finish off whatever doesn't fill a whole vector
+	rgbaPackScalar(rgb + i*3, alpha + i, rgba + i*4, count - i, premultiply);
+}
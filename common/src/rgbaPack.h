@@ -0,0 +1,16 @@
+#ifndef _RGBA_PACK
+#define _RGBA_PACK
+
+// Interleaves an RGB image and a single channel alpha mask into RGBA,
+// ready to be uploaded with ofTexture::loadData(..., GL_RGBA).
+// Pixels are walked in memory order, so rgba should be a buffer that is
+// allocated once and reused every frame (see alignedMemory.h).
+// With premultiply set the color channels are scaled by alpha/255
+// (rounded), for use with a premultiplied alpha blend mode.
+void rgbaPack(const unsigned char * rgb, const unsigned char * alpha, unsigned char * rgba, int count, bool premultiply = false);
+
+// Plain C version of the above, used on cpus without SSSE3/NEON and
+// as a reference to check the vectorized path against
+void rgbaPackScalar(const unsigned char * rgb, const unsigned char * alpha, unsigned char * rgba, int count, bool premultiply = false);
+
+#endif
@@ -0,0 +1,153 @@
+#include "stageGraph.h"
+#include "timer.h"
+
+#include <stdio.h>
+
+//--------------------------------------------------------------
+stageGraph::stageGraph() {
+	pool = NULL;
+	bSerial = false;
+	bSampling = false;
+	hook = NULL;
+	pending = 0;
+}
+
+//--------------------------------------------------------------
+stageGraph::~stageGraph() {
+	for (size_t i = 0; i < calls.size(); i++)
+		delete calls[i];
+}
+
+//--------------------------------------------------------------
+void stageGraph::setup(threadPool * pool) {
+	this->pool = pool;
+}
+
+//--------------------------------------------------------------
+int stageGraph::addStage(const std::string & name, call * function, int after1, int after2, int after3) {
+	int stage = (int) calls.size();
+	calls.push_back(function);
+	// 20us buckets up to 10ms
+	timings.push_back(latencyHistogram(name, 20, 500));
+	stats.push_back(stageStats(name));
+	dependents.push_back(std::vector<int>());
+	dependencyCount.push_back(0);
+	remaining.push_back(0);
+	stageTask task;
+	task.graph = this;
+	task.stage = stage;
+	tasks.push_back(task);
+
+	if (after1 >= 0)
+		addDependency(stage, after1);
+	if (after2 >= 0)
+		addDependency(stage, after2);
+	if (after3 >= 0)
+		addDependency(stage, after3);
+	return stage;
+}
+
+//--------------------------------------------------------------
+void stageGraph::addDependency(int stage, int after) {
+	// only earlier stages, so the graph can't have a cycle
+	if (after < 0 || after >= stage) {
+		fprintf(stderr, "stageGraph: %s can only wait for a stage added before it\n", stats[stage].getName().c_str());
+		return;
+	}
+	dependents[after].push_back(stage);
+	dependencyCount[stage]++;
+}
+
+//--------------------------------------------------------------
+void stageGraph::setSerial(bool serial) {
+	bSerial = serial;
+}
+
+//--------------------------------------------------------------
+bool stageGraph::isSerial() {
+	return bSerial;
+}
+
+//--------------------------------------------------------------
+void stageGraph::setHook(stageHook * hook) {
+	this->hook = hook;
+}
+
+//--------------------------------------------------------------
+void stageGraph::run() {
+	int count = (int) calls.size();
+	if (bSerial || pool == NULL || pool->getThreadCount() == 0) {
+		for (int i = 0; i < count; i++)
+			runStage(i, 0);
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+		remaining[i] = dependencyCount[i];
+	pending = count;
+	__sync_synchronize();
+	for (int i = 0; i < count; i++){
+		if (dependencyCount[i] == 0)
+			pool->submit(&tasks[i], pool->getThread());
+	}
+	pool->wait(&pending);
+}
+
+//--------------------------------------------------------------
+int stageGraph::getStageCount() {
+	return (int) calls.size();
+}
+
+//--------------------------------------------------------------
+const std::string & stageGraph::getName(int stage) {
+	return stats[stage].getName();
+}
+
+//--------------------------------------------------------------
+void stageGraph::setSampling(bool sampling) {
+	bSampling = sampling;
+}
+
+//--------------------------------------------------------------
+std::vector<latencyHistogram> & stageGraph::getTimings() {
+	return timings;
+}
+
+//--------------------------------------------------------------
+std::vector<stageStats> & stageGraph::getStats() {
+	return stats;
+}
+
+//--------------------------------------------------------------
+void stageGraph::clearStats() {
+	for (size_t i = 0; i < stats.size(); i++){
+		timings[i].clear();
+		stats[i].clear();
+	}
+}
+
+//--------------------------------------------------------------
+void stageGraph::runStage(int stage, int thread) {
+	unsigned long long start = timerNanos();
+	(*calls[stage])();
+	unsigned long long end = timerNanos();
+	timings[stage].add((end - start) / 1000);
+	if (bSampling)
+		stats[stage].add((end - start) / 1000.0);
+	if (hook != NULL)
+		hook->stageDone(stage, start / 1000, end / 1000, thread);
+}
+
+//--------------------------------------------------------------
+void stageGraph::stageTask::run(int thread) {
+	graph->runStage(stage, thread);
+
+	// hand on whatever was only waiting for this stage, to this thread's
+	// queue as it has the inputs in cache
+	std::vector<int> & next = graph->dependents[stage];
+	for (size_t i = 0; i < next.size(); i++){
+		if (__sync_sub_and_fetch(&graph->remaining[next[i]], 1) == 0)
+			graph->pool->submit(&graph->tasks[next[i]], thread);
+	}
+	__sync_sub_and_fetch(&graph->pending, 1);
+}
@@ -0,0 +1,123 @@
+#ifndef _STAGE_GRAPH
+#define _STAGE_GRAPH
+
+#include <string>
+#include <vector>
+
+#include "threadPool.h"
+#include "stageStats.h"
+#include "latencyHistogram.h"
+
+// Told about every stage as it finishes, from the thread that ran it.
+// Times are timerMicros(), thread is as in poolTask::run().
+class stageHook {
+
+	public:
+		virtual ~stageHook() {}
+
+		virtual void stageDone(int stage, unsigned long long start, unsigned long long end, int thread) = 0;
+};
+
+// The per frame work of a demo as a small graph of stages, eg. for mkart
+//
+//   color ----------------------------.
+//   depth -> regions -> hands -------> keys
+//                    `-> foot -------'
+//
+// Each stage is a method on the app, declared along with the stages it
+// needs to have run first. run() goes through the whole graph once,
+// handing every stage whose inputs are done to a threadPool, so stages
+// that don't depend on each other run at the same time. Stages have to
+// be added after the stages they depend on, which also makes the order
+// they are added in one that works serially.
+//
+// With no pool, a pool with no threads, or setSerial(true), run() just
+// calls the stages in the order they were added on the calling thread,
+// every time, which is the thing to use when debugging.
+//
+// How long each stage takes goes into a latencyHistogram, which never
+// grows, so a demo can leave it collecting for as long as it runs. Every
+// sample is only kept (in a stageStats) with setSampling(true), eg. for
+// the benchmark.
+class stageGraph {
+
+	public:
+		stageGraph();
+		~stageGraph();
+
+		// The pool has to outlive the graph
+		void setup(threadPool * pool);
+
+		// Adds a stage that calls object->method() once per run(), after the
+		// stages given (-1 for none). Returns the stage's index.
+		template <class T>
+		int addStage(const std::string & name, T * object, void (T::*method)(), int after1 = -1, int after2 = -1, int after3 = -1) {
+			return addStage(name, new memberCall<T>(object, method), after1, after2, after3);
+		}
+		// For stages that need more than three others
+		void addDependency(int stage, int after);
+
+		void setSerial(bool serial);
+		bool isSerial();
+		// Called as every stage finishes, NULL for none
+		void setHook(stageHook * hook);
+
+		// Runs every stage once, returns when they have all finished
+		void run();
+
+		int getStageCount();
+		const std::string & getName(int stage);
+		// Keep every stage's every time as well, off by default
+		void setSampling(bool sampling);
+		// How long each stage took, only read them between runs
+		std::vector<latencyHistogram> & getTimings();
+		// Each run()'s sample, empty unless sampling
+		std::vector<stageStats> & getStats();
+		void clearStats();
+
+	private:
+		class call {
+			public:
+				virtual ~call() {}
+				virtual void operator()() = 0;
+		};
+
+		template <class T>
+		class memberCall : public call {
+			public:
+				memberCall(T * object, void (T::*method)()) : object(object), method(method) {}
+				void operator()() { (object->*method)(); }
+			private:
+				T * object;
+				void (T::*method)();
+		};
+
+		class stageTask : public poolTask {
+			public:
+				stageGraph * graph;
+				int stage;
+				void run(int thread);
+		};
+
+		int addStage(const std::string & name, call * function, int after1, int after2, int after3);
+		void runStage(int stage, int thread);
+
+		threadPool * pool;
+		bool bSerial;
+		bool bSampling;
+		stageHook * hook;
+
+		// one entry per stage
+		std::vector<call *> calls;
+		std::vector<latencyHistogram> timings;
+		std::vector<stageStats> stats;
+		std::vector< std::vector<int> > dependents;
+		std::vector<int> dependencyCount;
+		std::vector<stageTask> tasks;
+		// counted down as a run goes, how many of each stage's
+		// dependencies have still to finish, and how many stages
+		std::vector<int> remaining;
+		volatile int pending;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "stageStats.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <math.h>
+
+//--------------------------------------------------------------
+stageStats::stageStats(const std::string & name) : name(name) {
+	bSorted = true;
+	total = 0;
+}
+
+//--------------------------------------------------------------
+void stageStats::add(double micros) {
+	samples.push_back(micros);
+	total += micros;
+	bSorted = false;
+}
+
+//--------------------------------------------------------------
+void stageStats::clear() {
+	samples.clear();
+	total = 0;
+	bSorted = true;
+}
+
+//--------------------------------------------------------------
+const std::string & stageStats::getName() {
+	return name;
+}
+
+//--------------------------------------------------------------
+int stageStats::getCount() {
+	return (int) samples.size();
+}
+
+//--------------------------------------------------------------
+double stageStats::getMin() {
+	return getPercentile(0);
+}
+
+//--------------------------------------------------------------
+double stageStats::getMax() {
+	return getPercentile(100);
+}
+
+//--------------------------------------------------------------
+double stageStats::getMean() {
+	return samples.empty() ? 0 : total / samples.size();
+}
+
+//--------------------------------------------------------------
+double stageStats::getMedian() {
+	return getPercentile(50);
+}
+
+//--------------------------------------------------------------
+double stageStats::getPercentile(double p) {
+	if (samples.empty())
+		return 0;
+	if (!bSorted) {
+		std::sort(samples.begin(), samples.end());
+		bSorted = true;
+	}
+	int rank = (int) ceil(p / 100.0 * samples.size()) - 1;
+	rank = std::max(0, std::min(rank, (int) samples.size() - 1));
+	return samples[rank];
+}
+
+//--------------------------------------------------------------
+double stageStats::getTotal() {
+	return total;
+}
+
+//--------------------------------------------------------------
+stageTimer::stageTimer(stageStats & stats) : stats(stats) {
+	start = timerNanos();
+}
+
+//--------------------------------------------------------------
+stageTimer::~stageTimer() {
+	stats.add((timerNanos() - start) / 1000.0);
+}
@@ -0,0 +1,51 @@
+#ifndef _STAGE_STATS
+#define _STAGE_STATS
+
+#include <string>
+#include <vector>
+
+// Collects timing samples (in microseconds) for one stage of a pipeline
+// and reports min/median/percentiles over them
+class stageStats {
+
+	public:
+		stageStats(const std::string & name = "");
+
+		void add(double micros);
+		void clear();
+
+		const std::string & getName();
+		int getCount();
+		double getMin();
+		double getMax();
+		double getMean();
+		double getMedian();
+		// p is 0-100, nearest rank
+		double getPercentile(double p);
+		double getTotal();
+
+	private:
+		std::string name;
+		std::vector<double> samples;
+		bool bSorted;
+		double total;
+};
+
+// Times its own lifetime and adds it to a stageStats, eg.
+//
+//   {
+//       stageTimer t(maskStats);
+//       depthMask(...);
+//   }
+class stageTimer {
+
+	public:
+		stageTimer(stageStats & stats);
+		~stageTimer();
+
+	private:
+		stageStats & stats;
+		unsigned long long start;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "threadPool.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// how many times an idle thread looks for work before going to sleep,
+// it is much cheaper than a wakeup if the next stage is only a few
+// microseconds away
+#define SPIN_COUNT 200
+
+//--------------------------------------------------------------
+threadPool::threadPool() {
+	bRunning = false;
+	queued = 0;
+	pthread_mutex_init(&sleepMutex, NULL);
+	pthread_cond_init(&wake, NULL);
+	pthread_key_create(&threadKey, NULL);
+	queues.push_back(new taskQueue());
+	pthread_mutex_init(&queues[0]->mutex, NULL);
+}
+
+//--------------------------------------------------------------
+threadPool::~threadPool() {
+	stop();
+	for (size_t i = 0; i < queues.size(); i++){
+		pthread_mutex_destroy(&queues[i]->mutex);
+		delete queues[i];
+	}
+	pthread_key_delete(threadKey);
+	pthread_cond_destroy(&wake);
+	pthread_mutex_destroy(&sleepMutex);
+}
+
+//--------------------------------------------------------------
+void threadPool::setup(int threads) {
+	stop();
+	for (int i = 0; i < threads; i++){
+		taskQueue * queue = new taskQueue();
+		pthread_mutex_init(&queue->mutex, NULL);
+		queues.push_back(queue);
+	}
+	bRunning = true;
+	for (int i = 0; i < threads; i++){
+		worker * w = new worker();
+		w->pool = this;
+		w->index = i + 1;
+		workers.push_back(w);
+		w->startThread();
+	}
+}
+
+//--------------------------------------------------------------
+void threadPool::stop() {
+	pthread_mutex_lock(&sleepMutex);
+	bRunning = false;
+	pthread_cond_broadcast(&wake);
+	pthread_mutex_unlock(&sleepMutex);
+	for (size_t i = 0; i < workers.size(); i++){
+		workers[i]->stopThread();
+		delete workers[i];
+	}
+	workers.clear();
+
+	for (size_t i = 1; i < queues.size(); i++){
+		pthread_mutex_destroy(&queues[i]->mutex);
+		delete queues[i];
+	}
+	queues.resize(1);
+	queues[0]->tasks.clear();
+	queued = 0;
+}
+
+//--------------------------------------------------------------
+int threadPool::getThreadCount() {
+	return (int) workers.size();
+}
+
+//--------------------------------------------------------------
+void threadPool::submit(poolTask * task, int thread) {
+	taskQueue * queue = queues[thread];
+	pthread_mutex_lock(&queue->mutex);
+	queue->tasks.push_back(task);
+	pthread_mutex_unlock(&queue->mutex);
+	__sync_add_and_fetch(&queued, 1);
+
+	// wake a sleeping thread for it, and wait() in case it is for queue 0
+	if (!workers.empty()) {
+		pthread_mutex_lock(&sleepMutex);
+		pthread_cond_signal(&wake);
+		pthread_mutex_unlock(&sleepMutex);
+	}
+	finished.signal();
+}
+
+//--------------------------------------------------------------
+void threadPool::wait(volatile int * pending) {
+	wait(pending, getThread());
+}
+
+//--------------------------------------------------------------
+void threadPool::wait(volatile int * pending, int thread) {
+	// pending is read with a barrier, so everything the tasks wrote
+	// before counting it down is seen once it reaches 0
+	while (__sync_add_and_fetch(pending, 0) > 0) {
+		poolTask * task = take(thread);
+		if (task != NULL) {
+			task->run(thread);
+			continue;
+		}
+		if (__sync_add_and_fetch(pending, 0) == 0)
+			break;
+		// the rest is running on other threads. Only the outside thread
+		// sleeps on finished, the pool's own are only ever waiting for a
+		// few strips. The timeout is only there in case a task counts
+		// down without finishing.
+		if (thread == 0)
+			finished.wait(1000);
+		else
+			sched_yield();
+	}
+}
+
+//--------------------------------------------------------------
+void threadPool::forStrips(int rows, int rowBytes, stripCall & call) {
+	int thread = getThread();
+	int stripRows = rowBytes > 0 ? STRIP_BYTES / rowBytes : rows;
+	if (stripRows < 1)
+		stripRows = 1;
+	if ((rows + stripRows - 1) / stripRows > MAX_STRIPS)
+		stripRows = (rows + MAX_STRIPS - 1) / MAX_STRIPS;
+	int count = (rows + stripRows - 1) / stripRows;
+	if (workers.empty() || count <= 1) {
+		call(0, rows, thread);
+		return;
+	}
+
+	// hand out all but the first strip, which this thread does itself
+	// straight away, then help with the rest
+	stripTask tasks[MAX_STRIPS];
+	volatile int pending = count - 1;
+	for (int i = count - 1; i > 0; i--){
+		tasks[i].call = &call;
+		tasks[i].y0 = i * stripRows;
+		tasks[i].y1 = i + 1 < count ? (i + 1) * stripRows : rows;
+		tasks[i].pending = &pending;
+		submit(&tasks[i], thread);
+	}
+	call(0, stripRows, thread);
+	wait(&pending, thread);
+}
+
+//--------------------------------------------------------------
+int threadPool::getThread() {
+	return (int) (long) pthread_getspecific(threadKey);
+}
+
+//--------------------------------------------------------------
+void threadPool::stripTask::run(int thread) {
+	(*call)(y0, y1, thread);
+	__sync_sub_and_fetch(pending, 1);
+}
+
+//--------------------------------------------------------------
+int threadPool::getDefaultThreadCount() {
+	const char * threads = getenv("KINECT_THREADS");
+	if (threads != NULL)
+		return atoi(threads) > 0 ? atoi(threads) : 0;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 1 ? (int) cores - 1 : 0;
+}
+
+//--------------------------------------------------------------
+poolTask * threadPool::take(int thread) {
+	if (queued == 0)
+		return NULL;
+
+	// newest first from our own queue
+	poolTask * task = NULL;
+	taskQueue * queue = queues[thread];
+	pthread_mutex_lock(&queue->mutex);
+	if (!queue->tasks.empty()) {
+		task = queue->tasks.back();
+		queue->tasks.pop_back();
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	// oldest first from everyone else's
+	int count = (int) queues.size();
+	for (int i = 1; task == NULL && i < count; i++){
+		queue = queues[(thread + i) % count];
+		pthread_mutex_lock(&queue->mutex);
+		if (!queue->tasks.empty()) {
+			task = queue->tasks.front();
+			queue->tasks.pop_front();
+		}
+		pthread_mutex_unlock(&queue->mutex);
+	}
+
+	if (task != NULL)
+		__sync_sub_and_fetch(&queued, 1);
+	return task;
+}
+
+//--------------------------------------------------------------
+void threadPool::worker::threadedFunction() {
+	pthread_setspecific(pool->threadKey, (void *) (long) index);
+	int idle = 0;
+	while (pool->bRunning) {
+		poolTask * task = pool->take(index);
+		if (task != NULL) {
+			task->run(index);
+			// the waiting thread may be waiting on this one
+			pool->finished.signal();
+			idle = 0;
+			continue;
+		}
+		if (++idle < SPIN_COUNT) {
+			sched_yield();
+			continue;
+		}
+
+		// nothing for a while, sleep until something is submitted
+		pthread_mutex_lock(&pool->sleepMutex);
+		while (pool->queued == 0 && pool->bRunning)
+			pthread_cond_wait(&pool->wake, &pool->sleepMutex);
+		pthread_mutex_unlock(&pool->sleepMutex);
+		idle = 0;
+	}
+}
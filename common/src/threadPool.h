@@ -0,0 +1,137 @@
+#ifndef _THREAD_POOL
+#define _THREAD_POOL
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+#include "workerThread.h"
+
+// About what fits in L2 with room to spare, see threadPool::forStrips()
+#define STRIP_BYTES (64 * 1024)
+// and the most strips a frame is cut into
+#define MAX_STRIPS 64
+
+// Something to run on a threadPool. thread is 0 when it runs on the
+// thread that called threadPool::wait(), and 1 to getThreadCount() on the
+// pool's own threads.
+class poolTask {
+
+	public:
+		virtual ~poolTask() {}
+
+		virtual void run(int thread) = 0;
+};
+
+// A fixed set of threads that run poolTasks, kept around for the life of
+// the app so nothing is started or stopped per frame.
+//
+// Every thread has its own queue. Tasks submitted from inside a task go
+// on the queue of the thread running it, and are taken newest first, so
+// a stage's follow on work tends to run where its input is still in
+// cache. A thread whose queue is empty steals the oldest task from
+// another one. The thread waiting for the work to finish (eg. the demo's
+// processing thread) has queue 0 and runs tasks too, so a pool with no
+// threads of its own runs everything on the waiting thread.
+class threadPool {
+
+	public:
+		threadPool();
+		~threadPool();
+
+		// Starts the given number of threads, on top of the thread that
+		// will be calling wait()
+		void setup(int threads);
+		// Stops and joins the threads, anything still queued is dropped
+		void stop();
+		int getThreadCount();
+
+		// Queues a task, on the given thread's queue. The task has to stay
+		// around until it has run.
+		void submit(poolTask * task, int thread = 0);
+		// Runs and steals tasks on the calling thread until pending drops
+		// to 0. Whatever the tasks are doing has to count it down.
+		void wait(volatile int * pending);
+
+		// Splits rows 0 to rows-1 into strips of about STRIP_BYTES (rowBytes
+		// being what one row reads and writes) and calls
+		// object->method(y0, y1, thread) for each, on all the threads,
+		// returning once they are all done. Meant for the per pixel
+		// kernels, which then run over cache sized pieces of the frame.
+		// Works from inside a task too. thread is what getThread() gives
+		// on the thread that runs the strip, for picking per thread scratch
+		// space. With no threads it is a single call over all the rows.
+		template <class T>
+		void forStrips(int rows, int rowBytes, T * object, void (T::*method)(int, int, int)) {
+			memberStrip<T> call(object, method);
+			forStrips(rows, rowBytes, call);
+		}
+
+		// Which thread this is, 0 for any thread that isn't the pool's own
+		// (only one of those should use the pool at a time)
+		int getThread();
+
+		// One thread less than there are cores, as the thread that waits
+		// works too. KINECT_THREADS overrides it, 0 runs everything on the
+		// waiting thread.
+		static int getDefaultThreadCount();
+
+	private:
+		class stripCall {
+			public:
+				virtual ~stripCall() {}
+				virtual void operator()(int y0, int y1, int thread) = 0;
+		};
+
+		template <class T>
+		class memberStrip : public stripCall {
+			public:
+				memberStrip(T * object, void (T::*method)(int, int, int)) : object(object), method(method) {}
+				void operator()(int y0, int y1, int thread) { (object->*method)(y0, y1, thread); }
+			private:
+				T * object;
+				void (T::*method)(int, int, int);
+		};
+
+		class stripTask : public poolTask {
+			public:
+				stripCall * call;
+				int y0, y1;
+				volatile int * pending;
+				void run(int thread);
+		};
+
+		void forStrips(int rows, int rowBytes, stripCall & call);
+		void wait(volatile int * pending, int thread);
+
+		class worker : public workerThread {
+			public:
+				threadPool * pool;
+				int index;
+			protected:
+				void threadedFunction();
+		};
+
+		struct taskQueue {
+			pthread_mutex_t mutex;
+			std::deque<poolTask *> tasks;
+		};
+
+		// takes from the thread's own queue, or steals from another
+		poolTask * take(int thread);
+
+		std::vector<taskQueue *> queues;
+		std::vector<worker *> workers;
+		// holds each of the pool's threads' index
+		pthread_key_t threadKey;
+		volatile bool bRunning;
+		volatile int queued;
+
+		// the pool's threads sleep on this when there is nothing to do
+		pthread_mutex_t sleepMutex;
+		pthread_cond_t wake;
+		// and wait() when everything left is running elsewhere
+		waitableEvent finished;
+};
+
+#endif
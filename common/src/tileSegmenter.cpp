@@ -0,0 +1,384 @@
+#include "tileSegmenter.h"
+#include "depthMask.h"
+#include "depthConversion.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using std::min;
+using std::max;
+
+//--------------------------------------------------------------
+tileSegmenter::tileSegmenter() {
+	width = height = 0;
+	tileSize = 32;
+	tilesX = tilesY = 0;
+	tolerance = 0;
+	deadband = 0;
+	bInvalid = true;
+	dirtyCount = 0;
+	bWindowed = false;
+	activeCount = 0;
+	checkedPixels = 0;
+	pool = NULL;
+	filters.resize(1);
+	input = NULL;
+	model = NULL;
+	maskLimits = NULL;
+	maskOutput = NULL;
+	maskCutoff = 0;
+	maskY0 = maskY1 = 0;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::setup(int width, int height, int tileSize) {
+	this->width = width;
+	this->height = height;
+	this->tileSize = tileSize;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+
+	reference.assign(width*height, 0);
+	filtered.assign(width*height, 0);
+	changed.assign(tilesX*tilesY, 0);
+	dirty.assign(tilesX*tilesY, 0);
+	active.assign(tilesX*tilesY, 1);
+	wasActive.assign(tilesX*tilesY, 1);
+	watched.assign(tilesX*tilesY, 1);
+	cleared.assign(tilesX*height, 0);
+
+	bInvalid = true;
+	dirtyCount = 0;
+	bWindowed = false;
+	activeCount = tilesX*tilesY;
+	checkedPixels = width*height;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::setTolerance(int tolerance) {
+	this->tolerance = tolerance < 0 ? 0 : tolerance;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::setKernel(int kernelWidth, int kernelHeight) {
+	for (size_t i = 0; i < filters.size(); i++)
+		filters[i].setKernel(kernelWidth, kernelHeight);
+	bInvalid = true;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::setTemporal(int deadband) {
+	this->deadband = deadband < 0 ? 0 : deadband;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::setPool(threadPool * pool) {
+	this->pool = pool;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::invalidate() {
+	bInvalid = true;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::setWindows(const int * x0, const int * y0, const int * x1, const int * y1, int count) {
+	active.assign(tilesX*tilesY, 0);
+	for (int i = 0; i < count; i++){
+		int tx0 = max(x0[i], 0) / tileSize, tx1 = (min(x1[i], width) + tileSize - 1) / tileSize;
+		int ty0 = max(y0[i], 0) / tileSize, ty1 = (min(y1[i], height) + tileSize - 1) / tileSize;
+		for (int ty = ty0; ty < ty1; ty++){
+			for (int tx = tx0; tx < tx1; tx++)
+				active[ty*tilesX + tx] = 1;
+		}
+	}
+	bWindowed = true;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::clearWindows() {
+	active.assign(tilesX*tilesY, 1);
+	bWindowed = false;
+}
+
+//--------------------------------------------------------------
+bool tileSegmenter::isWindowed() {
+	return bWindowed;
+}
+
+//--------------------------------------------------------------
+bool tileSegmenter::tileChanged(const unsigned short * depth, int tileX, int tileY) {
+	int x0 = tileX * tileSize, x1 = min(x0 + tileSize, width);
+	int y0 = tileY * tileSize, y1 = min(y0 + tileSize, height);
+	for (int y = y0; y < y1; y++){
+		const unsigned short * a = depth + y*width;
+		const unsigned short * b = &reference[y*width];
+		int x = x0;
+#if defined(__SSE2__)
+		// |a - b| > tolerance, 8 pixels at a time
+		const __m128i tol = _mm_set1_epi16((short) min(tolerance, 0x7fff));
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 8 <= x1; x += 8){
+			__m128i va = _mm_loadu_si128((const __m128i *) (a + x));
+			__m128i vb = _mm_loadu_si128((const __m128i *) (b + x));
+			__m128i diff = _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va));
+			__m128i over = _mm_subs_epu16(diff, tol);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(over, zero)) != 0xffff)
+				return true;
+		}
+#endif
+		for (; x < x1; x++){
+			int diff = a[x] - b[x];
+			if (diff > tolerance || -diff > tolerance)
+				return true;
+		}
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+bool tileSegmenter::stabilizeTile(const unsigned short * depth, int tileX, int tileY) {
+	int x0 = tileX * tileSize, x1 = min(x0 + tileSize, width);
+	int y0 = tileY * tileSize, y1 = min(y0 + tileSize, height);
+	bool moved = false;
+	for (int y = y0; y < y1; y++){
+		if (depthStabilize(depth + y*width + x0, &reference[y*width + x0], x1 - x0, deadband))
+			moved = true;
+	}
+	return moved;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::copyTile(const unsigned short * depth, int tileX, int tileY) {
+	int x0 = tileX * tileSize, x1 = min(x0 + tileSize, width);
+	int y0 = tileY * tileSize, y1 = min(y0 + tileSize, height);
+	for (int y = y0; y < y1; y++)
+		memcpy(&reference[y*width + x0], depth + y*width + x0, (x1 - x0) * sizeof(unsigned short));
+}
+
+//--------------------------------------------------------------
+int tileSegmenter::update(const unsigned short * depth) {
+	// a filter for every thread that might run a strip, all set up the same
+	int threads = pool != NULL ? pool->getThreadCount() + 1 : 1;
+	if ((int) filters.size() < threads) {
+		depthFilter settings = filters[0];
+		filters.resize(threads, settings);
+	}
+
+	// the filter reads a few pixels around each pixel, so the tiles it
+	// reaches into from a changed tile need recomputing as well
+	int reachX = (filters[0].getReachX() + tileSize - 1) / tileSize;
+	int reachY = (filters[0].getReachY() + tileSize - 1) / tileSize;
+
+	// only the tiles in the windows, and the ones their filter reads
+	// from, are looked at
+	activeCount = 0;
+	checkedPixels = 0;
+	for (int ty = 0; ty < tilesY; ty++){
+		for (int tx = 0; tx < tilesX; tx++){
+			bool w = bInvalid;
+			for (int ny = max(ty-reachY, 0); ny <= min(ty+reachY, tilesY-1) && !w; ny++){
+				for (int nx = max(tx-reachX, 0); nx <= min(tx+reachX, tilesX-1) && !w; nx++){
+					w = active[ny*tilesX + nx] != 0;
+				}
+			}
+			watched[ty*tilesX + tx] = w;
+			activeCount += active[ty*tilesX + tx];
+			if (w)
+				checkedPixels += (min((tx + 1) * tileSize, width) - tx * tileSize) * (min((ty + 1) * tileSize, height) - ty * tileSize);
+		}
+	}
+
+	// find the tiles whose input changed, and bring what we filter from
+	// up to date
+	input = depth;
+	int rowBytes = tileSize * width * 2 * sizeof(unsigned short);
+	if (pool != NULL)
+		pool->forStrips(tilesY, rowBytes, this, &tileSegmenter::detectStrip);
+	else
+		detectStrip(0, tilesY, 0);
+
+	// A tile is dirty if it or one the filter reaches into changed. Tiles
+	// outside the windows never are, unless everything is redone, and ones
+	// that just came back into a window always are, as the tiles around
+	// them weren't being checked.
+	dirtyCount = 0;
+	for (int ty = 0; ty < tilesY; ty++){
+		for (int tx = 0; tx < tilesX; tx++){
+			int t = ty*tilesX + tx;
+			bool d = bInvalid || (active[t] && !wasActive[t]);
+			for (int ny = max(ty-reachY, 0); ny <= min(ty+reachY, tilesY-1) && !d && active[t]; ny++){
+				for (int nx = max(tx-reachX, 0); nx <= min(tx+reachX, tilesX-1) && !d; nx++){
+					d = changed[ny*tilesX + nx] != 0;
+				}
+			}
+			dirty[t] = d;
+			// tiles that just left the windows don't need filtering, but
+			// their mask does need clearing
+			dirtyCount += d || (wasActive[t] && !active[t]);
+			wasActive[t] = active[t];
+		}
+	}
+
+	// refilter the dirty tiles, once every tile's input is up to date as
+	// the filter reads into the neighbouring ones
+	if (pool != NULL)
+		pool->forStrips(tilesY, rowBytes, this, &tileSegmenter::filterStrip);
+	else
+		filterStrip(0, tilesY, 0);
+
+	bInvalid = false;
+	return dirtyCount;
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::detectStrip(int ty0, int ty1, int thread) {
+	// With the temporal filter on only the pixels that really moved are
+	// taken in, otherwise whole tiles are.
+	for (int ty = ty0; ty < ty1; ty++){
+		for (int tx = 0; tx < tilesX; tx++){
+			bool c;
+			if (!watched[ty*tilesX + tx]) {
+				c = false;
+			} else if (bInvalid) {
+				copyTile(input, tx, ty);
+				c = true;
+			} else if (deadband > 0) {
+				c = stabilizeTile(input, tx, ty);
+			} else {
+				c = tileChanged(input, tx, ty);
+				if (c)
+					copyTile(input, tx, ty);
+			}
+			changed[ty*tilesX + tx] = c;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::filterStrip(int ty0, int ty1, int thread) {
+	// joining up runs of dirty tiles along each row of tiles so the
+	// filter's borders are shared
+	depthFilter & filter = filters[thread];
+	for (int ty = ty0; ty < ty1; ty++){
+		int y0 = ty * tileSize, y1 = min(y0 + tileSize, height);
+		for (int tx = 0; tx < tilesX; tx++){
+			if (!dirty[ty*tilesX + tx])
+				continue;
+			int start = tx;
+			while (tx + 1 < tilesX && dirty[ty*tilesX + tx + 1])
+				tx++;
+			filter.close(&reference[0], &filtered[0], width, height,
+						 start * tileSize, y0, min((tx + 1) * tileSize, width), y1);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+unsigned short * tileSegmenter::getFiltered() {
+	return &filtered[0];
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::updateBackground(backgroundModel & model) {
+	this->model = &model;
+	// what a row of tiles reads and writes: the filtered depth, the
+	// model's mean and variance and its limits
+	int rowBytes = tileSize * width * (sizeof(unsigned short) * 2 + sizeof(float) * 2);
+	if (pool != NULL)
+		pool->forStrips(tilesY, rowBytes, this, &tileSegmenter::backgroundStrip);
+	else
+		backgroundStrip(0, tilesY, 0);
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::backgroundStrip(int ty0, int ty1, int thread) {
+	// runs of dirty tiles are done a whole row of pixels at a time, so
+	// the model is read in long streaks
+	for (int ty = ty0; ty < ty1; ty++){
+		int y0 = ty * tileSize, y1 = min(y0 + tileSize, height);
+		for (int tx = 0; tx < tilesX; tx++){
+			if (!dirty[ty*tilesX + tx])
+				continue;
+			int x0 = tx * tileSize;
+			while (tx + 1 < tilesX && dirty[ty*tilesX + tx + 1])
+				tx++;
+			int x1 = min((tx + 1) * tileSize, width);
+			for (int y = y0; y < y1; y++)
+				model->update(&filtered[0], y*width + x0, x1 - x0);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::mask(const unsigned short * limits, unsigned char * mask, int cutoff, int y0, int y1) {
+	if (y1 < 0 || y1 > height)
+		y1 = height;
+	maskLimits = limits;
+	maskOutput = mask;
+	maskCutoff = millimetersToRawDepth(cutoff);
+	maskY0 = y0;
+	maskY1 = y1;
+	int rowBytes = tileSize * width * (sizeof(unsigned short) * 2 + 1);
+	if (pool != NULL)
+		pool->forStrips(tilesY, rowBytes, this, &tileSegmenter::maskStrip);
+	else
+		maskStrip(0, tilesY, 0);
+}
+
+//--------------------------------------------------------------
+void tileSegmenter::maskStrip(int ty0, int ty1, int thread) {
+	for (int ty = ty0; ty < ty1; ty++){
+		int y0 = max(ty * tileSize, maskY0), y1 = min((ty + 1) * tileSize, maskY1);
+		if (y0 >= y1)
+			continue;
+		for (int tx = 0; tx < tilesX; tx++){
+			int t = ty*tilesX + tx;
+			int x0 = tx * tileSize, x1 = min(x0 + tileSize, width);
+			// tiles outside the windows are cleared once, and masked again
+			// when they come back, dirty or not. That is kept row by row, as
+			// a call might only cover some of a tile's rows.
+			for (int y = y0; y < y1; y++){
+				int offset = y*width + x0;
+				unsigned char & rowCleared = cleared[y*tilesX + tx];
+				if (!active[t]) {
+					if (!rowCleared)
+						memset(maskOutput + offset, 0, x1 - x0);
+					rowCleared = 1;
+				} else if (dirty[t] || rowCleared) {
+					depthMask(&filtered[offset], maskLimits + offset, maskOutput + offset, x1 - x0, maskCutoff);
+					rowCleared = 0;
+				}
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------
+int tileSegmenter::getDirtyCount() {
+	return dirtyCount;
+}
+
+//--------------------------------------------------------------
+int tileSegmenter::getTileCount() {
+	return tilesX * tilesY;
+}
+
+//--------------------------------------------------------------
+bool tileSegmenter::isDirty(int tileX, int tileY) {
+	return dirty[tileY*tilesX + tileX] != 0;
+}
+
+//--------------------------------------------------------------
+int tileSegmenter::getActiveCount() {
+	return activeCount;
+}
+
+//--------------------------------------------------------------
+int tileSegmenter::getCheckedPixels() {
+	return checkedPixels;
+}
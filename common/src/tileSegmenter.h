@@ -0,0 +1,146 @@
+#ifndef _TILE_SEGMENTER
+#define _TILE_SEGMENTER
+
+#include <vector>
+
+#include "depthFilter.h"
+#include "backgroundModel.h"
+#include "threadPool.h"
+
+// Keeps the noise filtered raw depth map and the foreground masks up to
+// date incrementally. The frame is cut into tiles, and each new depth frame is
+// compared with what every tile was last computed from. Only the tiles
+// that changed (plus the neighbours the noise filter reaches into, see
+// depthFilter.h) are filtered and masked again, everything else is
+// left as it was. When the player is still hardly anything is recomputed,
+// and when nothing at all changed the caller can skip blob finding too.
+//
+// With a tolerance of 0 and the temporal filter off (the defaults) the
+// results are exactly the same as processing the whole frame every time.
+//
+// The work can also be limited to windows of the frame (setWindows()),
+// eg. around where the tracked hands will be. The tiles outside them are
+// left alone, and cleared in the mask, until they are in a window again.
+//
+// Given a threadPool, every pass is split into strips of tile rows that
+// run on all its threads. Tiles never depend on each other within a pass
+// and the noise filter reads its border from the shared input, so the
+// results are the same as on one thread.
+class tileSegmenter {
+
+	public:
+		tileSegmenter();
+
+		void setup(int width, int height, int tileSize = 32);
+
+		// Pixels that moved by no more than this many raw steps don't make
+		// a tile dirty
+		void setTolerance(int tolerance);
+		// Size of the noise filter's kernel, 3x3 by default
+		void setKernel(int kernelWidth, int kernelHeight);
+		// Turns on the temporal filter (see depthStabilize() in
+		// depthFilter.h), which holds each pixel until it moves by more
+		// than deadband raw steps. 0, the default, turns it off. Unlike the tolerance,
+		// which leaves whole tiles stale, this works pixel by pixel.
+		void setTemporal(int deadband);
+		// Runs the passes over the frame on the pool's threads, NULL (the
+		// default) runs them on the calling thread
+		void setPool(threadPool * pool);
+		// Forces every tile to be recomputed on the next update(), eg. after
+		// the background or a threshold has changed
+		void invalidate();
+		// From the next update() on only the tiles under these windows are
+		// checked, filtered and masked (x1 and y1 are one past the end, in
+		// pixels), along with the tiles the noise filter reads from around
+		// them. Everything outside them is cleared in the mask, so only
+		// blobs inside them are found. A tile that comes back into a window
+		// is recomputed. invalidate() still redoes the whole frame.
+		void setWindows(const int * x0, const int * y0, const int * x1, const int * y1, int count);
+		// Goes back to the whole frame
+		void clearWindows();
+		bool isWindowed();
+
+		// Takes in a new raw depth frame, works out which tiles are dirty
+		// and refilters them. Returns the number of dirty tiles, plus the
+		// tiles that just left the windows (their mask needs clearing).
+		int update(const unsigned short * rawDepth);
+
+		// The raw depth map after the noise filter
+		unsigned short * getFiltered();
+
+		// Takes the filtered depth of the dirty tiles into model (see
+		// backgroundModel.h). The other tiles haven't changed, so their part
+		// of the model and the limits mask() uses stay as they were.
+		void updateBackground(backgroundModel & model);
+
+		// Recomputes mask (see depthMask.h) from the filtered depth map
+		// for the dirty tiles only, so mask must be kept between frames
+		// (and it should always be the same mask when there are windows).
+		// limits come from depthMaskLimits() and cutoff is in millimeters.
+		// Only rows y0 to y1-1 are touched (y1 < 0 means to the bottom).
+		void mask(const unsigned short * limits, unsigned char * mask, int cutoff, int y0 = 0, int y1 = -1);
+
+		// Stats for the last update()
+		int getDirtyCount();
+		int getTileCount();
+		bool isDirty(int tileX, int tileY);
+		// Tiles inside the windows (all of them without windows), and the
+		// pixels that were checked for changes
+		int getActiveCount();
+		int getCheckedPixels();
+
+	private:
+		// the passes, over tile rows ty0 to ty1-1
+		void detectStrip(int ty0, int ty1, int thread);
+		void filterStrip(int ty0, int ty1, int thread);
+		void backgroundStrip(int ty0, int ty1, int thread);
+		void maskStrip(int ty0, int ty1, int thread);
+
+		bool tileChanged(const unsigned short * depth, int tileX, int tileY);
+		bool stabilizeTile(const unsigned short * depth, int tileX, int tileY);
+		void copyTile(const unsigned short * depth, int tileX, int tileY);
+
+		int width;
+		int height;
+		int tileSize;
+		int tilesX;
+		int tilesY;
+		int tolerance;
+		int deadband;
+		bool bInvalid;
+		int dirtyCount;
+		bool bWindowed;
+		int activeCount;
+		int checkedPixels;
+
+		threadPool * pool;
+		// one filter per thread, as each keeps its own scratch space
+		std::vector<depthFilter> filters;
+
+		// the arguments of the update(), updateBackground() or mask()
+		// whose strips are running
+		const unsigned short * input;
+		backgroundModel * model;
+		const unsigned short * maskLimits;
+		unsigned char * maskOutput;
+		unsigned short maskCutoff;
+		int maskY0, maskY1;
+
+		// what each tile was last computed from, which is also the
+		// output of the temporal filter when that is on
+		std::vector<unsigned short> reference;
+		std::vector<unsigned short> filtered;
+		// tiles whose input changed, and tiles that need recomputing
+		std::vector<unsigned char> changed;
+		std::vector<unsigned char> dirty;
+		// tiles inside the windows, in them in the last update(), checked
+		// for changes (the windows and the filter's reach around them), and
+		// for each row of each column of tiles, cleared in the mask because
+		// they were outside
+		std::vector<unsigned char> active;
+		std::vector<unsigned char> wasActive;
+		std::vector<unsigned char> watched;
+		std::vector<unsigned char> cleared;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "timer.h"
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+//--------------------------------------------------------------
+unsigned long long timerMicros() {
+	return timerNanos() / 1000;
+}
+
+//--------------------------------------------------------------
+unsigned long long timerNanos() {
+#if defined(__APPLE__)
+	static mach_timebase_info_data_t info;
+	if (info.denom == 0)
+		mach_timebase_info(&info);
+	return mach_absolute_time() * info.numer / info.denom;
+#elif defined(_WIN32)
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (unsigned long long) (now.QuadPart * 1000000000.0 / freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+//--------------------------------------------------------------
+void timerSleepMicros(unsigned long long micros) {
+#if defined(_WIN32)
+	Sleep((DWORD) (micros / 1000));
+#else
+	usleep((useconds_t) micros);
+#endif
+}
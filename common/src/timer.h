@@ -0,0 +1,13 @@
+#ifndef _TIMER
+#define _TIMER
+
+// Microseconds since an arbitrary (but fixed) point, from a monotonic
+// clock. Only useful for measuring intervals.
+unsigned long long timerMicros();
+// Same, in nanoseconds, for timing things that take less than a microsecond
+unsigned long long timerNanos();
+
+// Sleeps the calling thread for the given number of microseconds
+void timerSleepMicros(unsigned long long micros);
+
+#endif
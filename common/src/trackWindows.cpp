@@ -0,0 +1,146 @@
+#include "trackWindows.h"
+#include "blobPyramid.h"
+
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+//--------------------------------------------------------------
+trackWindows::trackWindows() {
+	width = 0;
+	height = 0;
+	bEnabled = false;
+	margin = 24;
+	grid = 1;
+	interval = 30;
+	expected = 1;
+	bFullFrame = true;
+	frames = 0;
+	count = 0;
+}
+
+//--------------------------------------------------------------
+void trackWindows::setup(int width, int height) {
+	this->width = width;
+	this->height = height;
+	bFullFrame = true;
+	frames = 0;
+	count = 0;
+}
+
+//--------------------------------------------------------------
+void trackWindows::setEnabled(bool bEnabled) {
+	this->bEnabled = bEnabled;
+}
+
+//--------------------------------------------------------------
+bool trackWindows::isEnabled() {
+	return bEnabled;
+}
+
+//--------------------------------------------------------------
+void trackWindows::setMargin(int pixels) {
+	margin = max(pixels, 0);
+}
+
+//--------------------------------------------------------------
+void trackWindows::setGrid(int pixels) {
+	grid = max(pixels, 1);
+}
+
+//--------------------------------------------------------------
+void trackWindows::setFullFrameInterval(int frames) {
+	interval = max(frames, 0);
+}
+
+//--------------------------------------------------------------
+void trackWindows::setExpectedTracks(int count) {
+	expected = count;
+}
+
+//--------------------------------------------------------------
+bool trackWindows::update(const trackList & tracks, const blobList & blobs, float dt) {
+	count = 0;
+	bFullFrame = !bEnabled || tracks.count < expected || (interval > 0 && ++frames >= interval);
+	for (int i = 0; i < tracks.count && !bFullFrame; i++){
+		int b = tracks.blob[i];
+		if (b < 0 || b >= blobs.count) {
+			bFullFrame = true;
+			break;
+		}
+		// the blob's box where it will be next frame, with room for it to
+		// move as far again
+		float dx = tracks.vx[i] * dt, dy = tracks.vy[i] * dt;
+		int growX = margin + (int) ceilf(fabsf(dx));
+		int growY = margin + (int) ceilf(fabsf(dy));
+		int left = (int) floorf(blobs.minX[b] + dx) - growX;
+		int top = (int) floorf(blobs.minY[b] + dy) - growY;
+		int right = (int) ceilf(blobs.maxX[b] + 1 + dx) + growX;
+		int bottom = (int) ceilf(blobs.maxY[b] + 1 + dy) + growY;
+
+		x0[count] = max(left, 0) / grid * grid;
+		y0[count] = max(top, 0) / grid * grid;
+		x1[count] = min((min(right, width) + grid - 1) / grid * grid, width);
+		y1[count] = min((min(bottom, height) + grid - 1) / grid * grid, height);
+		if (x0[count] < x1[count] && y0[count] < y1[count])
+			count++;
+	}
+	if (bFullFrame) {
+		frames = 0;
+		count = 0;
+		return false;
+	}
+	// windows that overlap are joined, so no pixel is done twice
+	count = joinBoxes(x0, y0, x1, y1, count);
+	return true;
+}
+
+//--------------------------------------------------------------
+void trackWindows::apply(tileSegmenter & segmenter) {
+	if (bFullFrame)
+		segmenter.clearWindows();
+	else
+		segmenter.setWindows(x0, y0, x1, y1, count);
+}
+
+//--------------------------------------------------------------
+bool trackWindows::isFullFrame() {
+	return bFullFrame;
+}
+
+//--------------------------------------------------------------
+int trackWindows::getCount() {
+	return count;
+}
+
+//--------------------------------------------------------------
+const int * trackWindows::getX0() {
+	return x0;
+}
+
+//--------------------------------------------------------------
+const int * trackWindows::getY0() {
+	return y0;
+}
+
+//--------------------------------------------------------------
+const int * trackWindows::getX1() {
+	return x1;
+}
+
+//--------------------------------------------------------------
+const int * trackWindows::getY1() {
+	return y1;
+}
+
+//--------------------------------------------------------------
+int trackWindows::getPixels() {
+	if (bFullFrame)
+		return width * height;
+	int pixels = 0;
+	for (int i = 0; i < count; i++)
+		pixels += (x1[i] - x0[i]) * (y1[i] - y0[i]);
+	return pixels;
+}
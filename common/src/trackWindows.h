@@ -0,0 +1,77 @@
+#ifndef _TRACK_WINDOWS
+#define _TRACK_WINDOWS
+
+#include "blobTracker.h"
+#include "tileSegmenter.h"
+
+// Works out where in the next frame the tracked hands can be, so the
+// filtering, masking and labelling can be kept to windows around them
+// rather than the whole frame (see tileSegmenter::setWindows() and
+// blobPyramid::findInBoxes()).
+//
+// Each hand's window is the bounding box of the blob it was matched to,
+// moved on by its velocity for one frame and grown by a margin, plus the
+// distance it moved so a hand that speeds up stays inside. Boxes are
+// rounded out to a grid (eg. the segmenter's tiles), so the labelling
+// covers exactly what was masked.
+//
+// The whole frame is searched instead when a hand wasn't seen (it may
+// have moved out of its window), when there are fewer hands than
+// expected (a new one can come in anywhere), and every few frames anyway
+// so nothing new is missed for long.
+class trackWindows {
+
+	public:
+		trackWindows();
+
+		void setup(int width, int height);
+		// Turns the windows on or off, off searches every frame in full
+		void setEnabled(bool bEnabled);
+		bool isEnabled();
+		// Pixels added around each blob's box, on top of how far it moves
+		void setMargin(int pixels);
+		// Boxes are rounded out to multiples of this, 1 leaves them be
+		void setGrid(int pixels);
+		// Every how many frames the whole frame is searched, 0 for never
+		void setFullFrameInterval(int frames);
+		// Fewer tracks than this searches the whole frame
+		void setExpectedTracks(int count);
+
+		// Works out the windows for the next frame from the tracks and the
+		// blobs they were matched to this frame, dt seconds per frame.
+		// Returns false if the next frame should be searched in full.
+		bool update(const trackList & tracks, const blobList & blobs, float dt);
+		// Hands the windows (or the whole frame) to the segmenter
+		void apply(tileSegmenter & segmenter);
+
+		bool isFullFrame();
+		// The windows, in pixels with x1 and y1 one past the end
+		int getCount();
+		const int * getX0();
+		const int * getY0();
+		const int * getX1();
+		const int * getY1();
+		// How many pixels the windows cover, the whole frame when searching
+		// it in full
+		int getPixels();
+
+	private:
+		int width;
+		int height;
+		bool bEnabled;
+		int margin;
+		int grid;
+		int interval;
+		int expected;
+
+		bool bFullFrame;
+		// frames since the whole frame was last searched
+		int frames;
+		int count;
+		int x0[TRACK_LIST_SIZE];
+		int y0[TRACK_LIST_SIZE];
+		int x1[TRACK_LIST_SIZE];
+		int y1[TRACK_LIST_SIZE];
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _TRIPLE_BUFFER
+#define _TRIPLE_BUFFER
+
+// Lock free hand over of the newest T from one producer thread to one
+// consumer thread. The producer fills getWriteBuffer() and publish()es it,
+// the consumer calls update() to swap in the newest published buffer and
+// reads it with getReadBuffer(). Neither side ever waits for the other:
+// if the producer is faster, frames the consumer never got to are simply
+// overwritten, and if the consumer is faster it keeps the buffer it has.
+//
+// The buffers are never copied, so T can be big (whole images).
+template <class T>
+class tripleBuffer {
+
+	public:
+		tripleBuffer() {
+			back = 0;
+			middle = 1;
+			front = 2;
+		}
+
+		// Direct access to all three buffers, to allocate them up front.
+		// Only safe before the threads are started.
+		T & getBuffer(int index) {
+			return buffers[index];
+		}
+
+		// producer side
+		T & getWriteBuffer() {
+			return buffers[back];
+		}
+
+		void publish() {
+			back = exchange(middle, back | FRESH) & INDEX;
+		}
+
+		// consumer side, returns true if a newer buffer was swapped in
+		bool update() {
+			if ((middle & FRESH) == 0)
+				return false;
+			front = exchange(middle, front) & INDEX;
+			return true;
+		}
+
+		T & getReadBuffer() {
+			return buffers[front];
+		}
+
+	private:
+		enum {
+			INDEX = 3,
+			// set on the middle index when it holds a buffer the consumer hasn't seen
+			FRESH = 4
+		};
+
+		// atomic swap with a full memory barrier, so everything written to
+		// a buffer is visible before its index is
+		static int exchange(volatile int & value, int newValue) {
+			int old;
+			do {
+				old = value;
+			} while (__sync_val_compare_and_swap(&value, old, newValue) != old);
+			return old;
+		}
+
+		T buffers[3];
+		int back;
+		volatile int middle;
+		int front;
+};
+
+#endif
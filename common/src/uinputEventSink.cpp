@@ -0,0 +1,103 @@
+#include "uinputEventSink.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+// linux key codes for each inputKey
+static const int keyCodes[INPUT_KEY_COUNT] = {
+	KEY_LEFT,
+	KEY_RIGHT,
+	KEY_UP,
+	KEY_DOWN,
+	KEY_Z,
+	KEY_X,
+	KEY_SPACE,
+	KEY_ENTER
+};
+
+//--------------------------------------------------------------
+uinputEventSink::uinputEventSink() {
+	fd = -1;
+}
+
+//--------------------------------------------------------------
+uinputEventSink::~uinputEventSink() {
+	close();
+}
+
+//--------------------------------------------------------------
+bool uinputEventSink::open(const char * device) {
+	close();
+	fd = ::open(device, O_WRONLY | O_NONBLOCK);
+	if (fd < 0) {
+		fprintf(stderr, "uinputEventSink: can't open %s\n", device);
+		return false;
+	}
+
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	ioctl(fd, UI_SET_EVBIT, EV_SYN);
+	for (int k = 0; k < INPUT_KEY_COUNT; k++)
+		ioctl(fd, UI_SET_KEYBIT, keyCodes[k]);
+
+	// the old way of describing the device, which newer kernels still take
+	struct uinput_user_dev dev;
+	memset(&dev, 0, sizeof(dev));
+	snprintf(dev.name, UINPUT_MAX_NAME_SIZE, "kinect-demos");
+	dev.id.bustype = BUS_VIRTUAL;
+	dev.id.vendor = 1;
+	dev.id.product = 1;
+	dev.id.version = 1;
+	if (write(fd, &dev, sizeof(dev)) != sizeof(dev) || ioctl(fd, UI_DEV_CREATE) < 0) {
+		fprintf(stderr, "uinputEventSink: can't create the virtual keyboard\n");
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+void uinputEventSink::close() {
+	if (fd < 0)
+		return;
+	ioctl(fd, UI_DEV_DESTROY);
+	::close(fd);
+	fd = -1;
+}
+
+//--------------------------------------------------------------
+bool uinputEventSink::isOpen() {
+	return fd >= 0;
+}
+
+//--------------------------------------------------------------
+void uinputEventSink::send(const keyEvent * events, int count) {
+	if (fd < 0)
+		return;
+	// every key, then one report to say the batch is complete
+	struct input_event out[64 + 1];
+	while (count > 0) {
+		int n = count < 64 ? count : 64;
+		memset(out, 0, sizeof(out[0]) * (n + 1));
+		for (int i = 0; i < n; i++){
+			out[i].type = EV_KEY;
+			out[i].code = keyCodes[events[i].key];
+			out[i].value = events[i].down ? 1 : 0;
+		}
+		out[n].type = EV_SYN;
+		out[n].code = SYN_REPORT;
+		if (write(fd, out, sizeof(out[0]) * (n + 1)) < 0)
+			perror("uinputEventSink");
+		events += n;
+		count -= n;
+	}
+}
+
+#endif
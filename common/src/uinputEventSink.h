@@ -0,0 +1,32 @@
+#ifndef _UINPUT_EVENT_SINK
+#define _UINPUT_EVENT_SINK
+
+#include "eventSink.h"
+
+#ifdef __linux__
+
+// Sends key events through a virtual keyboard made with linux's uinput,
+// so they reach whatever has focus (X11, wayland or the console alike).
+// Needs write access to /dev/uinput. Each batch is written with a single
+// write() and a single sync report.
+class uinputEventSink : public eventSink {
+
+	public:
+		uinputEventSink();
+		~uinputEventSink();
+
+		// Creates the virtual keyboard, returns false if /dev/uinput can't
+		// be opened (events are then thrown away)
+		bool open(const char * device = "/dev/uinput");
+		void close();
+		bool isOpen();
+
+		void send(const keyEvent * events, int count);
+
+	private:
+		int fd;
+};
+
+#endif
+
+#endif
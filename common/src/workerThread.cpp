@@ -0,0 +1,88 @@
+#include "workerThread.h"
+
+#include <sys/time.h>
+
+//--------------------------------------------------------------
+workerThread::workerThread() {
+	bStarted = false;
+	bRunning = false;
+}
+
+//--------------------------------------------------------------
+workerThread::~workerThread() {
+	stopThread();
+}
+
+//--------------------------------------------------------------
+bool workerThread::startThread() {
+	if (bStarted)
+		return true;
+	bRunning = true;
+	if (pthread_create(&thread, NULL, run, this) != 0) {
+		bRunning = false;
+		return false;
+	}
+	bStarted = true;
+	return true;
+}
+
+//--------------------------------------------------------------
+void workerThread::stopThread() {
+	bRunning = false;
+	if (bStarted)
+		pthread_join(thread, NULL);
+	bStarted = false;
+}
+
+//--------------------------------------------------------------
+bool workerThread::isThreadRunning() {
+	return bRunning;
+}
+
+//--------------------------------------------------------------
+void * workerThread::run(void * arg) {
+	((workerThread *) arg)->threadedFunction();
+	return NULL;
+}
+
+//--------------------------------------------------------------
+waitableEvent::waitableEvent() {
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+	bSignalled = false;
+}
+
+//--------------------------------------------------------------
+waitableEvent::~waitableEvent() {
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+//--------------------------------------------------------------
+void waitableEvent::signal() {
+	pthread_mutex_lock(&mutex);
+	bSignalled = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+//--------------------------------------------------------------
+bool waitableEvent::wait(unsigned long long timeoutMicros) {
+	// pthread wants an absolute wall clock time
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	unsigned long long usec = now.tv_usec + timeoutMicros;
+	struct timespec until;
+	until.tv_sec = now.tv_sec + usec / 1000000;
+	until.tv_nsec = (usec % 1000000) * 1000;
+
+	pthread_mutex_lock(&mutex);
+	while (!bSignalled) {
+		if (pthread_cond_timedwait(&cond, &mutex, &until) != 0)
+			break;
+	}
+	bool signalled = bSignalled;
+	bSignalled = false;
+	pthread_mutex_unlock(&mutex);
+	return signalled;
+}
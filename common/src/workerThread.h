@@ -0,0 +1,51 @@
+#ifndef _WORKER_THREAD
+#define _WORKER_THREAD
+
+#include <pthread.h>
+
+// Minimal pthread wrapper in the spirit of ofxThread, without depending
+// on openFrameworks. Subclasses implement threadedFunction(), which should
+// loop until isThreadRunning() returns false.
+//
+// Call stopThread() before the subclass is destroyed.
+class workerThread {
+
+	public:
+		workerThread();
+		virtual ~workerThread();
+
+		bool startThread();
+		// asks the thread to finish and waits for it
+		void stopThread();
+		bool isThreadRunning();
+
+	protected:
+		virtual void threadedFunction() = 0;
+
+	private:
+		static void * run(void * arg);
+
+		pthread_t thread;
+		bool bStarted;
+		volatile bool bRunning;
+};
+
+// Lets one thread sleep until another one has something for it.
+// Signals don't queue up: several signal()s before a wait() wake it once.
+class waitableEvent {
+
+	public:
+		waitableEvent();
+		~waitableEvent();
+
+		void signal();
+		// returns true if signalled, false if the timeout ran out first
+		bool wait(unsigned long long timeoutMicros);
+
+	private:
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		bool bSignalled;
+};
+
+#endif
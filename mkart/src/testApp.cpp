@@ -1,51 +1,114 @@
 #include "testApp.h"
 #include "ofxKinect.h"
+#include "timer.h"
+#include <string.h>
+#ifdef __APPLE__
 #include <OpenGL/glu.h>
+#else
+#include <GL/glu.h>
+#endif
 
 //--------------------------------------------------------------
-void testApp::setCalibrationOffset(float x, float y) {
-	ofxMatrix4x4 matrix = kinect.getRGBDepthMatrix();
-	matrix.getPtr()[3] = x;
-	matrix.getPtr()[7] = y;
-	kinect.setRGBDepthMatrix(matrix);
-}
-
-//--------------------------------------------------------------
-void testApp::sendKeystrokeToProcess(CGKeyCode code, bool down) {
-	// This is a Mac specific way of sending global keystroke
-	// Note, th reason I am using this call and not a Core Foundation
-	// call is that most emulators do not recieve input through Core
+void testApp::sendKeystrokeToProcess(inputKey key, bool down) {
+	// This only queues the key, the dispatcher thread sends it on. On the
+	// mac that goes through the accessibility API rather than Core
+	// Foundation, as most emulators do not recieve input through Core
 	// Foundation, so they do not detect keystrokes sent that way
-	AXUIElementRef axSystemWideElement = AXUIElementCreateSystemWide();
-	AXUIElementPostKeyboardEvent(axSystemWideElement, 0, code, down);
-	CFRelease(axSystemWideElement);
+	keys.post(key, down, frameTimestamp);
+	keyLatency.add(timerMicros() - frameTimestamp);
 }
 
 //--------------------------------------------------------------
 void testApp::setup(){
-	// Setup kinect
-	kinect.init();
-	kinect.setVerbose(true);
-	kinect.open();
+	// Play back a recorded clip instead of the kinect if KINECT_CLIP
+	// is set, otherwise setup the kinect (see kinectFrameSource.h)
+	source = openFrameSource(kinect, kinectSource, clipSource);
 	
 	// Allocate space for all the images
-	colorImg.allocate(kinect.width, kinect.height);
+	subtractor.setup(source->getWidth(), source->getHeight());
+	int w = source->getWidth(), h = source->getHeight();
+	grayDiff = buffers.acquire(w*h);
+	footDiff = buffers.acquire(w*h);
+	memset(grayDiff.write(), 0, w*h);
+	memset(footDiff.write(), 0, w*h);
+	lastTimestamp = 0;
+	frameTimestamp = 0;
+	maskLatency = latencyHistogram("capture to mask", 500, 200);
+	blobLatency = latencyHistogram("capture to blobs", 500, 200);
+	keyLatency = latencyHistogram("capture to key", 500, 200);
 	
-	grayImage.allocate(kinect.width, kinect.height);
-	grayBg.allocate(kinect.width, kinect.height);
-	grayDiff.allocate(kinect.width, kinect.height);
-	footDiff.allocate(kinect.width, kinect.height );
+	// Keys go to the OS through a sink on their own thread
+#ifndef __APPLE__
+	keySink.open();
+#endif
+	keys.setup(&keySink);
+	keys.startThread();
 	
-	// Don't capture the background at startup
-	bLearnBakground = false;
+	registration.setup(source->getWidth(), source->getHeight());
+	
+	// and for the results handed over to draw(), one set per buffer
+	for (int i = 0; i < 3; i++){
+		frameResult & result = results.getBuffer(i);
+		result.color = buffers.acquire(w*h*3);
+		memset(result.color.write(), 0, w*h*3);
+		result.grayDiff = grayDiff;
+		result.footDiff = footDiff;
+		result.leftDown = result.rightDown = result.footDown = false;
+		result.blobs.count = 0;
+		result.tracks.count = 0;
+		result.keyLatencyMedian = result.keyLatencyP99 = 0;
+		result.keyCount = 0;
+		result.bytesCopied = result.bytesShared = 0;
+	}
+	depthTex.allocate(w, h, GL_LUMINANCE);
+	colorTex.allocate(w, h, GL_RGB);
+	grayDiffTex.allocate(w, h, GL_LUMINANCE);
+	footDiffTex.allocate(w, h, GL_LUMINANCE);
+	colorPixels = NULL;
+	keysDown = 0;
+	
+	// Load the gesture to key bindings, or fall back on the built in ones
+	if (!gestures.load(ofToDataPath("gestures.txt").c_str()))
+		gestures.parse(GESTURE_RULES_DEFAULT);
+	bReloadGestures = false;
+	
+	// Don't record at startup
+	bToggleRecording = false;
 	
 	// set up sensable defaults for threshold and calibration offsets
 	// Note: these are empirically set based on my kinect, they will likely need adjusting
-	threshold = 72;
+	threshold = 3000;
+	maskThreshold = threshold;
+	steerLead = 0;
+	
+	// The hands can be anywhere nearer than 2550mm, for feet we want to
+	// focus on only the bottom part of the image (the bottom 180px).
+	// Rows outside a region are never written, so they stay black. The
+	// masks are handed to the regions each frame, see findRegions().
+	regions.setup(w, h);
+	handRegion = regions.addRegion("hands", 0, 0, -1, -1, 0, 2550, 1000, (w*h)/2, 5); // TODO: This should be configurable as well
+	footRegion = regions.addRegion("foot", 0, 300, -1, -1, 0, threshold, 1000, (w*h)/2, 5);
+	
+	// The processing for each frame, as stages that wait for the ones
+	// they need, with the per pixel passes split into strips over the same
+	// threads. KINECT_THREADS=0 runs them one after the other, in this
+	// order, for debugging.
+	pool.setup(threadPool::getDefaultThreadCount());
+	graph.setup(&pool);
+	subtractor.setPool(&pool);
+	graph.addStage("color", this, &testApp::copyColor);
+	int depthStage = graph.addStage("depth", this, &testApp::filterDepth);
+	int regionStage = graph.addStage("mask + blobs", this, &testApp::findRegions, depthStage);
+	int handStage = graph.addStage("hands", this, &testApp::trackHands, regionStage);
+	int footStage = graph.addStage("foot", this, &testApp::copyFoot, regionStage);
+	graph.addStage("keys", this, &testApp::sendKeys, handStage, footStage);
+	currentFrame = NULL;
 	
-	xOff = 13.486656;
-	yOff = 34.486656;	
-	setCalibrationOffset(xOff, yOff);
+	// the registration has the cameras' calibration, the offsets are
+	// only for nudging it
+	xOff = 0;
+	yOff = 0;
+	registration.setColorOffset(xOff, yOff);
 	
 	// Set depth map so near values are higher (white)
 	kinect.enableDepthNearValueWhite(true);
@@ -53,149 +116,247 @@ void testApp::setup(){
 	// Setup window
 	ofSetFullscreen(true);
 	ofSetFrameRate(30);	
+	
+	// Start pulling in frames on their own thread, and processing
+	// them on this app's thread as soon as they arrive
+	capture.setup(source, &buffers);
+	capture.startThread();
+	startThread();
 }
 
 //--------------------------------------------------------------
 void testApp::update(){
 	
-	ofBackground(100, 100, 100);
-	kinect.update();
-	
-	// Pull in new frame
-	kinect.update();
-	grayImage.setFromPixels(kinect.getDepthPixels(), kinect.width, kinect.height);
-	colorImg.setFromPixels(kinect.getCalibratedRGBPixels(), kinect.width, kinect.height);
-	
-	// Quick and dirty noise filter on the depth map. Needs work
-	grayImage.dilate();
-	grayImage.erode();
-	
-	// If the user pressed spacebar, capture the depth iamge and save for later
-    if (bLearnBakground == true){
-        grayBg = grayImage;
-        bLearnBakground = false;
-    }
-	
-	// The next few steps mask the depthmap so that only pixels 
-	// that have changed since background was captured are considered
-	
-    // Subtract the saved background from the current one
-	grayDiff = grayImage;
-	grayDiff -= grayBg;
-	
-	// anything that is > 1 has changed, so keep it
-    grayDiff.threshold(1);
-	// multiply in the current depth values, to mask it 
-	grayDiff *= grayImage;
-	
-	// Copy the filtered depthmap so we can use it for detecting feet 
-	footDiff = grayDiff;
-	// for feet we want to focus on only the bottom part of the image
-	// so we set the region of interest to the bottom 180 px
-	footDiff.setROI(0, 300,footDiff.width, 480-300);
-	
-	// cut off anything that is too far away
-    grayDiff.threshold(104); // TODO: This should be configurable as well
-	footDiff.threshold(threshold);
-	
-	// since we set ROI, we need to reset it
-	footDiff.resetROI();
-	// also, since ROI was on when we did the above threshold
-	// we clear out all pixels that are not fully white 
-	//(which ends up being only the upper part of the iamge)
-	footDiff.threshold(254);
-	
-	// Find blobs (should be hands and foot) in the filtered depthmap
-	contourFinder.findContours(grayDiff, 1000, (kinect.width*kinect.height)/2, 5, false);
-	footContourFinder.findContours(footDiff, 1000, (kinect.width*kinect.height)/2, 5, false);
-	
-	// if at least 2 blobs were detected (presumably 2 hands), figure out
-	// their locations and calculate which way to "steer"
-	if (contourFinder.blobs.size() >= 2) {
-		// Find the x,y cord of the center of the first 2 blobs
-		float x1 = contourFinder.blobs[0].centroid.x;
-		float y1 = contourFinder.blobs[0].centroid.y;
-		float x2 = contourFinder.blobs[1].centroid.x;
-		float y2 = contourFinder.blobs[1].centroid.y;
-		
-		// the x1<x2 check is to ensure that p1 is always the leftmost blob (right hand)
-		ofPoint p1(x1<x2 ? x1 : x2,x1<x2 ? y1 : y2, 0);
-		ofPoint p2(x2<x1 ? x1 : x2,x2<x1 ? y1 : y2, 0);
-		
-		// if the "steering wheel" is sufficently rotated
-		if(abs(p1.y-p2.y) > 50){
-			if(p1.y < p2.y ){ // turning left
-				if(!leftDown){ // if left is already down, dont send key even again
-					// Send the key down event for left, and up event for right
-					sendKeystrokeToProcess((CGKeyCode) kVK_LeftArrow ,true);
-					sendKeystrokeToProcess((CGKeyCode) kVK_RightArrow ,false);
-					leftDown = true;
-					rightDown = false;
-				}
-			} else { // turning right
-				if(!rightDown){ // if left is already down, dont send key even again
-					// Send the key down event for right, and up event for left
-					sendKeystrokeToProcess((CGKeyCode) kVK_RightArrow ,true);
-					sendKeystrokeToProcess((CGKeyCode) kVK_LeftArrow ,false);
-					rightDown = true;
-					leftDown = false;
-				}
-			}
-		} else { // "steering weheel" centered
-			if(leftDown){
-				sendKeystrokeToProcess((CGKeyCode) kVK_LeftArrow ,false);
-				leftDown = false;
-			}
-			if(rightDown){
-				sendKeystrokeToProcess((CGKeyCode) kVK_RightArrow ,false);
-				rightDown = false;
-			}
-		}
-	} else { // no hands detected
-		if(leftDown){
-			sendKeystrokeToProcess((CGKeyCode) kVK_LeftArrow ,false);
-			leftDown = false;
-		}
-		if(rightDown){
-			sendKeystrokeToProcess((CGKeyCode) kVK_RightArrow ,false);
-			rightDown = false;
-		}
+	// Show the newest processed frame, if there is one. Its images are
+	// the processing thread's own, held until the next one comes in.
+	if (results.update()) {
+		frameResult & result = results.getReadBuffer();
+		depthTex.loadData((unsigned char *) result.depth.read(), source->getWidth(), source->getHeight(), GL_LUMINANCE);
+		colorTex.loadData((unsigned char *) result.color.read(), source->getWidth(), source->getHeight(), GL_RGB);
+		grayDiffTex.loadData((unsigned char *) result.grayDiff.read(), source->getWidth(), source->getHeight(), GL_LUMINANCE);
+		footDiffTex.loadData((unsigned char *) result.footDiff.read(), source->getWidth(), source->getHeight(), GL_LUMINANCE);
 	}
-
-	// if any blob is detected in the foot map, it can be considered a foot
-	if(footContourFinder.blobs.size() >= 1) {
-		ofBackground(0,255,0); // set background to green for debugging
-		if(!footDown) {
-			sendKeystrokeToProcess((CGKeyCode) 6 ,true);
-			footDown = true;
-		}
-	} else {
+	
+	// set background to green for debugging when the foot is down
+	if (results.getReadBuffer().footDown)
+		ofBackground(0,255,0);
+	else
 		ofBackground(100,100,100);
-		if(footDown) {
-			sendKeystrokeToProcess((CGKeyCode) 6 ,false);
-			footDown = false;
-		}
+}
+
+//--------------------------------------------------------------
+void testApp::exit(){
+	// stop processing before the frames it is reading go away
+	stopThread();
+	capture.stopThread();
+	keys.stopThread();
+	pool.stop();
+	recorder.close();
+	
+	// how long it took to get from a movement to a key
+	printf("%s%s%s%s", maskLatency.toString().c_str(), blobLatency.toString().c_str(), keyLatency.toString().c_str(),
+		   keys.getLatency().toString().c_str());
+	// and how long each stage took
+	std::vector<latencyHistogram> & stages = graph.getTimings();
+	for (size_t i = 0; i < stages.size(); i++)
+		printf("%-14s median %.0fus p99 %.0fus\n", stages[i].getName().c_str(), stages[i].getPercentile(50), stages[i].getPercentile(99));
+}
+
+//--------------------------------------------------------------
+void testApp::threadedFunction(){
+	// Process every frame as soon as the capture thread hands it
+	// over, the results are picked up by update() on the main thread
+	while (isThreadRunning()) {
+		if (capture.waitForFrame(100000))
+			processFrame(capture.getFrame());
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::recordFrame(capturedFrame & frame){
+	// Start/stop recording if 'r' was pressed, and save the frame if we are recording
+	if (bToggleRecording) {
+		if (recorder.isOpen())
+			recorder.close();
+		else
+			recorder.open(ofToDataPath("clip.kdc").c_str(), frame.width, frame.height, frame.rgbRegistered);
+		bToggleRecording = false;
+	}
+	if (recorder.isOpen())
+		recorder.addFrame(frame.getRawDepth(), frame.getDepth(), frame.getRGB(), frame.timestamp);
+}
+
+//--------------------------------------------------------------
+void testApp::processFrame(capturedFrame & frame){
+	currentFrame = &frame;
+	frameTimestamp = frame.timestamp;
+	copiedBefore = buffers.getBytesCopied();
+	sharedBefore = buffers.getBytesShared();
+	
+	// the depth preview is drawn from the captured frame, shared
+	results.getWriteBuffer().depth = frame.depth;
+	
+	// Run the stages, the color image, the hands and the foot at the
+	// same time on the pool's threads when there are any (see stageGraph.h)
+	graph.run();
+	
+	// hand the finished frame over to the main thread, with what it took
+	// to move its images around
+	frameResult & result = results.getWriteBuffer();
+	result.bytesCopied = (int) (buffers.getBytesCopied() - copiedBefore);
+	result.bytesShared = (int) (buffers.getBytesShared() - sharedBefore);
+	results.publish();
+}
+
+//--------------------------------------------------------------
+void testApp::copyColor(){
+	// Pull in new frame, lined up with the depth map in strips of rows
+	// on the pool's threads. The table it goes through is only rebuilt
+	// when the offsets change. A frame that is already lined up is
+	// handed on as it is.
+	registration.update();
+	frameResult & result = results.getWriteBuffer();
+	if (currentFrame->rgbRegistered)
+		result.color = currentFrame->rgb;
+	else {
+		colorPixels = result.color.overwrite();
+		pool.forStrips(currentFrame->height, currentFrame->width*3, this, &testApp::registerStrip);
 	}
+	recordFrame(*currentFrame);
+}
+
+//--------------------------------------------------------------
+void testApp::registerStrip(int y0, int y1, int thread){
+	registration.apply(currentFrame->getRawDepth(), currentFrame->getRGB(), colorPixels, y0, y1);
+}
+
+//--------------------------------------------------------------
+void testApp::filterDepth(){
+	// Everything has to be masked again if the threshold changes
+	int cutoff = threshold;
+	if (cutoff != maskThreshold) {
+		subtractor.invalidate();
+		regions.setThresholds(footRegion, 0, cutoff);
+		maskThreshold = cutoff;
+	}
+	
+	// Noise filter on the depth map, then either capture it as the
+	// background if the user pressed spacebar, or keep the background
+	// following the scene. Only the tiles that changed since the last
+	// frame are redone, see backgroundSubtractor.h
+	subtractor.update(currentFrame->getRawDepth());
+	maskLatency.add(timerMicros() - frameTimestamp);
+}
+
+//--------------------------------------------------------------
+void testApp::findRegions(){
+	// Mask the depthmap so that only pixels that are well in front of the
+	// background, and are closer than each region's threshold, are kept,
+	// and find the blobs (should be hands and foot) as it goes.
+	// If no tile changed the masks and the blobs are the same as last frame.
+	// The hands cover the whole frame, so their mask is written from
+	// scratch, but the foot's is copied first if draw() still holds it so
+	// the rows above it stay black.
+	if (subtractor.getDirtyCount() > 0) {
+		regions.setMaskOutput(handRegion, grayDiff.overwrite());
+		regions.setMaskOutput(footRegion, footDiff.write());
+		regions.find(subtractor.getFiltered(), subtractor.getLimits());
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::trackHands(){
+	frameResult & result = results.getWriteBuffer();
+	blobList & blobs = regions.getBlobs(handRegion);
+	
+	// Follow the hands on from the last frame, so the same two are used
+	// whichever order the blobs come in, and a hand that drops out for a
+	// frame or two carries on where it was heading
+	float dt = lastTimestamp != 0 && frameTimestamp > lastTimestamp ? (frameTimestamp - lastTimestamp) / 1000000.0f : 1 / 30.0f;
+	lastTimestamp = frameTimestamp;
+	tracker.update(blobs, dt);
+	blobLatency.add(timerMicros() - frameTimestamp);
+	
+	result.grayDiff = grayDiff;
+	result.blobs = blobs;
+	result.tracks = tracker.getTracks();
+}
+
+//--------------------------------------------------------------
+void testApp::copyFoot(){
+	results.getWriteBuffer().footDiff = footDiff;
+}
+
+//--------------------------------------------------------------
+void testApp::sendKeys(){
+	frameResult & result = results.getWriteBuffer();
+	
+	// Reload the gesture rules if 'g' was pressed
+	if (bReloadGestures) {
+		gestures.load(ofToDataPath("gestures.txt").c_str());
+		bReloadGestures = false;
+	}
+	
+	// Work out how the hands (the two tracks that have been there longest)
+	// and the foot are placed, steerLead ms from when the frame was
+	// captured, and run the rules (see gestureRules.h) to find out which
+	// keys should be down. Only the keys that changed are sent.
+	float features[GESTURE_FEATURE_COUNT];
+	gestureFeatures(tracker, regions.getBlobs(footRegion).count, steerLead / 1000.0f, features);
+	unsigned int down = gestures.evaluate(features, frameTimestamp);
+	unsigned int changed = down ^ keysDown;
+	for (int k = 0; k < INPUT_KEY_COUNT; k++){
+		if (changed & (1 << k))
+			sendKeystrokeToProcess((inputKey) k, (down & (1 << k)) != 0);
+	}
+	keysDown = down;
+	
+	result.leftDown = (keysDown & (1 << INPUT_KEY_LEFT)) != 0;
+	result.rightDown = (keysDown & (1 << INPUT_KEY_RIGHT)) != 0;
+	result.footDown = (keysDown & (1 << INPUT_KEY_Z)) != 0;
+	result.keyLatencyMedian = keyLatency.getPercentile(50) / 1000;
+	result.keyLatencyP99 = keyLatency.getPercentile(99) / 1000;
+	result.keyCount = keyLatency.getCount();
 }
 
 //--------------------------------------------------------------
 void testApp::draw(){
+	// the newest frame the processing thread has finished
+	frameResult & result = results.getReadBuffer();
+	
 	ofSetHexColor(0xffffff);
 	
 	// Draw some debug images along the top
-	kinect.drawDepth(10, 10, 315, 236);
-	grayDiff.draw(335, 10, 315, 236);
-	footDiff.draw(660, 10, 315, 236);
+	depthTex.draw(10, 10, 315, 236);
+	grayDiffTex.draw(335, 10, 315, 236);
+	footDiffTex.draw(660, 10, 315, 236);
 	
 	
 	// Draw a larger image of the calibrated RGB camera
 	// and overlay the found blobs on top of it
-	colorImg.draw(10,256);
-	contourFinder.draw(10,256);
+	colorTex.draw(10,256);
+	ofNoFill();
+	for (int i = 0; i < result.blobs.count; i++){
+		ofSetHexColor(0xff0099);
+		ofRect(10 + result.blobs.minX[i], 256 + result.blobs.minY[i],
+			   result.blobs.maxX[i] - result.blobs.minX[i] + 1, result.blobs.maxY[i] - result.blobs.minY[i] + 1);
+		ofSetHexColor(0x00ffff);
+		ofCircle(10 + result.blobs.centroidX[i], 256 + result.blobs.centroidY[i], 4);
+	}
+	ofFill();
+	ofSetHexColor(0xffffff);
+	// and the tracked hands with their ids
+	for (int i = 0; i < result.tracks.count; i++){
+		char idStr[16];
+		sprintf(idStr, "%i", result.tracks.id[i]);
+		ofDrawBitmapString(idStr, 14 + result.tracks.x[i], 252 + result.tracks.y[i]);
+	}
 		
 	// Display some debugging info
 	char reportStr[1024];
-	sprintf(reportStr, "left: %i right: %i foot: %i", leftDown, rightDown, footDown);
+	sprintf(reportStr, "left: %i right: %i foot: %i\nsteer ahead: %ims (press: [/])\ncapture to key: p50 %.1fms p99 %.1fms (%i keys)\nimages: %i bytes copied, %i shared",
+			result.leftDown, result.rightDown, result.footDown, steerLead, result.keyLatencyMedian, result.keyLatencyP99, result.keyCount,
+			result.bytesCopied, result.bytesShared);
 	ofDrawBitmapString(reportStr, 20, 800);
 	
 }
@@ -206,29 +367,44 @@ void testApp::keyPressed(int key){
 	switch (key)
 	{
 		case ' ':
-			bLearnBakground = true;
+			subtractor.learnBackground();
 			break;
 		case '+':
-			threshold++;
+			threshold += 10;
 			break;
 		case '-':
-			threshold--;
+			threshold -= 10;
+			break;
+		case '[':
+			if (steerLead >= 10)
+				steerLead -= 10;
+			break;
+		case ']':
+			steerLead += 10;
+			break;
+		case 'g':
+			// reload gestures.txt after editing it
+			bReloadGestures = true;
+			break;
+		case 'r':
+			// start/stop recording a clip that can be played back with KINECT_CLIP
+			bToggleRecording = true;
 			break;
 		case OF_KEY_UP:
 			yOff++;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_DOWN:
 			yOff--;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_LEFT:
 			xOff--;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_RIGHT:
 			xOff++;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		// Note these are currently not enabled in ofxKinect as of 11/23/2010
 		case 'h':
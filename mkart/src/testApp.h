@@ -7,12 +7,63 @@
 #include "ofxOpenCv.h"
 #include "ofxKinect.h"
 
-class testApp : public ofBaseApp{
+#include "frameSource.h"
+#include "kinectFrameSource.h"
+#include "fileFrameSource.h"
+#include "clipWriter.h"
+#include "captureThread.h"
+#include "frameBufferPool.h"
+#include "tripleBuffer.h"
+#include "workerThread.h"
+#include "backgroundSubtractor.h"
+#include "blobLabeller.h"
+#include "regionSegmenter.h"
+#include "blobTracker.h"
+#include "latencyHistogram.h"
+#include "eventSink.h"
+#include "macEventSink.h"
+#include "uinputEventSink.h"
+#include "gestureRules.h"
+#include "threadPool.h"
+#include "stageGraph.h"
+#include "depthRegistration.h"
+
+// Everything the processing thread hands over to draw() for one frame.
+// The images are shared with the processing rather than copied, see
+// frameBufferPool.h.
+struct frameResult {
+	// the 8 bit depth map as it was captured, for the preview
+	frameBuffer depth;
+	// the RGB frame
+	frameBuffer color;
+	// the processed depth image
+	frameBuffer grayDiff;
+	// the processed depth image for the feet
+	frameBuffer footDiff;
+	// blobs (hands) found in grayDiff
+	blobList blobs;
+	// the hands followed from frame to frame
+	trackList tracks;
+	// which keys were down after this frame
+	bool leftDown;
+	bool rightDown;
+	bool footDown;
+	// capture to key latency so far, in milliseconds
+	float keyLatencyMedian;
+	float keyLatencyP99;
+	int keyCount;
+	// bytes of images copied, and shared instead, for this frame
+	int bytesCopied;
+	int bytesShared;
+};
+
+class testApp : public ofBaseApp, public workerThread {
 
 	public:
 		void setup();
 		void update();
 		void draw();
+		void exit();
 
 		void keyPressed  (int key);
 		void keyReleased(int key);
@@ -22,51 +73,139 @@ class testApp : public ofBaseApp{
 		void mouseReleased(int x, int y, int button);
 		void windowResized(int w, int h);
 
+	protected:
+		// Processes frames as they come in, runs on its own thread
+		void threadedFunction();
+
 	private:
 		// Instance of the kinect object
 		ofxKinect kinect;
 		
+		// Where every image's pixels come from, reused from frame to frame.
+		// Declared first, as it has to outlive everything holding them.
+		frameBufferPool buffers;
+		
+		// Where frames come from, either the kinect or a recorded clip
+		frameSource * source;
+		kinectFrameSource kinectSource;
+		fileFrameSource clipSource;
+		
+		// Pulls frames from the source on its own thread
+		captureThread capture;
+		
+		// Used to record clips of the incoming frames
+		clipWriter recorder;
+		// Set when 'r' is pressed, the processing thread starts/stops recording
+		volatile bool bToggleRecording;
+		
 		// Current camera tilt angle
 		int camTilt;
 		
-		// The calibration offsets to align depth and RGB cameras
+		// Lines the RGB image up with the depth map, see depthRegistration.h
+		depthRegistration registration;
+		// and the nudges to it tuned with the arrow keys, in pixels
 		float xOff;
 		float yOff;
 		
-		// Quick utility function to apply the offsets to the camera matrix
-		void setCalibrationOffset(float x, float y);
 		
-		// Sends a keystroke to the foreground application (Mac specific)
-		void sendKeystrokeToProcess(CGKeyCode code, bool down);
+		// Queues a keystroke for the foreground application (see
+		// eventSink.h), and counts how long after the frame was captured
+		// it was queued
+		void sendKeystrokeToProcess(inputKey key, bool down);
+		
+		// Sends the keystrokes on their own thread, so a slow sink never
+		// holds up the processing
+#ifdef __APPLE__
+		macEventSink keySink;
+#else
+		uinputEventSink keySink;
+#endif
+		eventDispatcher keys;
 			
-		// Used for storing each RGB frame
-		ofxCvColorImage	colorImg;
-		
-		// Used to store each depth frame
-		ofxCvGrayscaleImage grayImage;
-		// Used to store captured depth bg
-		ofxCvGrayscaleImage grayBg;
-		// Used to store the processed depth image
-		ofxCvGrayscaleImage grayDiff;
-		// Used to store the processed depth image for the feet
-		ofxCvGrayscaleImage footDiff;
-		
-		// Used to find blobs in the filtered depthmap
-		ofxCvContourFinder 	contourFinder;
-		
-		// Used to find blobs in the filtered foot depthmap
-		ofxCvContourFinder 	footContourFinder;
+		// Runs the image processing on one frame, and publishes the result
+		void processFrame(capturedFrame & frame);
+		// The stages processFrame() runs, see setup() for what waits for what
+		void copyColor();
+		// and the strips of rows copyColor() splits into
+		void registerStrip(int y0, int y1, int thread);
+		void filterDepth();
+		void findRegions();
+		void trackHands();
+		void copyFoot();
+		void sendKeys();
+		// Runs the stages, with the ones that don't depend on each other
+		// on the pool's threads at the same time
+		threadPool pool;
+		stageGraph graph;
+		// the frame the stages are working on
+		capturedFrame * currentFrame;
+		// Saves the frame if we are recording
+		void recordFrame(capturedFrame & frame);
+		
+		// Processed frames, handed from the processing thread to draw()
+		tripleBuffer<frameResult> results;
+		// and their images, loaded into textures when a new one comes in
+		ofTexture depthTex;
+		ofTexture colorTex;
+		ofTexture grayDiffTex;
+		ofTexture footDiffTex;
+		// the color image the stages are filling in
+		unsigned char * colorPixels;
+		// the pool's counts when the frame started
+		unsigned long long copiedBefore;
+		unsigned long long sharedBefore;
+		
+		// Filters the depth frames, keeps the background model (learned
+		// when space is pressed) and masks them, only redoing the parts
+		// of the frame that changed
+		backgroundSubtractor subtractor;
+		// Masks the hands over the whole frame and the foot over the bottom
+		// rows, and finds the blobs in both, in one pass over the frame
+		regionSegmenter regions;
+		int handRegion;
+		int footRegion;
+		// The masked depth maps for the hands and the feet, kept between
+		// frames since they are only redone when a tile changed. draw()
+		// shares them, so they are only copied when a tile changes while
+		// draw() still holds them.
+		frameBuffer grayDiff;
+		frameBuffer footDiff;
+		// the foot threshold footDiff was last masked with
+		int maskThreshold;
+		
+		// Follows the hand blobs between frames so the hands keep their
+		// ids, and smooths them (see blobTracker.h)
+		blobTracker tracker;
+		// when the last frame was captured, to work out the time between frames
+		unsigned long long lastTimestamp;
+		
+		// How long after the frame being processed was captured it got
+		// masked, had its blobs found, and queued a key. Printed on exit,
+		// with the dispatcher's capture to sink times.
+		latencyHistogram maskLatency;
+		latencyHistogram blobLatency;
+		latencyHistogram keyLatency;
+		// capture time of the frame being processed
+		unsigned long long frameTimestamp;
+		
+		// How far ahead to steer, in milliseconds. The hands are run
+		// forward this far (see blobTracker::predict()) before the steering
+		// angle is worked out, so keys go down as the wheel is about to
+		// turn rather than a frame after. 0 turns it off.
+		volatile int steerLead;
 			
-		// Flag to capture the background in the next update()
-		bool bLearnBakground;
-		// distance at which depth map is "cut off"
-		int	threshold;	
+		// distance at which the foot depth map is "cut off", in millimeters
+		volatile int threshold;	
+		
+		// Turns the hands and foot into keys, loaded from
+		// bin/data/gestures.txt
+		gestureRules gestures;
+		// Set when 'g' is pressed, the processing thread reloads the rules
+		volatile bool bReloadGestures;
 		
-		// state variables for the keypresses, so we dont
+		// the keys that are down (bit n for inputKey n), so we dont
 		// send multiple key up or key down events
-		bool footDown;
-		bool leftDown;
-		bool rightDown;
+		unsigned int keysDown;
 	
 };
 
@@ -1,40 +1,93 @@
 #include "testApp.h"
 #include "ofxKinect.h"
+#include <string.h>
+#ifdef __APPLE__
 #include <OpenGL/glu.h>
+#else
+#include <GL/glu.h>
+#endif
 
-
-//--------------------------------------------------------------
-void testApp::setCalibrationOffset(float x, float y) {
-	ofxMatrix4x4 matrix = kinect.getRGBDepthMatrix();
-	matrix.getPtr()[3] = x;
-	matrix.getPtr()[7] = y;
-	kinect.setRGBDepthMatrix(matrix);
-}
+// Teapot size for each meter between the hands, about the size it was
+// when it went by pixels, for someone a couple of meters away
+#define POT_SIZE_PER_METER 300
 
 //--------------------------------------------------------------
 void testApp::setup(){
-	// Setup kinect
-	kinect.init();
-	kinect.setVerbose(true);
-	kinect.open();
+	// Play back a recorded clip instead of the kinect if KINECT_CLIP
+	// is set, otherwise setup the kinect (see kinectFrameSource.h)
+	source = openFrameSource(kinect, kinectSource, clipSource);
 	
 	// Allocate space for all the images
-	colorImg.allocate(kinect.width, kinect.height);
+	subtractor.setup(source->getWidth(), source->getHeight());
+	labeller.setup(source->getWidth(), source->getHeight());
+	// hands are over 1000 pixels, so they can be found at half the size
+	// (320x240) and then measured at full size. Halving again is quicker
+	// still on a clean mask, but joins up speckles into big blobs.
+	labeller.setLevels(1);
+	cloud.setup(source->getWidth(), source->getHeight());
+	int w = source->getWidth(), h = source->getHeight();
+	grayDiff = buffers.acquire(w*h);
+	memset(grayDiff.write(), 0, w*h);
+	blobs.count = 0;
+	lastTimestamp = 0;
 	
-	grayImage.allocate(kinect.width, kinect.height);
-	grayBg.allocate(kinect.width, kinect.height);
-	grayDiff.allocate(kinect.width, kinect.height);
+	// windows around the two hands on the segmenter's tiles, searching
+	// the whole frame every second in case something new came in
+	windows.setup(source->getWidth(), source->getHeight());
+	windows.setExpectedTracks(2);
+	windows.setGrid(32);
+	windows.setFullFrameInterval(30);
+	bWindows = true;
 	
-	// Don't capture the background at startup
-	bLearnBakground = false;
+	registration.setup(source->getWidth(), source->getHeight());
+	
+	// and for the results handed over to draw(), one set per buffer
+	for (int i = 0; i < 3; i++){
+		frameResult & result = results.getBuffer(i);
+		result.color = buffers.acquire(w*h*3);
+		memset(result.color.write(), 0, w*h*3);
+		result.grayDiff = grayDiff;
+		result.potZangle = result.potYangle = result.potSize = 0;
+		result.blobs.count = 0;
+		result.tracks.count = 0;
+		result.windowCount = 0;
+		result.checkedPixels = result.labelledPixels = 0;
+		result.bytesCopied = result.bytesShared = 0;
+	}
+	depthTex.allocate(w, h, GL_LUMINANCE);
+	colorTex.allocate(w, h, GL_RGB);
+	grayDiffTex.allocate(w, h, GL_LUMINANCE);
+	colorPixels = NULL;
+	potZangle = potYangle = potSize = 0;
+	
+	// The processing for each frame, as stages that wait for the ones
+	// they need, with the per pixel passes split into strips over the same
+	// threads. KINECT_THREADS=0 runs them one after the other, in this
+	// order, for debugging.
+	pool.setup(threadPool::getDefaultThreadCount());
+	graph.setup(&pool);
+	subtractor.setPool(&pool);
+	graph.addStage("color", this, &testApp::copyColor);
+	int depthStage = graph.addStage("depth", this, &testApp::filterDepth);
+	int blobStage = graph.addStage("mask + blobs", this, &testApp::findBlobs, depthStage);
+	graph.addStage("mask copy", this, &testApp::copyMask, blobStage);
+	int pointStage = graph.addStage("points", this, &testApp::findPoints, blobStage);
+	graph.addStage("hands", this, &testApp::trackHands, pointStage);
+	currentFrame = NULL;
+	
+	// Don't record at startup
+	bToggleRecording = false;
 	
 	// set up sensable defaults for threshold and calibration offsets
 	// Note: these are empirically set based on my kinect, they will likely need adjusting
-	threshold = 104;
+	threshold = 2550;
+	maskThreshold = threshold;
 	
-	xOff = 13.486656;
-	yOff = 34.486656;	
-	setCalibrationOffset(xOff, yOff);
+	// the registration has the cameras' calibration, the offsets are
+	// only for nudging it
+	xOff = 0;
+	yOff = 0;
+	registration.setColorOffset(xOff, yOff);
 	
 	// Set depth map so near values are higher (white)
 	kinect.enableDepthNearValueWhite(true);
@@ -42,6 +95,12 @@ void testApp::setup(){
 	// Setup window
 	ofSetFullscreen(true);
 	ofSetFrameRate(30);	
+	
+	// Start pulling in frames on their own thread, and processing
+	// them on this app's thread as soon as they arrive
+	capture.setup(source, &buffers);
+	capture.startThread();
+	startThread();
 }
 
 //--------------------------------------------------------------
@@ -49,87 +108,259 @@ void testApp::update(){
 	
 	ofBackground(100, 100, 100);
 	
-	// Pull in new frame
-	kinect.update();
-	grayImage.setFromPixels(kinect.getDepthPixels(), kinect.width, kinect.height);
-	colorImg.setFromPixels(kinect.getCalibratedRGBPixels(), kinect.width, kinect.height);
-	
-	// Quick and dirty noise filter on the depth map. Needs work
-	grayImage.dilate();
-	grayImage.erode();
-	
-	// If the user pressed spacebar, capture the depth iamge and save for later
-    if (bLearnBakground == true){
-        grayBg = grayImage;
-        bLearnBakground = false;
-    }
-	
-	// The next few steps mask the depthmap so that only pixels 
-	// that have changed since background was captured are considered
-	
-    // Subtract the saved background from the current one
-	grayDiff = grayImage;
-	grayDiff -= grayBg;
-	
-	// anything that is > 1 has changed, so keep it
-    grayDiff.threshold(1);
-	// multiply in the current depth values, to mask it 
-	grayDiff *= grayImage;
-	
-    // cut off anything that is too far away
-	grayDiff.threshold(threshold);
-	
-	// Find blobs (should be hands) in the filtered depthmap
-    contourFinder.findContours(grayDiff, 1000, (kinect.width*kinect.height)/2, 5, false);
-	
-	// if at least 2 blobs were detected (presumably 2 hands), figure out
-	// their locations and calculate the new size and rotation of the teapot
-	if (contourFinder.blobs.size() >= 2) {
-		// Find the x,y, and z of the center of the first 2 blobs
-		float x1 = contourFinder.blobs[0].centroid.x;
-		float y1 = contourFinder.blobs[0].centroid.y;
-		float x2 = contourFinder.blobs[1].centroid.x;
-		float y2 = contourFinder.blobs[1].centroid.y;
-		float z1 = kinect.getDistanceAt(x1,y1);
-		float z2 = kinect.getDistanceAt(x2,y2);
-		
-		// zp# are used to rotate about the z axis
-		// the x1<x2 check is to ensure that p1 is always the leftmost blob (right hand)
-		ofPoint zp1(x1<x2 ? x1 : x2,x1<x2 ? y1 : y2, 0);
-		ofPoint zp2(x2<x1 ? x1 : x2,x2<x1 ? y1 : y2, 0);
-		ofxVec3f zVec = zp1-zp2; // Vector connecting both hands excluding z direction
-		
-		// yp# about the y
-		ofPoint yp1(x1<x2 ? x1 : x2, 0, x1<x2 ? z1 : z2);
-		ofPoint yp2(x2<x1 ? x1 : x2, 0, x1>x2 ? z1 : z2);
-		ofxVec3f yVec = yp1-yp2; // Vector connecting both hands excluding y direction
+	// Show the newest processed frame, if there is one. Its images are
+	// the processing thread's own, held until the next one comes in.
+	if (results.update()) {
+		frameResult & result = results.getReadBuffer();
+		depthTex.loadData((unsigned char *) result.depth.read(), source->getWidth(), source->getHeight(), GL_LUMINANCE);
+		colorTex.loadData((unsigned char *) result.color.read(), source->getWidth(), source->getHeight(), GL_RGB);
+		grayDiffTex.loadData((unsigned char *) result.grayDiff.read(), source->getWidth(), source->getHeight(), GL_LUMINANCE);
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::exit(){
+	// stop processing before the frames it is reading go away
+	stopThread();
+	capture.stopThread();
+	pool.stop();
+	recorder.close();
+}
+
+//--------------------------------------------------------------
+void testApp::threadedFunction(){
+	// Process every frame as soon as the capture thread hands it
+	// over, the results are picked up by update() on the main thread
+	while (isThreadRunning()) {
+		if (capture.waitForFrame(100000))
+			processFrame(capture.getFrame());
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::recordFrame(capturedFrame & frame){
+	// Start/stop recording if 'r' was pressed, and save the frame if we are recording
+	if (bToggleRecording) {
+		if (recorder.isOpen())
+			recorder.close();
+		else
+			recorder.open(ofToDataPath("clip.kdc").c_str(), frame.width, frame.height, frame.rgbRegistered);
+		bToggleRecording = false;
+	}
+	if (recorder.isOpen())
+		recorder.addFrame(frame.getRawDepth(), frame.getDepth(), frame.getRGB(), frame.timestamp);
+}
+
+//--------------------------------------------------------------
+void testApp::processFrame(capturedFrame & frame){
+	currentFrame = &frame;
+	copiedBefore = buffers.getBytesCopied();
+	sharedBefore = buffers.getBytesShared();
+	
+	// the depth preview is drawn from the captured frame, shared
+	results.getWriteBuffer().depth = frame.depth;
+	
+	// Run the stages, the color image at the same time as the depth, on
+	// the pool's threads when there are any (see stageGraph.h)
+	graph.run();
+	
+	// hand the finished frame over to the main thread, with what it took
+	// to move its images around
+	frameResult & result = results.getWriteBuffer();
+	result.bytesCopied = (int) (buffers.getBytesCopied() - copiedBefore);
+	result.bytesShared = (int) (buffers.getBytesShared() - sharedBefore);
+	results.publish();
+}
+
+//--------------------------------------------------------------
+void testApp::copyColor(){
+	// Pull in new frame, lined up with the depth map in strips of rows
+	// on the pool's threads. The table it goes through is only rebuilt
+	// when the offsets change. A frame that is already lined up is
+	// handed on as it is.
+	registration.update();
+	frameResult & result = results.getWriteBuffer();
+	if (currentFrame->rgbRegistered)
+		result.color = currentFrame->rgb;
+	else {
+		colorPixels = result.color.overwrite();
+		pool.forStrips(currentFrame->height, currentFrame->width*3, this, &testApp::registerStrip);
+	}
+	recordFrame(*currentFrame);
+}
+
+//--------------------------------------------------------------
+void testApp::registerStrip(int y0, int y1, int thread){
+	registration.apply(currentFrame->getRawDepth(), currentFrame->getRGB(), colorPixels, y0, y1);
+}
+
+//--------------------------------------------------------------
+void testApp::filterDepth(){
+	// Everything has to be masked again if the threshold changes
+	int cutoff = threshold;
+	if (cutoff != maskThreshold) {
+		subtractor.invalidate();
+		maskThreshold = cutoff;
+	}
+	
+	// Noise filter on the depth map, then either capture it as the
+	// background if the user pressed spacebar, or keep the background
+	// following the scene. Only the tiles that changed since the last
+	// frame are redone, see backgroundSubtractor.h
+	subtractor.update(currentFrame->getRawDepth());
+}
+
+//--------------------------------------------------------------
+void testApp::findBlobs(){
+	// Mask the depthmap so that only pixels that are well in front of the
+	// background, and are closer than the threshold, are kept,
+	// then find blobs (should be hands) in it. If no tile changed the
+	// mask and the blobs are the same as last frame. While there are
+	// windows around the hands only they were masked, so only they are
+	// labelled.
+	frameResult & result = results.getWriteBuffer();
+	result.labelledPixels = 0;
+	if (subtractor.getDirtyCount() > 0) {
+		unsigned char * maskPixels = grayDiff.write();
+		subtractor.mask(maskPixels, maskThreshold);
+		if (windows.isFullFrame())
+			labeller.find(maskPixels, blobs, 1000, (currentFrame->width*currentFrame->height)/2, 5, subtractor.getFiltered());
+		else
+			labeller.findInBoxes(maskPixels, blobs, 1000, (currentFrame->width*currentFrame->height)/2, 5, subtractor.getFiltered(),
+								 windows.getX0(), windows.getY0(), windows.getX1(), windows.getY1(), windows.getCount());
+		result.labelledPixels = labeller.getRefinedPixels();
+	}
+	result.checkedPixels = subtractor.getSegmenter().getCheckedPixels();
+}
+
+//--------------------------------------------------------------
+void testApp::copyMask(){
+	// shared, not copied, see grayDiff
+	results.getWriteBuffer().grayDiff = grayDiff;
+}
+
+//--------------------------------------------------------------
+void testApp::findPoints(){
+	// The blobs' pixels as points in meters, so the hands are measured
+	// in 3D from all of their pixels. Like the blobs, only redone when
+	// a tile changed.
+	if (subtractor.getDirtyCount() > 0)
+		cloud.update(subtractor.getFiltered(), grayDiff.read(), blobs);
+}
+
+//--------------------------------------------------------------
+void testApp::handPosition(int track, float & x, float & y, float & z){
+	// the mean of the hand's points if its blob was seen this frame,
+	// otherwise where the tracker thinks it is
+	trackList & tracks = tracker.getTracks();
+	if (!cloud.getCentroid(tracks.blob[track], x, y, z))
+		cloud.unproject(tracks.x[track], tracks.y[track], tracks.depth[track], x, y, z);
+}
+
+//--------------------------------------------------------------
+void testApp::trackHands(){
+	frameResult & result = results.getWriteBuffer();
+	
+	// Follow the blobs on from the last frame, so the same hands are used
+	// whichever order the blobs come in, and a hand that drops out for a
+	// frame or two carries on where it was heading
+	float dt = lastTimestamp != 0 && currentFrame->timestamp > lastTimestamp ? (currentFrame->timestamp - lastTimestamp) / 1000000.0f : 1 / 30.0f;
+	lastTimestamp = currentFrame->timestamp;
+	tracker.update(blobs, dt);
+	trackList & tracks = tracker.getTracks();
+	
+	result.blobs = blobs;
+	result.tracks = tracks;
+	
+	// Work out where the hands can be next frame, and only look there
+	// while both are in sight. The segmenter picks the windows up on the
+	// next update(), and findBlobs() labels the same ones.
+	windows.setEnabled(bWindows);
+	windows.update(tracks, blobs, dt);
+	windows.apply(subtractor.getSegmenter());
+	result.windowCount = windows.getCount();
+	for (int i = 0; i < windows.getCount(); i++){
+		result.windowX0[i] = windows.getX0()[i];
+		result.windowY0[i] = windows.getY0()[i];
+		result.windowX1[i] = windows.getX1()[i];
+		result.windowY1[i] = windows.getY1()[i];
+	}
+	
+	// if at least 2 hands are being tracked, take the two that have been
+	// there longest and calculate the new size and rotation of the teapot
+	if (tracks.count >= 2) {
+		// Where the 2 hands are, in meters
+		float x1, y1, z1, x2, y2, z2;
+		handPosition(0, x1, y1, z1);
+		handPosition(1, x2, y2, z2);
 		
-		// flat vector to base angle offsets on
-		ofxVec3f horizonVec(zp1.x+1,0,0);
+		// make sure p1 is always the leftmost hand (right hand)
+		if (x2 < x1) {
+			float t;
+			t = x1; x1 = x2; x2 = t;
+			t = y1; y1 = y2; y2 = t;
+			t = z1; z1 = z2; z2 = t;
+		}
 		
-		// calculate the rotation angle about the z axis by finding the 
-		// the anlge between the horizon and the respective hand vectors
-		potZangle = (zp1.y > zp2.y ? -1 : 1 ) * horizonVec.angle(zVec);
-		potYangle = (yp1.z > yp2.z ? -10 : 10 ) * horizonVec.angle(yVec);
+		// the rotation about the z axis is the tilt of the line between
+		// the hands (with the teapot turned over, as it always was), and
+		// about the y axis how far one hand is in front of the other
+		float dx = x2 - x1, dy = y2 - y1, dz = z2 - z1;
+		potZangle = 180 - atan2f(dy, dx) * 180.0f / 3.14159265f;
+		potYangle = -atan2f(dz, dx) * 180.0f / 3.14159265f;
 		
 		// calculate scale based on the distance of the hands from eachother
-		potSize = zVec.length();
-		
+		potSize = sqrtf(dx*dx + dy*dy + dz*dz) * POT_SIZE_PER_METER;
 	}
+	result.potZangle = potZangle;
+	result.potYangle = potYangle;
+	result.potSize = potSize;
 }
 
 //--------------------------------------------------------------
 void testApp::draw(){
+	// the newest frame the processing thread has finished
+	frameResult & result = results.getReadBuffer();
+	
 	ofSetHexColor(0xffffff);
 	
 	// Draw some debug images along the top
-	kinect.drawDepth(10, 10, 315, 236);
-	grayDiff.draw(335, 10, 315, 236);
+	depthTex.draw(10, 10, 315, 236);
+	grayDiffTex.draw(335, 10, 315, 236);
 	
 	// Draw a larger image of the calibrated RGB camera
 	// and overlay the found blobs on top of it
-	colorImg.draw(10,256);
-	contourFinder.draw(10,256);
+	colorTex.draw(10,256);
+	ofNoFill();
+	for (int i = 0; i < result.blobs.count; i++){
+		ofSetHexColor(0xff0099);
+		ofRect(10 + result.blobs.minX[i], 256 + result.blobs.minY[i],
+			   result.blobs.maxX[i] - result.blobs.minX[i] + 1, result.blobs.maxY[i] - result.blobs.minY[i] + 1);
+		ofSetHexColor(0x00ffff);
+		ofCircle(10 + result.blobs.centroidX[i], 256 + result.blobs.centroidY[i], 4);
+	}
+	ofFill();
+	ofSetHexColor(0xffffff);
+	// and the tracked hands with their ids
+	for (int i = 0; i < result.tracks.count; i++){
+		char idStr[16];
+		sprintf(idStr, "%i", result.tracks.id[i]);
+		ofDrawBitmapString(idStr, 14 + result.tracks.x[i], 252 + result.tracks.y[i]);
+	}
+	// the windows the next frame is searched in, and how much of the
+	// frame this one went over
+	ofNoFill();
+	ofSetHexColor(0xffff00);
+	for (int i = 0; i < result.windowCount; i++){
+		ofRect(10 + result.windowX0[i], 256 + result.windowY0[i],
+			   result.windowX1[i] - result.windowX0[i], result.windowY1[i] - result.windowY0[i]);
+	}
+	ofFill();
+	ofSetHexColor(0xffffff);
+	char pixelStr[256];
+	sprintf(pixelStr, "windows %s ('w'): %i pixels checked, %i labelled\nimages: %i bytes copied, %i shared", bWindows ? "on" : "off",
+			result.checkedPixels, result.labelledPixels, result.bytesCopied, result.bytesShared);
+	ofDrawBitmapString(pixelStr, 10, 256 + 480 + 20);
 	
 	// Save matrix state so ofTranslate's and ofRotate's dont mess anything up
 	ofPushMatrix();
@@ -138,8 +369,8 @@ void testApp::draw(){
 		ofTranslate(ofGetWidth()*2/3, ofGetHeight()/2, 0);
 		
 		// rotate the pot based on calculated values
-		ofRotateZ(potZangle);
-		ofRotateY(potYangle);
+		ofRotateZ(result.potZangle);
+		ofRotateY(result.potYangle);
 		
 		// Enable ligh
 		glEnable(GL_DEPTH_TEST); 
@@ -147,7 +378,7 @@ void testApp::draw(){
 		glEnable(GL_LIGHT0);
 		
 		// Draw the teapot
-		glutSolidTeapot(potSize);
+		glutSolidTeapot(result.potSize);
 		
 		// Disable lighting and depth testing so that it doesnt interfere 
 		// with drawing the images in the next itteration of draw()
@@ -164,29 +395,37 @@ void testApp::keyPressed(int key){
 	switch (key)
 	{
 		case ' ':
-			bLearnBakground = true;
+			subtractor.learnBackground();
 			break;
 		case '+':
-			threshold++;
+			threshold += 10;
 			break;
 		case '-':
-			threshold--;
+			threshold -= 10;
+			break;
+		case 'r':
+			// start/stop recording a clip that can be played back with KINECT_CLIP
+			bToggleRecording = true;
+			break;
+		case 'w':
+			// only search windows around the hands, or the whole frame
+			bWindows = !bWindows;
 			break;
 		case OF_KEY_UP:
 			yOff++;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_DOWN:
 			yOff--;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_LEFT:
 			xOff--;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_RIGHT:
 			xOff++;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		// Note these are currently not enabled in ofxKinect as of 11/23/2010
 		case 'h':
@@ -7,12 +7,62 @@
 #include "ofxOpenCv.h"
 #include "ofxKinect.h"
 
-class testApp : public ofBaseApp{
+#include "frameSource.h"
+#include "kinectFrameSource.h"
+#include "fileFrameSource.h"
+#include "clipWriter.h"
+#include "captureThread.h"
+#include "frameBufferPool.h"
+#include "tripleBuffer.h"
+#include "workerThread.h"
+#include "backgroundSubtractor.h"
+#include "blobPyramid.h"
+#include "blobTracker.h"
+#include "trackWindows.h"
+#include "threadPool.h"
+#include "stageGraph.h"
+#include "depthRegistration.h"
+#include "pointCloud.h"
+
+// Everything the processing thread hands over to draw() for one frame.
+// The images are shared with the processing rather than copied, see
+// frameBufferPool.h.
+struct frameResult {
+	// the 8 bit depth map as it was captured, for the preview
+	frameBuffer depth;
+	// the RGB frame
+	frameBuffer color;
+	// the processed depth image
+	frameBuffer grayDiff;
+	// blobs found in grayDiff
+	blobList blobs;
+	// the hands followed from frame to frame
+	trackList tracks;
+	// the windows the next frame is searched in, none for the whole frame,
+	// and the pixels this one checked for changes and labelled
+	int windowCount;
+	int windowX0[TRACK_LIST_SIZE];
+	int windowY0[TRACK_LIST_SIZE];
+	int windowX1[TRACK_LIST_SIZE];
+	int windowY1[TRACK_LIST_SIZE];
+	int checkedPixels;
+	int labelledPixels;
+	// angle and size of the teapot
+	float potZangle;
+	float potYangle;
+	float potSize;
+	// bytes of images copied, and shared instead, for this frame
+	int bytesCopied;
+	int bytesShared;
+};
+
+class testApp : public ofBaseApp, public workerThread {
 
 	public:
 		void setup();
 		void update();
 		void draw();
+		void exit();
 
 		void keyPressed  (int key);
 		void keyReleased(int key);
@@ -22,39 +72,104 @@ class testApp : public ofBaseApp{
 		void mouseReleased(int x, int y, int button);
 		void windowResized(int w, int h);
 
+	protected:
+		// Processes frames as they come in, runs on its own thread
+		void threadedFunction();
+
 	private:
 		// Instance of the kinect object
 		ofxKinect kinect;
 		
+		// Where every image's pixels come from, reused from frame to frame.
+		// Declared first, as it has to outlive everything holding them.
+		frameBufferPool buffers;
+		
+		// Where frames come from, either the kinect or a recorded clip
+		frameSource * source;
+		kinectFrameSource kinectSource;
+		fileFrameSource clipSource;
+		
+		// Pulls frames from the source on its own thread
+		captureThread capture;
+		
+		// Used to record clips of the incoming frames
+		clipWriter recorder;
+		// Set when 'r' is pressed, the processing thread starts/stops recording
+		volatile bool bToggleRecording;
+		
 		// Current camera tilt angle
 		int camTilt;
 		
-		// The calibration offsets to align depth and RGB cameras
+		// Lines the RGB image up with the depth map, see depthRegistration.h
+		depthRegistration registration;
+		// and the nudges to it tuned with the arrow keys, in pixels
 		float xOff;
 		float yOff;
 		
-		// Quick utility function to apply the offsets to the camera matrix
-		void setCalibrationOffset(float x, float y);
 		
 		
-		// Used for storing each RGB frame
-		ofxCvColorImage	colorImg;
+		// Runs the image processing on one frame, and publishes the result
+		void processFrame(capturedFrame & frame);
+		// The stages processFrame() runs, see setup() for what waits for what
+		void copyColor();
+		// and the strips of rows copyColor() splits into
+		void registerStrip(int y0, int y1, int thread);
+		void filterDepth();
+		void findBlobs();
+		void copyMask();
+		void findPoints();
+		void trackHands();
+		// where one of the tracked hands is, in meters
+		void handPosition(int track, float & x, float & y, float & z);
+		// Runs the stages, with the ones that don't depend on each other
+		// on the pool's threads at the same time
+		threadPool pool;
+		stageGraph graph;
+		// the frame the stages are working on
+		capturedFrame * currentFrame;
+		// Saves the frame if we are recording
+		void recordFrame(capturedFrame & frame);
 		
+		// Processed frames, handed from the processing thread to draw()
+		tripleBuffer<frameResult> results;
+		// and their images, loaded into textures when a new one comes in
+		ofTexture depthTex;
+		ofTexture colorTex;
+		ofTexture grayDiffTex;
+		// the color image the stages are filling in
+		unsigned char * colorPixels;
+		// the pool's counts when the frame started
+		unsigned long long copiedBefore;
+		unsigned long long sharedBefore;
 				
-		// Used to store each depth frame
-		ofxCvGrayscaleImage grayImage;
-		// Used to store captured depth bg
-		ofxCvGrayscaleImage grayBg;
-		// Used to store the processed depth image
-		ofxCvGrayscaleImage grayDiff;
-		
-		// Used to find blobs in the filtered depthmap
-		ofxCvContourFinder 	contourFinder;
+		// Filters the depth frames, keeps the background model (learned
+		// when space is pressed) and masks them, only redoing the parts
+		// of the frame that changed
+		backgroundSubtractor subtractor;
+		// The masked depth map, kept between frames since only the
+		// changed tiles are updated. draw() shares it, so it is only
+		// copied when a tile changes while draw() still holds it.
+		frameBuffer grayDiff;
+		// the threshold grayDiff was last masked with
+		int maskThreshold;
+		// Used to find blobs in grayDiff, coarse to fine (see
+		// blobPyramid.h), and the ones it found last
+		blobPyramid labeller;
+		blobList blobs;
+		// The blobs' pixels as 3D points in meters, for the teapot
+		pointCloud cloud;
+		// Follows the blobs between frames so the hands keep their ids,
+		// and smooths them (see blobTracker.h)
+		blobTracker tracker;
+		// when the last frame was captured, to work out the time between frames
+		unsigned long long lastTimestamp;
+		// Once both hands are tracked only windows around them are
+		// filtered, masked and labelled (see trackWindows.h), toggled with 'w'
+		trackWindows windows;
+		volatile bool bWindows;
 		
-		// Flag to capture the background in the next update()
-		bool bLearnBakground;
-		// distance at which depth map is "cut off"
-		int	threshold;
+		// distance at which depth map is "cut off", in millimeters
+		volatile int threshold;
 		
 		// The current angl and size of the teapot
 		float potZangle;
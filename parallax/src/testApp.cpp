@@ -1,50 +1,116 @@
 #include "testApp.h"
-#include <OpenGL/glu.h>
+#include "rgbaPack.h"
+#include "depthConversion.h"
+#include "alignedMemory.h"
 
-//--------------------------------------------------------------
-void testApp::setCalibrationOffset(float x, float y) {
-	ofxMatrix4x4 matrix = kinect.getRGBDepthMatrix();
-	matrix.getPtr()[3] = x;
-	matrix.getPtr()[7] = y;
-	kinect.setRGBDepthMatrix(matrix);
-}
+#include <string.h>
 
 //--------------------------------------------------------------
 void testApp::setup(){
-	// Setup kinect
-	kinect.init();
-	kinect.setVerbose(true);
-	kinect.open();
+	// Play back a recorded clip instead of the kinect if KINECT_CLIP
+	// is set, otherwise setup the kinect (see kinectFrameSource.h)
+	source = openFrameSource(kinect, kinectSource, clipSource);
 	
 	// Allocate space for all the images
-	colorImg.allocate(kinect.width, kinect.height);
-	colorBg.allocate(kinect.width, kinect.height);
+	int w = source->getWidth(), h = source->getHeight();
+	colorImg = buffers.acquire(w*h*3);
+	memset(colorImg.write(), 0, w*h*3);
+	colorPixels = NULL;
+	grayPixels = NULL;
+	registration.setup(source->getWidth(), source->getHeight());
+	subtractor.setup(source->getWidth(), source->getHeight());
+	reprojector.setup(source->getWidth(), source->getHeight());
+	head.setup(source->getWidth(), source->getHeight());
+	grayDiff = buffers.acquire(w*h);
+	memset(grayDiff.write(), 0, w*h);
 	
-	grayImage.allocate(kinect.width, kinect.height);
-	grayBg.allocate(kinect.width, kinect.height);
-	grayDiff.allocate(kinect.width, kinect.height);
+	// and for the results handed over to draw(), one set per buffer
+	for (int i = 0; i < 3; i++){
+		frameResult & result = results.getBuffer(i);
+		result.grayImage = buffers.acquire(w*h);
+		memset(result.grayImage.write(), 0, w*h);
+		result.grayDiff = grayDiff;
+		// staging buffer for maskedImg, reused every frame
+		result.maskedPixels = (unsigned char *) alignedMalloc(source->getWidth()*source->getHeight()*4);
+		result.bPremultiplied = false;
+		result.bHead = false;
+		result.headX = result.headY = 0;
+		result.eyeX = result.eyeY = 0;
+		result.headMicros = 0;
+		result.headOverBudget = 0;
+		result.bytesCopied = result.bytesShared = 0;
+		colorBgs.getBuffer(i) = colorImg;
+	}
+	depthTex.allocate(w, h, GL_LUMINANCE);
+	rgbTex.allocate(w, h, GL_RGB);
+	grayImageTex.allocate(w, h, GL_LUMINANCE);
+	grayDiffTex.allocate(w, h, GL_LUMINANCE);
+	colorBgTex.allocate(w, h, GL_RGB);
 	
-	maskedImg.allocate(kinect.width, kinect.height,GL_RGBA);
+	maskedImg.allocate(source->getWidth(), source->getHeight(),GL_RGBA);
+	bPremultiplyAlpha = false;
 	
-	// Don't capture the background at startup
-	bLearnBakground = false;
+	// The processing for each frame, as stages that wait for the ones
+	// they need, with the per pixel passes split into strips over the same
+	// threads. KINECT_THREADS=0 runs them one after the other, in this
+	// order, for debugging.
+	pool.setup(threadPool::getDefaultThreadCount());
+	graph.setup(&pool);
+	subtractor.setPool(&pool);
+	reprojector.setPool(&pool);
+	int colorStage = graph.addStage("color", this, &testApp::copyColor);
+	int depthStage = graph.addStage("depth", this, &testApp::filterDepth);
+	graph.addStage("display", this, &testApp::displayDepth, depthStage);
+	graph.addStage("color bg", this, &testApp::saveColorBackground, colorStage, depthStage);
+	int maskStage = graph.addStage("mask", this, &testApp::maskDepth, depthStage);
+	graph.addStage("mask copy", this, &testApp::copyMask, maskStage);
+	int headStage = graph.addStage("head", this, &testApp::trackHead, maskStage);
+	int reprojectStage = graph.addStage("reproject", this, &testApp::reproject, colorStage, headStage);
+	graph.addStage("rgba pack", this, &testApp::packColor, reprojectStage);
+	currentFrame = NULL;
+	bLearned = false;
+	
+	// Don't record at startup
+	bToggleRecording = false;
 	
 	// set up sensable defaults for threshold and calibration offsets
 	// Note: these are empirically set based on my kinect, they will likely need adjusting
-	threshold = 80;
+	threshold = 2900;
+	maskThreshold = threshold;
 	
-	xOff = 13.486656;
-	yOff = 34.486656;	
-	setCalibrationOffset(xOff, yOff);
+	// the registration has the cameras' calibration, the offsets are
+	// only for nudging it
+	xOff = 0;
+	yOff = 0;
+	registration.setColorOffset(xOff, yOff);
 	
 	// Set depth map so near values are higher (white)
 	kinect.enableDepthNearValueWhite(true);
 	
-	// Set which direction virtual cameara is animating
+	// Start the virtual camera where the kinect is, and set which
+	// direction it is animating
+	eyeX = 0;
+	eyeY = 0;
 	eyeDir = 1;
+	for (int i = 0; i < 3; i++){
+		eyes.getBuffer(i).x = 0;
+		eyes.getBuffer(i).y = 0;
+	}
+	viewX = 0;
+	viewY = 0;
+	
+	// Move it by hand until head tracking is turned on
+	bHeadTracking = false;
+	lastTimestamp = 0;
 	
 	// Setup window
 	ofSetFrameRate(30);	
+	
+	// Start pulling in frames on their own thread, and processing
+	// them on this app's thread as soon as they arrive
+	capture.setup(source, &buffers);
+	capture.startThread();
+	startThread();
 }
 
 //--------------------------------------------------------------
@@ -52,93 +118,274 @@ void testApp::update(){
 	
 	ofBackground(100, 100, 100);
 	
-	// Pull in new frame
-	kinect.update();
-	grayImage.setFromPixels(kinect.getDepthPixels(), kinect.width, kinect.height);
-	colorImg.setFromPixels(kinect.getCalibratedRGBPixels(), kinect.width, kinect.height);
-	
-	// Quick and dirty noise filter on the depth map. Needs work
-	grayImage.dilate();
-	grayImage.erode();
-	
-	// If the user pressed spacebar, capture the depth and RGB images and save for later
-    if (bLearnBakground == true){
-        grayBg = grayImage;
-		colorBg = colorImg;
-        bLearnBakground = false;
-    }
-	
-	// The next few steps mask the depthmap so that only pixels 
-	// that have changed since background was captured are considered
-	
-    // Subtract the saved background from the current one
-	grayDiff = grayImage;
-	grayDiff -= grayBg;
-	
-	// anything that is > 1 has changed, so keep it
-    grayDiff.threshold(1);
-	// multiply in the current depth values, to mask it 
-	grayDiff *= grayImage;
-	
-    // cut off anything that is too far away
-	grayDiff.threshold(threshold);
-	
-	
-	// The next block uses the finalized depth map we calculated
-	// above to mask the current RGB frame
-	unsigned char * pixels = new unsigned char[kinect.width*kinect.height*4];
-	unsigned char * colorPixels = colorImg.getPixels();
-	unsigned char * alphaPixels = grayDiff.getPixels();
-	
-	for (int i = 0; i < kinect.width; i++){
-		for (int j = 0; j < kinect.height; j++){
-			int pos = (j * kinect.width + i);
-			pixels[pos*4  ] = colorPixels[pos * 3];
-			pixels[pos*4+1] = colorPixels[pos * 3+1];
-			pixels[pos*4+2] = colorPixels[pos * 3+2];
-			pixels[pos*4+3] = alphaPixels[pos];
-		}
+	// Show the newest processed frame, if there is one. Its images are
+	// the processing thread's own, held until the next one comes in.
+	int w = source->getWidth(), h = source->getHeight();
+	if (results.update()) {
+		frameResult & result = results.getReadBuffer();
+		maskedImg.loadData(result.maskedPixels, w, h, GL_RGBA);
+		depthTex.loadData((unsigned char *) result.depth.read(), w, h, GL_LUMINANCE);
+		rgbTex.loadData((unsigned char *) result.rgb.read(), w, h, GL_RGB);
+		grayImageTex.loadData((unsigned char *) result.grayImage.read(), w, h, GL_LUMINANCE);
+		grayDiffTex.loadData((unsigned char *) result.grayDiff.read(), w, h, GL_LUMINANCE);
 	}
-	maskedImg.loadData(pixels, kinect.width,kinect.height,GL_RGBA);
-	delete [] pixels;
+	if (colorBgs.update())
+		colorBgTex.loadData((unsigned char *) colorBgs.getReadBuffer().read(), w, h, GL_RGB);
 	
 	// Move the "eye" back and forth automatically, comment
-	// this out if you want to contorl with the mouse
-	eyeX += 20*eyeDir;
-	if(eyeX > 300)
-		eyeDir = -1;
-	else if(eyeX < -300)
-		eyeDir = 1;
+	// this out if you want to contorl with the mouse. While a head is
+	// tracked the processing thread moves it with the head instead (see
+	// trackHead()), and it carries on from there when the head is lost.
+	frameResult & shown = results.getReadBuffer();
+	if (bHeadTracking && shown.bHead) {
+		eyeX = shown.eyeX;
+		eyeY = shown.eyeY;
+	} else {
+		eyeX += 20*eyeDir;
+		if(eyeX > 300)
+			eyeDir = -1;
+		else if(eyeX < -300)
+			eyeDir = 1;
+	}
+	eyePosition & eye = eyes.getWriteBuffer();
+	eye.x = eyeX;
+	eye.y = eyeY;
+	eyes.publish();
+}
+
+//--------------------------------------------------------------
+void testApp::exit(){
+	// stop processing before the frames it is reading go away
+	stopThread();
+	capture.stopThread();
+	pool.stop();
+	recorder.close();
+	for (int i = 0; i < 3; i++)
+		alignedFree(results.getBuffer(i).maskedPixels);
+	
+	// how long finding the head took
+	printf("%s%d frames over budget\n", head.getTiming().toString().c_str(), head.getOverBudgetCount());
+}
+
+//--------------------------------------------------------------
+void testApp::threadedFunction(){
+	// Process every frame as soon as the capture thread hands it
+	// over, the results are picked up by update() on the main thread
+	while (isThreadRunning()) {
+		if (capture.waitForFrame(100000))
+			processFrame(capture.getFrame());
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::recordFrame(capturedFrame & frame){
+	// Start/stop recording if 'r' was pressed, and save the frame if we are recording
+	if (bToggleRecording) {
+		if (recorder.isOpen())
+			recorder.close();
+		else
+			recorder.open(ofToDataPath("clip.kdc").c_str(), frame.width, frame.height, frame.rgbRegistered);
+		bToggleRecording = false;
+	}
+	if (recorder.isOpen())
+		recorder.addFrame(frame.getRawDepth(), frame.getDepth(), frame.getRGB(), frame.timestamp);
+}
+
+//--------------------------------------------------------------
+void testApp::processFrame(capturedFrame & frame){
+	currentFrame = &frame;
+	copiedBefore = buffers.getBytesCopied();
+	sharedBefore = buffers.getBytesShared();
+	
+	// the previews are drawn from the captured frame, shared
+	frameResult & captured = results.getWriteBuffer();
+	captured.depth = frame.depth;
+	captured.rgb = frame.rgb;
+	
+	// Run the stages, the color image at the same time as the depth and
+	// the display image at the same time as the mask, on the pool's
+	// threads when there are any (see stageGraph.h)
+	graph.run();
+	
+	// hand the finished frame over to the main thread, with what it took
+	// to move its images around
+	frameResult & result = results.getWriteBuffer();
+	result.bytesCopied = (int) (buffers.getBytesCopied() - copiedBefore);
+	result.bytesShared = (int) (buffers.getBytesShared() - sharedBefore);
+	results.publish();
+}
+
+//--------------------------------------------------------------
+void testApp::copyColor(){
+	// Pull in new frame, lined up with the depth map in strips of rows
+	// on the pool's threads. The table it goes through is only rebuilt
+	// when the offsets change. A frame that is already lined up is
+	// used as it is, and a background captured from an earlier frame
+	// keeps its pixels.
+	registration.update();
+	if (currentFrame->rgbRegistered)
+		colorImg = currentFrame->rgb;
+	else {
+		colorPixels = colorImg.overwrite();
+		pool.forStrips(currentFrame->height, currentFrame->width*3, this, &testApp::registerStrip);
+	}
+	recordFrame(*currentFrame);
+}
+
+//--------------------------------------------------------------
+void testApp::registerStrip(int y0, int y1, int thread){
+	registration.apply(currentFrame->getRawDepth(), currentFrame->getRGB(), colorPixels, y0, y1);
+}
+
+//--------------------------------------------------------------
+void testApp::filterDepth(){
+	// Everything has to be masked again if the threshold changes
+	int cutoff = threshold;
+	if (cutoff != maskThreshold) {
+		subtractor.invalidate();
+		maskThreshold = cutoff;
+	}
+	
+	// Noise filter on the depth map, then either capture it as the
+	// background if the user pressed spacebar, or keep the background
+	// following the scene. Only the tiles that changed since the last
+	// frame are redone, see backgroundSubtractor.h
+	bLearned = subtractor.update(currentFrame->getRawDepth());
+}
+
+//--------------------------------------------------------------
+void testApp::displayDepth(){
+	// in strips of rows on the pool's threads, over every pixel so
+	// there's nothing to copy
+	grayPixels = results.getWriteBuffer().grayImage.overwrite();
+	pool.forStrips(currentFrame->height, currentFrame->width*3, this, &testApp::displayStrip);
+}
+
+//--------------------------------------------------------------
+void testApp::displayStrip(int y0, int y1, int thread){
+	int offset = y0*currentFrame->width;
+	rawDepthToDisplay(subtractor.getFiltered() + offset, grayPixels + offset, (y1 - y0)*currentFrame->width);
+}
+
+//--------------------------------------------------------------
+void testApp::saveColorBackground(){
+	// save the RGB image along with the depth background, by sharing it
+	if (bLearned) {
+		colorBgs.getWriteBuffer() = colorImg;
+		colorBgs.publish();
+	}
+}
+
+//--------------------------------------------------------------
+void testApp::maskDepth(){
+	// Mask the depthmap so that only pixels that are well in front of the
+	// background, and are closer than the threshold, are kept.
+	// Only the changed tiles are masked again, see backgroundSubtractor.h
+	if (subtractor.getDirtyCount() > 0)
+		subtractor.mask(grayDiff.write(), maskThreshold);
+}
+
+//--------------------------------------------------------------
+void testApp::copyMask(){
+	// shared, not copied, see grayDiff
+	results.getWriteBuffer().grayDiff = grayDiff;
+}
+
+//--------------------------------------------------------------
+void testApp::trackHead(){
+	// Find the top of the nearest person in the mask, and move the
+	// virtual camera with it before this frame is reprojected. Without
+	// one it goes wherever the main thread last put it.
+	eyes.update();
+	viewX = eyes.getReadBuffer().x;
+	viewY = eyes.getReadBuffer().y;
+	if (bHeadTracking) {
+		unsigned long long timestamp = currentFrame->timestamp;
+		float dt = lastTimestamp != 0 && timestamp > lastTimestamp ? (timestamp - lastTimestamp) / 1000000.0f : 1 / 30.0f;
+		lastTimestamp = timestamp;
+		head.update(grayDiff.read(), subtractor.getFiltered(), dt);
+		if (head.isTracking()) {
+			viewX = head.getX() * 1000;
+			viewY = head.getY() * 1000;
+		}
+	}
+	
+	frameResult & result = results.getWriteBuffer();
+	result.bHead = bHeadTracking && head.isTracking();
+	result.headX = head.getImageX();
+	result.headY = head.getImageY();
+	result.eyeX = viewX;
+	result.eyeY = viewY;
+	result.headMicros = head.getTiming().getPercentile(99);
+	result.headOverBudget = head.getOverBudgetCount();
+}
+
+//--------------------------------------------------------------
+void testApp::reproject(){
+	// Move every masked RGB pixel to where it would be seen from the
+	// virtual camera, by its own depth. Things at the threshold distance
+	// stay put, so the foreground lines up with the background image
+	// where the two meet.
+	reprojector.setViewpoint(viewX / 1000.0f, viewY / 1000.0f, maskThreshold / 1000.0f);
+	reprojector.update(subtractor.getFiltered(), grayDiff.read(), colorImg.read());
+}
+
+//--------------------------------------------------------------
+void testApp::packColor(){
+	// The next block uses the alpha of the reprojected image to mask
+	// it, in strips of rows on the pool's threads
+	results.getWriteBuffer().bPremultiplied = bPremultiplyAlpha;
+	pool.forStrips(currentFrame->height, currentFrame->width*8, this, &testApp::packStrip);
+}
+
+//--------------------------------------------------------------
+void testApp::packStrip(int y0, int y1, int thread){
+	frameResult & result = results.getWriteBuffer();
+	int offset = y0*currentFrame->width;
+	rgbaPack(reprojector.getColor() + offset*3, reprojector.getAlpha() + offset, result.maskedPixels + offset*4, (y1 - y0)*currentFrame->width, result.bPremultiplied);
 }
 
 //--------------------------------------------------------------
 void testApp::draw(){
+	// the newest frame the processing thread has finished
+	frameResult & result = results.getReadBuffer();
+	
 	ofSetHexColor(0xffffff);
 
 	// Draw some debug images along the top
-	kinect.drawDepth(10, 10, 300, 225);
-	grayImage.draw(320, 10, 300, 225);
-	grayDiff.draw(640, 10, 300, 225);
-	kinect.draw(960, 10, 300, 225);
+	depthTex.draw(10, 10, 300, 225);
+	grayImageTex.draw(320, 10, 300, 225);
+	grayDiffTex.draw(640, 10, 300, 225);
+	// with the tracked head on it
+	if (result.bHead) {
+		ofNoFill();
+		ofSetHexColor(0xff0000);
+		ofCircle(640 + result.headX * 300 / source->getWidth(), 10 + result.headY * 225 / source->getHeight(), 10);
+		ofFill();
+		ofSetHexColor(0xffffff);
+	}
+	rgbTex.draw(960, 10, 300, 225);
 	
-	// Save matrix state so ofTranslate's dont mess anything up
-	ofPushMatrix();
-	{
-		// Set the virtual camera position
-		gluLookAt(eyeX, eyeY, 330, eyeX, eyeY, 0, 0, 1, 0);
-		
-		// Draw the captured background
-		colorBg.draw(ofGetWidth()/2-colorBg.width/2, 350);
-
-		// Draw the foreground (arbitrarily) 300 units forward
-		ofTranslate(0, 0, 300);
-		maskedImg.draw(ofGetWidth()/2-colorBg.width/2, 350);
+	// Draw the captured background, it is behind the pivot distance so
+	// it stays put
+	colorBgTex.draw(ofGetWidth()/2-source->getWidth()/2, 350);
+
+	// and the foreground on top of it, already seen from the virtual
+	// camera by the reproject stage
+	// (the blending is put back however openFrameworks had it)
+	if (result.bPremultiplied) {
+		glPushAttrib(GL_COLOR_BUFFER_BIT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	maskedImg.draw(ofGetWidth()/2-source->getWidth()/2, 350);
+	if (result.bPremultiplied) {
+		glPopAttrib();
 	}
-	ofPopMatrix();
 	
 	// Output some help text
 	char reportStr[1024];
-	sprintf(reportStr, "press ' ' to capture bg\nthreshold %i (press: +/-)\nfps: %f\nArrows to calibrate\nxOffset: %f  yOffset: %f", threshold, ofGetFrameRate(), xOff, yOff);
+	sprintf(reportStr, "press ' ' to capture bg\nthreshold %imm (press: +/-)\npremultiplied alpha: %i (press: p)\nhead tracking: %i (press: t), p99 %.0fus, %i frames over budget\nimages: %i bytes copied, %i shared\nfps: %f\nArrows to calibrate\nxOffset: %f  yOffset: %f", threshold, bPremultiplyAlpha, bHeadTracking, result.headMicros, result.headOverBudget, result.bytesCopied, result.bytesShared, ofGetFrameRate(), xOff, yOff);
 	ofDrawBitmapString(reportStr, 20, 650);
 	
 }
@@ -149,29 +396,39 @@ void testApp::keyPressed(int key){
 	switch (key)
 	{
 		case ' ':
-			bLearnBakground = true;
+			subtractor.learnBackground();
 			break;
 		case '+':
-			threshold++;
+			threshold += 10;
 			break;
 		case '-':
-			threshold--;
+			threshold -= 10;
+			break;
+		case 'r':
+			// start/stop recording a clip that can be played back with KINECT_CLIP
+			bToggleRecording = true;
+			break;
+		case 'p':
+			bPremultiplyAlpha = !bPremultiplyAlpha;
+			break;
+		case 't':
+			bHeadTracking = !bHeadTracking;
 			break;
 		case OF_KEY_UP:
 			yOff++;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_DOWN:
 			yOff--;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_LEFT:
 			xOff--;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		case OF_KEY_RIGHT:
 			xOff++;
-			setCalibrationOffset(xOff, yOff);
+			registration.setColorOffset(xOff, yOff);
 			break;
 		// Note these are currently not enabled in ofxKinect as of 11/23/2010
 		case 'h':
@@ -7,12 +7,62 @@
 #include "ofxOpenCv.h"
 #include "ofxKinect.h"
 
-class testApp : public ofBaseApp{
+#include "frameSource.h"
+#include "kinectFrameSource.h"
+#include "fileFrameSource.h"
+#include "clipWriter.h"
+#include "captureThread.h"
+#include "frameBufferPool.h"
+#include "tripleBuffer.h"
+#include "workerThread.h"
+#include "backgroundSubtractor.h"
+#include "threadPool.h"
+#include "stageGraph.h"
+#include "depthRegistration.h"
+#include "depthReprojector.h"
+#include "headTracker.h"
+
+// Where the main thread has put the virtual camera, in millimeters
+struct eyePosition {
+	GLdouble x, y;
+};
+
+// Everything the processing thread hands over to draw() for one frame.
+// The images are shared with the processing rather than copied, see
+// frameBufferPool.h.
+struct frameResult {
+	// the frame as it was captured, the 8 bit depth map and the RGB
+	// as the colour camera saw it, for the previews
+	frameBuffer depth;
+	frameBuffer rgb;
+	// the (filtered) depth frame, as the 8 bit display view
+	frameBuffer grayImage;
+	// the processed depth image
+	frameBuffer grayDiff;
+	// the masked RGBA pixels of the foreground object
+	unsigned char * maskedPixels;
+	// whether maskedPixels has premultiplied alpha
+	bool bPremultiplied;
+	// whether a head is being tracked, where it is in the depth image,
+	// and how long finding it takes (99th percentile, microseconds)
+	bool bHead;
+	float headX, headY;
+	// where the virtual camera was for this frame, in millimeters
+	GLdouble eyeX, eyeY;
+	double headMicros;
+	int headOverBudget;
+	// bytes of images copied, and shared instead, for this frame
+	int bytesCopied;
+	int bytesShared;
+};
+
+class testApp : public ofBaseApp, public workerThread {
 
 	public:
 		void setup();
 		void update();
 		void draw();
+		void exit();
 
 		void keyPressed  (int key);
 		void keyReleased(int key);
@@ -22,43 +72,131 @@ class testApp : public ofBaseApp{
 		void mouseReleased(int x, int y, int button);
 		void windowResized(int w, int h);
 
+	protected:
+		// Processes frames as they come in, runs on its own thread
+		void threadedFunction();
+
 	private:
 		// Instance of the kinect object
 		ofxKinect kinect;
+
+		// Where every image's pixels come from, reused from frame to frame.
+		// Declared first, as it has to outlive everything holding them.
+		frameBufferPool buffers;
+		
+		// Where frames come from, either the kinect or a recorded clip
+		frameSource * source;
+		kinectFrameSource kinectSource;
+		fileFrameSource clipSource;
+		
+		// Pulls frames from the source on its own thread
+		captureThread capture;
+		
+		// Used to record clips of the incoming frames
+		clipWriter recorder;
+		// Set when 'r' is pressed, the processing thread starts/stops recording
+		volatile bool bToggleRecording;
 		
 		// Current camera tilt angle
 		int camTilt;
 
-		// The calibration offsets to align depth and RGB cameras
+		// Lines the RGB image up with the depth map, see depthRegistration.h
+		depthRegistration registration;
+		// and the nudges to it tuned with the arrow keys, in pixels
 		float xOff;
 		float yOff;
 
-		// Quick utility function to apply the offsets to the camera matrix
-		void setCalibrationOffset(float x, float y);
 
-		// Used for storing each RGB frame
-		ofxCvColorImage	colorImg;
-		// Used to store the captured RGB background
-		ofxCvColorImage	colorBg;
+		// Runs the image processing on one frame, and publishes the result
+		void processFrame(capturedFrame & frame);
+		// The stages processFrame() runs, see setup() for what waits for what
+		void copyColor();
+		void filterDepth();
+		void displayDepth();
+		void saveColorBackground();
+		void maskDepth();
+		void copyMask();
+		void trackHead();
+		void reproject();
+		void packColor();
+		// and the strips of rows copyColor(), displayDepth() and packColor()
+		// split into
+		void registerStrip(int y0, int y1, int thread);
+		void displayStrip(int y0, int y1, int thread);
+		void packStrip(int y0, int y1, int thread);
+		// Runs the stages, with the ones that don't depend on each other
+		// on the pool's threads at the same time
+		threadPool pool;
+		stageGraph graph;
+		// the frame the stages are working on
+		capturedFrame * currentFrame;
+		// whether the background was learned from it
+		bool bLearned;
+		// Saves the frame if we are recording
+		void recordFrame(capturedFrame & frame);
+
+		// Processed frames, handed from the processing thread to draw()
+		tripleBuffer<frameResult> results;
+		// and their images, loaded into textures when a new one comes in
+		ofTexture depthTex;
+		ofTexture rgbTex;
+		ofTexture grayImageTex;
+		ofTexture grayDiffTex;
+		// the display image displayDepth() is filling in
+		unsigned char * grayPixels;
+		// the pool's counts when the frame started
+		unsigned long long copiedBefore;
+		unsigned long long sharedBefore;
+
+		// Used for storing each RGB frame, and the pixels copyColor() is
+		// filling in
+		frameBuffer colorImg;
+		unsigned char * colorPixels;
+		// Used to store the captured RGB background, handed to draw() when
+		// captured. It is the colour frame it was captured from, shared.
+		tripleBuffer<frameBuffer> colorBgs;
+		ofTexture colorBgTex;
+
+		// Filters the depth frames, keeps the background model (learned
+		// when space is pressed) and masks them, only redoing the parts
+		// of the frame that changed
+		backgroundSubtractor subtractor;
+		// The masked depth map, kept between frames since only the
+		// changed tiles are updated. draw() shares it, so it is only
+		// copied when a tile changes while draw() still holds it.
+		frameBuffer grayDiff;
+		// the threshold grayDiff was last masked with
+		int maskThreshold;
+
+		// Finds the nearest person's head in grayDiff, to move the virtual
+		// camera with (press 't'), see headTracker.h
+		headTracker head;
+		volatile bool bHeadTracking;
+		// capture time of the last frame the head was looked for in
+		unsigned long long lastTimestamp;
 
-		// Used to store each depth frame
-		ofxCvGrayscaleImage grayImage;
-		// Used to store captured depth bg
-		ofxCvGrayscaleImage grayBg;
-		// Used to store the processed depth image
-		ofxCvGrayscaleImage grayDiff;
+		// Redraws the foreground from the virtual camera, moving every pixel
+		// by its own depth, see depthReprojector.h
+		depthReprojector reprojector;
 
 		// Used to store the masked RGB iamge of the forgeground object
 		ofTexture maskedImg;
+		// Whether maskedImg is built and drawn with premultiplied alpha
+		volatile bool bPremultiplyAlpha;
 
-		// Flag to capture the background in the next update()
-		bool bLearnBakground;
-		// distance at which depth map is "cut off"
-		int	threshold;
+		// distance at which depth map is "cut off", in millimeters
+		volatile int threshold;
 
-		// Position of the virtual camera
+		// Position of the virtual camera, in millimeters from the kinect,
+		// as the main thread moves it: back and forth by itself or with
+		// the mouse. Handed to the processing thread once a frame.
 		GLdouble eyeX;
 		GLdouble eyeY;
+		tripleBuffer<eyePosition> eyes;
+		// Where the processing thread put it for the frame it is on, the
+		// head while one is tracked, otherwise the newest from eyes
+		GLdouble viewX;
+		GLdouble viewY;
 		
 		// Which direction virtual cameara is animating
 		GLdouble eyeDir;
@@ -0,0 +1,203 @@
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "testing.h"
+#include "blobLabeller.h"
+#include "blobPyramid.h"
+#include "tileSegmenter.h"
+
+// blobPyramid has to find exactly what blobLabeller::find() finds on the
+// full mask, and the windowed tileSegmenter has to leave the mask as if
+// only the windows had been masked.
+
+static const int width = 640, height = 480;
+
+//--------------------------------------------------------------
+static void drawEllipse(std::vector<unsigned char> & mask, int cx, int cy, int rx, int ry) {
+	for (int y = std::max(cy - ry, 0); y <= std::min(cy + ry, height - 1); y++){
+		for (int x = std::max(cx - rx, 0); x <= std::min(cx + rx, width - 1); x++){
+			float dx = (x - cx) / (float) rx, dy = (y - cy) / (float) ry;
+			if (dx*dx + dy*dy <= 1)
+				mask[y*width + x] = 255;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+static void randomMask(testRandom & random, std::vector<unsigned char> & mask, std::vector<unsigned short> & depth) {
+	// a few hands and arms, some of them close enough to touch, with
+	// speckle around them that should all be dropped
+	mask.assign(width*height, 0);
+	int blobs = random.range(0, 7);
+	for (int b = 0; b < blobs; b++)
+		drawEllipse(mask, random.range(0, width), random.range(0, height), random.range(10, 70), random.range(10, 70));
+	int speckle = random.range(0, 400);
+	for (int s = 0; s < speckle; s++)
+		drawEllipse(mask, random.range(0, width), random.range(0, height), random.range(1, 3), random.range(1, 3));
+	depth.resize(width*height);
+	for (int i = 0; i < width*height; i++)
+		depth[i] = random.range(500, 900);
+}
+
+//--------------------------------------------------------------
+// The blobs in the same order, with ties in area put in a fixed order
+static std::vector<int> blobOrder(const blobList & blobs) {
+	std::vector<long long> keys;
+	for (int i = 0; i < blobs.count; i++)
+		keys.push_back(((long long) (width*height - blobs.area[i]) << 40) | ((long long) blobs.minY[i] << 20) | (blobs.minX[i] << 4) | i);
+	std::sort(keys.begin(), keys.end());
+	std::vector<int> order;
+	for (size_t i = 0; i < keys.size(); i++)
+		order.push_back((int) (keys[i] & 15));
+	return order;
+}
+
+//--------------------------------------------------------------
+static bool sameBlobs(const blobList & a, const blobList & b) {
+	if (a.count != b.count)
+		return false;
+	std::vector<int> oa = blobOrder(a), ob = blobOrder(b);
+	for (int k = 0; k < a.count; k++){
+		int i = oa[k], j = ob[k];
+		if (a.area[i] != b.area[j] || a.centroidX[i] != b.centroidX[j] || a.centroidY[i] != b.centroidY[j] ||
+			a.minX[i] != b.minX[j] || a.minY[i] != b.minY[j] || a.maxX[i] != b.maxX[j] || a.maxY[i] != b.maxY[j] ||
+			a.depth[i] != b.depth[j] || a.depthVariance[i] != b.depthVariance[j])
+			return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+TEST(blobs, pyramidFind) {
+	testRandom random(21);
+	blobLabeller labeller;
+	labeller.setup(width, height);
+	blobPyramid pyramids[3];
+	for (int l = 0; l < 3; l++){
+		pyramids[l].setup(width, height);
+		pyramids[l].setLevels(l);
+	}
+	std::vector<unsigned char> mask;
+	std::vector<unsigned short> depth;
+	blobList expected, found;
+	for (int m = 0; m < 100; m++){
+		randomMask(random, mask, depth);
+		labeller.find(&mask[0], expected, 1000, width*height/2, 5, &depth[0]);
+		for (int l = 0; l < 3; l++){
+			pyramids[l].find(&mask[0], found, 1000, width*height/2, 5, &depth[0]);
+			CHECK(sameBlobs(expected, found));
+		}
+	}
+}
+
+//--------------------------------------------------------------
+TEST(blobs, pyramidFindInBoxes) {
+	// Windows around the blobs of a frame, with the mask cleared outside
+	// them as the windowed tileSegmenter leaves it
+	testRandom random(22);
+	blobLabeller labeller;
+	labeller.setup(width, height);
+	blobPyramid pyramid;
+	pyramid.setup(width, height);
+	std::vector<unsigned char> mask;
+	std::vector<unsigned short> depth;
+	blobList blobs, expected, found;
+	for (int m = 0; m < 100; m++){
+		randomMask(random, mask, depth);
+		labeller.find(&mask[0], blobs, 1000, width*height/2, 5, &depth[0]);
+		int x0[BLOB_LIST_SIZE], y0[BLOB_LIST_SIZE], x1[BLOB_LIST_SIZE], y1[BLOB_LIST_SIZE];
+		int margin = random.range(0, 40);
+		for (int i = 0; i < blobs.count; i++){
+			x0[i] = std::max(blobs.minX[i] - margin, 0);
+			y0[i] = std::max(blobs.minY[i] - margin, 0);
+			x1[i] = std::min(blobs.maxX[i] + 1 + margin, width);
+			y1[i] = std::min(blobs.maxY[i] + 1 + margin, height);
+		}
+		int count = joinBoxes(x0, y0, x1, y1, blobs.count);
+		std::vector<unsigned char> windowed(width*height, 0);
+		for (int i = 0; i < count; i++){
+			for (int y = y0[i]; y < y1[i]; y++)
+				memcpy(&windowed[y*width + x0[i]], &mask[y*width + x0[i]], x1[i] - x0[i]);
+		}
+
+		labeller.find(&windowed[0], expected, 1000, width*height/2, 5, &depth[0]);
+		pyramid.setLevels(m % 3);
+		pyramid.findInBoxes(&windowed[0], found, 1000, width*height/2, 5, &depth[0], x0, y0, x1, y1, count);
+		CHECK(sameBlobs(expected, found));
+	}
+}
+
+//--------------------------------------------------------------
+TEST(blobs, joinBoxes) {
+	testRandom random(23);
+	for (int n = 0; n < 200; n++){
+		int x0[BLOB_LIST_SIZE], y0[BLOB_LIST_SIZE], x1[BLOB_LIST_SIZE], y1[BLOB_LIST_SIZE];
+		int count = random.range(0, BLOB_LIST_SIZE + 1);
+		std::vector<unsigned char> covered(width*height, 0);
+		for (int i = 0; i < count; i++){
+			x0[i] = random.range(0, width - 1);
+			y0[i] = random.range(0, height - 1);
+			x1[i] = random.range(x0[i] + 1, std::min(x0[i] + 200, width) + 1);
+			y1[i] = random.range(y0[i] + 1, std::min(y0[i] + 200, height) + 1);
+			for (int y = y0[i]; y < y1[i]; y++)
+				memset(&covered[y*width + x0[i]], 1, x1[i] - x0[i]);
+		}
+		int joined = joinBoxes(x0, y0, x1, y1, count);
+		CHECK(joined <= count);
+		// no two overlap, and together they still cover every box
+		bool apart = true;
+		for (int i = 0; i < joined; i++){
+			for (int j = i + 1; j < joined; j++)
+				apart = apart && (x0[i] >= x1[j] || x0[j] >= x1[i] || y0[i] >= y1[j] || y0[j] >= y1[i]);
+			for (int y = y0[i]; y < y1[i]; y++)
+				memset(&covered[y*width + x0[i]], 0, x1[i] - x0[i]);
+		}
+		CHECK(apart);
+		CHECK(std::count(covered.begin(), covered.end(), 1) == 0);
+	}
+}
+
+//--------------------------------------------------------------
+TEST(blobs, windowedMaskRows) {
+	// Masking the frame in two calls split inside a row of tiles comes
+	// out the same as one call, as the windows shrink and grow again
+	testRandom random(24);
+	std::vector<unsigned short> depth(width*height), limits(width*height, 2047);
+	std::vector<unsigned char> whole(width*height, 0), split(width*height, 0);
+	tileSegmenter a, b;
+	a.setup(width, height);
+	b.setup(width, height);
+	int splitRow = 200;
+	for (int frame = 0; frame < 12; frame++){
+		for (int i = 0; i < width*height; i++)
+			depth[i] = random.range(0, 8) == 0 ? 2047 : random.range(500, 900);
+		int x0 = random.range(0, width - 100), y0 = random.range(0, height - 100);
+		int x1 = x0 + 100, y1 = y0 + 100;
+		if (frame % 3 == 0) {
+			a.clearWindows();
+			b.clearWindows();
+		} else {
+			a.setWindows(&x0, &y0, &x1, &y1, 1);
+			b.setWindows(&x0, &y0, &x1, &y1, 1);
+		}
+		a.update(&depth[0]);
+		b.update(&depth[0]);
+		a.mask(&limits[0], &whole[0], 3000);
+		b.mask(&limits[0], &split[0], 3000, 0, splitRow);
+		b.mask(&limits[0], &split[0], 3000, splitRow, -1);
+		CHECK(whole == split);
+
+		if (frame % 3 != 0) {
+			// and nothing is left outside the window's tiles
+			bool cleared = true;
+			for (int y = 0; y < height; y++){
+				for (int x = 0; x < width; x++){
+					bool inside = x >= x0 / 32 * 32 && x < (x1 + 31) / 32 * 32 && y >= y0 / 32 * 32 && y < (y1 + 31) / 32 * 32;
+					cleared = cleared && (inside || split[y*width + x] == 0);
+				}
+			}
+			CHECK(cleared);
+		}
+	}
+}
@@ -0,0 +1,241 @@
+#include <string.h>
+#include <vector>
+
+#include "testing.h"
+#include "depthMask.h"
+#include "depthFilter.h"
+#include "rgbaPack.h"
+#include "backgroundModel.h"
+#include "depthRegistration.h"
+#include "depthReprojector.h"
+#include "threadPool.h"
+
+// The vectorized kernels against their plain C references, on random
+// data. Counts and widths go through every remainder the vector loops can
+// leave, and the pointers are offset so the loads aren't aligned either.
+
+// widths and heights that aren't multiples of any vector size
+static const int sizes[][2] = { {1, 1}, {7, 3}, {17, 9}, {31, 5}, {33, 17}, {64, 2}, {97, 13}, {640, 4} };
+static const int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+
+//--------------------------------------------------------------
+static void randomDepth(testRandom & random, unsigned short * depth, int count) {
+	// mostly a surface around 1 to 2 meters, with some dropouts
+	for (int i = 0; i < count; i++)
+		depth[i] = random.range(0, 10) == 0 ? 2047 : random.range(500, 1050);
+}
+
+//--------------------------------------------------------------
+TEST(kernels, depthMask) {
+	testRandom random(11);
+	std::vector<unsigned short> depth(1000), limits(1000);
+	std::vector<unsigned char> fast(1000), slow(1000);
+	for (int count = 0; count <= 80; count++){
+		for (int offset = 0; offset < 3; offset++){
+			randomDepth(random, &depth[0], (int) depth.size());
+			for (size_t i = 0; i < limits.size(); i++)
+				limits[i] = random.range(0, 2048);
+			unsigned short cutoff = random.range(0, 2048);
+			unsigned short closest = offset == 2 ? random.range(0, 1000) : 0;
+			depthMask(&depth[offset], &limits[offset], &fast[offset], count, cutoff, closest);
+			depthMaskScalar(&depth[offset], &limits[offset], &slow[offset], count, cutoff, closest);
+			CHECK(memcmp(&fast[offset], &slow[offset], count) == 0);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+TEST(kernels, rgbaPack) {
+	testRandom random(12);
+	std::vector<unsigned char> rgb(3000), alpha(1000), fast(4000), slow(4000);
+	for (int count = 0; count <= 80; count++){
+		for (int premultiply = 0; premultiply < 2; premultiply++){
+			for (size_t i = 0; i < rgb.size(); i++)
+				rgb[i] = random.next();
+			// all of 0, 255 and the values in between
+			for (size_t i = 0; i < alpha.size(); i++)
+				alpha[i] = random.range(0, 3) == 0 ? random.next() : (random.next() & 1) * 255;
+			int offset = count % 5;
+			memset(&fast[0], 0, fast.size());
+			memset(&slow[0], 0, slow.size());
+			rgbaPack(&rgb[offset*3], &alpha[offset], &fast[offset*4], count, premultiply != 0);
+			rgbaPackScalar(&rgb[offset*3], &alpha[offset], &slow[offset*4], count, premultiply != 0);
+			CHECK(fast == slow);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+TEST(kernels, depthClose) {
+	testRandom random(13);
+	static const int kernels[][2] = { {1, 1}, {3, 3}, {5, 5}, {3, 5}, {7, 3} };
+	for (int s = 0; s < sizeCount; s++){
+		int width = sizes[s][0], height = sizes[s][1];
+		std::vector<unsigned short> src(width*height), fast(width*height), slow(width*height);
+		for (int k = 0; k < 5; k++){
+			randomDepth(random, &src[0], width*height);
+			depthFilter filter;
+			filter.setKernel(kernels[k][0], kernels[k][1]);
+			filter.close(&src[0], &fast[0], width, height);
+			depthCloseScalar(&src[0], &slow[0], width, height, kernels[k][0], kernels[k][1]);
+			CHECK(fast == slow);
+
+			// a rectangle of the frame comes out the same as that part of the
+			// whole frame, and nothing outside it is touched
+			int x0 = random.range(0, width), x1 = random.range(x0 + 1, width + 1);
+			int y0 = random.range(0, height), y1 = random.range(y0 + 1, height + 1);
+			std::vector<unsigned short> part(width*height, 4000);
+			filter.close(&src[0], &part[0], width, height, x0, y0, x1, y1);
+			bool same = true;
+			for (int y = 0; y < height; y++){
+				for (int x = 0; x < width; x++){
+					bool inside = x >= x0 && x < x1 && y >= y0 && y < y1;
+					same = same && part[y*width + x] == (inside ? slow[y*width + x] : 4000);
+				}
+			}
+			CHECK(same);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+TEST(kernels, backgroundModel) {
+	testRandom random(14);
+	for (int s = 0; s < sizeCount; s++){
+		int width = sizes[s][0], height = sizes[s][1], count = width*height;
+		std::vector<unsigned short> depth(count);
+		randomDepth(random, &depth[0], count);
+		backgroundModel fast, slow;
+		fast.setup(width, height);
+		slow.setup(width, height);
+		fast.learn(&depth[0]);
+		slow.learn(&depth[0]);
+
+		std::vector<unsigned short> background(depth);
+		for (int frame = 0; frame < 30; frame++){
+			// the background flickering by a few steps, with things coming
+			// in front of it and dropping out
+			for (int i = 0; i < count; i++){
+				int r = random.range(0, 20);
+				if (r == 0)
+					depth[i] = 2047;
+				else if (r == 1)
+					depth[i] = random.range(400, 700);
+				else
+					depth[i] = background[i] == 2047 ? random.range(500, 1050) : background[i] + random.range(-4, 5);
+			}
+			// the whole frame, or a run of it that starts and ends anywhere
+			int start = frame % 2 == 0 ? 0 : random.range(0, count);
+			int length = frame % 2 == 0 ? count : random.range(0, count - start + 1);
+			fast.update(&depth[0], start, length);
+			slow.updateScalar(&depth[0], start, length);
+		}
+		// bit for bit, see backgroundModel.h
+		CHECK(memcmp(fast.getMean(), slow.getMean(), count * sizeof(float)) == 0);
+		CHECK(memcmp(fast.getVariance(), slow.getVariance(), count * sizeof(float)) == 0);
+		CHECK(memcmp(fast.getLimits(), slow.getLimits(), count * sizeof(unsigned short)) == 0);
+	}
+}
+
+//--------------------------------------------------------------
+TEST(kernels, depthRegistration) {
+	testRandom random(15);
+	for (int s = 0; s < sizeCount; s++){
+		int width = sizes[s][0], height = sizes[s][1], count = width*height;
+		std::vector<unsigned short> depth(count);
+		std::vector<unsigned char> rgb(count*3), fast(count*3), slow(count*3);
+		depthRegistration registration;
+		registration.setup(width, height);
+		for (int pass = 0; pass < 3; pass++){
+			randomDepth(random, &depth[0], count);
+			for (int i = 0; i < count*3; i++)
+				rgb[i] = random.next();
+			registration.setColorOffset(random.range(-20, 21), random.range(-20, 21));
+			registration.update();
+			// whole frames, then strips of rows
+			int y0 = pass == 0 ? 0 : random.range(0, height), y1 = pass == 0 ? -1 : random.range(y0, height + 1);
+			memset(&fast[0], 1, fast.size());
+			memset(&slow[0], 1, slow.size());
+			registration.apply(&depth[0], &rgb[0], &fast[0], y0, y1);
+			registration.applyScalar(&depth[0], &rgb[0], &slow[0], y0, y1);
+			CHECK(fast == slow);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+TEST(kernels, reprojectIdentity) {
+	// From where the kinect is nothing moves, so the output is the
+	// masked input
+	testRandom random(16);
+	int width = 97, height = 61, count = width*height;
+	std::vector<unsigned short> depth(count);
+	std::vector<unsigned char> mask(count), rgb(count*3);
+	randomDepth(random, &depth[0], count);
+	for (int i = 0; i < count; i++){
+		mask[i] = depth[i] < 2047 && random.range(0, 3) > 0 ? 255 : 0;
+		rgb[i*3] = random.next();
+		rgb[i*3 + 1] = random.next();
+		rgb[i*3 + 2] = random.next();
+	}
+	depthReprojector reprojector;
+	reprojector.setup(width, height);
+	reprojector.setViewpoint(0, 0, 1);
+	reprojector.update(&depth[0], &mask[0], &rgb[0]);
+
+	bool same = true;
+	for (int i = 0; i < count && same; i++){
+		if (mask[i])
+			same = reprojector.getAlpha()[i] == 255 && memcmp(reprojector.getColor() + i*3, &rgb[i*3], 3) == 0;
+	}
+	CHECK(same);
+	int masked = 0;
+	for (int i = 0; i < count; i++)
+		masked += mask[i] ? 1 : 0;
+	CHECK(reprojector.getWarpedCount() == masked);
+}
+
+//--------------------------------------------------------------
+TEST(kernels, reprojectThreads) {
+	// The strips come out exactly the same on a pool as on one thread
+	testRandom random(17);
+	int width = 160, height = 120, count = width*height;
+	std::vector<unsigned short> depth(count);
+	std::vector<unsigned char> mask(count), rgb(count*3);
+	// a few blobs at different depths in front of nothing
+	for (int i = 0; i < count; i++)
+		depth[i] = 2047;
+	for (int b = 0; b < 6; b++){
+		int cx = random.range(0, width), cy = random.range(0, height), r = random.range(5, 30);
+		unsigned short z = random.range(500, 900);
+		for (int y = cy - r; y < cy + r; y++){
+			for (int x = cx - r; x < cx + r; x++){
+				if (x >= 0 && y >= 0 && x < width && y < height && (x - cx)*(x - cx) + (y - cy)*(y - cy) < r*r)
+					depth[y*width + x] = z + random.range(0, 8);
+			}
+		}
+	}
+	for (int i = 0; i < count; i++){
+		mask[i] = depth[i] < 2047 ? 255 : 0;
+		rgb[i*3] = rgb[i*3 + 1] = rgb[i*3 + 2] = random.next();
+	}
+
+	threadPool pool;
+	pool.setup(3);
+	depthReprojector serial, pooled;
+	serial.setup(width, height);
+	pooled.setup(width, height);
+	pooled.setPool(&pool);
+	for (int view = 0; view < 4; view++){
+		float x = random.range(-300, 301) / 1000.0f, y = random.range(-300, 301) / 1000.0f;
+		serial.setViewpoint(x, y, 1.2f);
+		pooled.setViewpoint(x, y, 1.2f);
+		serial.update(&depth[0], &mask[0], &rgb[0]);
+		pooled.update(&depth[0], &mask[0], &rgb[0]);
+		CHECK(memcmp(serial.getColor(), pooled.getColor(), count*3) == 0);
+		CHECK(memcmp(serial.getAlpha(), pooled.getAlpha(), count) == 0);
+		CHECK(serial.getWarpedCount() == pooled.getWarpedCount());
+		CHECK(serial.getFilledCount() == pooled.getFilledCount());
+	}
+	pool.stop();
+}
@@ -0,0 +1,15 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "testing.h"
+
+//--------------------------------------------------------------
+int main(int argc, char ** argv) {
+	if (argc > 1 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)) {
+		printf("usage: kinect-tests [group...]\n"
+			   "  runs the tests in the groups given, or all of them: kernels, blobs,\n"
+			   "  tracking, threading\n");
+		return 0;
+	}
+	return runTests(argc - 1, argv + 1) == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include "testing.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+struct testCase {
+	const char * group;
+	const char * name;
+	testFunction function;
+};
+
+// Made on first use, as the registrars run during static initialisation
+// in whatever order the files are linked
+static std::vector<testCase> & testCases() {
+	static std::vector<testCase> cases;
+	return cases;
+}
+
+static int checks = 0;
+static int failures = 0;
+
+//--------------------------------------------------------------
+testRegistrar::testRegistrar(const char * group, const char * name, testFunction function) {
+	testCase test;
+	test.group = group;
+	test.name = name;
+	test.function = function;
+	testCases().push_back(test);
+}
+
+//--------------------------------------------------------------
+bool testCheck(bool ok, const char * what, const char * file, int line) {
+	checks++;
+	if (!ok) {
+		failures++;
+		printf("    %s:%d: CHECK(%s) failed\n", file, line, what);
+	}
+	return ok;
+}
+
+//--------------------------------------------------------------
+static bool wanted(const char * group, int groupCount, char ** groups) {
+	if (groupCount == 0)
+		return true;
+	for (int i = 0; i < groupCount; i++){
+		if (strcmp(groups[i], group) == 0)
+			return true;
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+int runTests(int groupCount, char ** groups) {
+	std::vector<testCase> & cases = testCases();
+	int run = 0, failed = 0;
+	for (size_t i = 0; i < cases.size(); i++){
+		if (!wanted(cases[i].group, groupCount, groups))
+			continue;
+		checks = 0;
+		failures = 0;
+		cases[i].function();
+		run++;
+		if (failures > 0)
+			failed++;
+		printf("%-8s %s.%s (%d checks)\n", failures > 0 ? "FAILED" : "ok", cases[i].group, cases[i].name, checks);
+	}
+	if (run == 0) {
+		printf("no tests in the groups given\n");
+		return 1;
+	}
+	printf("%d of %d tests passed\n", run - failed, run);
+	return failed;
+}
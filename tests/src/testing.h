@@ -0,0 +1,64 @@
+#ifndef _TESTING
+#define _TESTING
+
+// A very small test harness, so the tests need nothing beyond the
+// standard library, like the benchmark. Tests are declared with
+//
+//   TEST(group, name) {
+//       CHECK(a == b);
+//   }
+//
+// anywhere in a .cpp file, and kinect-tests runs every group, or the
+// groups named on the command line. A failed CHECK prints where it was
+// and carries on, so one run shows everything that is wrong.
+
+typedef void (*testFunction)();
+
+// Adds a test to the list kinect-tests runs, see TEST()
+class testRegistrar {
+
+	public:
+		testRegistrar(const char * group, const char * name, testFunction function);
+};
+
+#define TEST(group, name) \
+	static void group##_##name(); \
+	static testRegistrar group##_##name##_registrar(#group, #name, group##_##name); \
+	static void group##_##name()
+
+// Counts the check against the running test, and prints it if it failed.
+// Returns ok, so a test can stop early when nothing after it makes sense.
+bool testCheck(bool ok, const char * what, const char * file, int line);
+
+#define CHECK(condition) testCheck((condition) ? true : false, #condition, __FILE__, __LINE__)
+
+// Runs the tests in the groups given (all of them for none), returns the
+// number of tests that failed
+int runTests(int groupCount, char ** groups);
+
+// The same pseudo random numbers everywhere (xorshift), unlike rand(), so
+// a failure can be reproduced on any machine
+class testRandom {
+
+	public:
+		testRandom(unsigned int seed = 1) {
+			state = seed != 0 ? seed : 1;
+		}
+
+		unsigned int next() {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		// lo to hi-1
+		int range(int lo, int hi) {
+			return lo + (int) (next() % (unsigned int) (hi - lo));
+		}
+
+	private:
+		unsigned int state;
+};
+
+#endif
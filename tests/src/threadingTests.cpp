@@ -0,0 +1,290 @@
+#include <string.h>
+#include <sched.h>
+#include <vector>
+
+#include "testing.h"
+#include "tripleBuffer.h"
+#include "lockFreeQueue.h"
+#include "frameBufferPool.h"
+#include "stageGraph.h"
+#include "threadPool.h"
+#include "workerThread.h"
+
+// The hand overs between threads: the triple buffer, the lock free queue
+// and the pool's shared frames, plus the stage graph's ordering.
+
+//--------------------------------------------------------------
+// A result big enough that a torn read would show
+struct countedResult {
+	int values[64];
+};
+
+class resultProducer : public workerThread {
+
+	public:
+		tripleBuffer<countedResult> * results;
+		int count;
+
+	protected:
+		void threadedFunction() {
+			for (int n = 1; n <= count; n++){
+				countedResult & result = results->getWriteBuffer();
+				for (int i = 0; i < 64; i++)
+					result.values[i] = n;
+				results->publish();
+			}
+		}
+};
+
+//--------------------------------------------------------------
+TEST(threading, tripleBuffer) {
+	// Every buffer the consumer swaps in is whole, never older than the
+	// one before, and the last one published is always seen in the end
+	tripleBuffer<countedResult> results;
+	for (int b = 0; b < 3; b++)
+		memset(&results.getBuffer(b), 0, sizeof(countedResult));
+	resultProducer producer;
+	producer.results = &results;
+	producer.count = 200000;
+	producer.startThread();
+
+	int last = 0, swaps = 0;
+	bool whole = true, ordered = true;
+	while (last < producer.count) {
+		if (!results.update()) {
+			sched_yield();
+			continue;
+		}
+		countedResult & result = results.getReadBuffer();
+		for (int i = 1; i < 64; i++)
+			whole = whole && result.values[i] == result.values[0];
+		ordered = ordered && result.values[0] > last;
+		last = result.values[0];
+		swaps++;
+	}
+	producer.stopThread();
+	CHECK(whole);
+	CHECK(ordered);
+	CHECK(last == producer.count);
+	CHECK(!results.update());
+	CHECK(swaps > 0);
+}
+
+//--------------------------------------------------------------
+class queueProducer : public workerThread {
+
+	public:
+		lockFreeQueue<int, 64> * queue;
+		int count;
+
+	protected:
+		void threadedFunction() {
+			for (int n = 0; n < count; n++){
+				// waits for room when the queue is full
+				while (!queue->push(n))
+					sched_yield();
+			}
+		}
+};
+
+//--------------------------------------------------------------
+TEST(threading, lockFreeQueue) {
+	lockFreeQueue<int, 64> queue;
+	// full at SIZE, and empty again in the same order
+	for (int n = 0; n < 64; n++)
+		CHECK(queue.push(n));
+	CHECK(!queue.push(64));
+	int item = -1;
+	bool inOrder = true;
+	for (int n = 0; n < 64; n++)
+		inOrder = inOrder && queue.pop(item) && item == n;
+	CHECK(inOrder);
+	CHECK(queue.empty());
+	CHECK(!queue.pop(item));
+
+	// and across two threads nothing is lost, doubled or reordered
+	queueProducer producer;
+	producer.queue = &queue;
+	producer.count = 500000;
+	producer.startThread();
+	int next = 0;
+	inOrder = true;
+	while (next < producer.count) {
+		if (queue.pop(item)) {
+			inOrder = inOrder && item == next;
+			next++;
+		} else {
+			sched_yield();
+		}
+	}
+	producer.stopThread();
+	CHECK(inOrder);
+	CHECK(queue.empty());
+}
+
+//--------------------------------------------------------------
+TEST(threading, copyOnWrite) {
+	frameBufferPool pool;
+	frameBuffer a = pool.acquire(1000);
+	CHECK(!a.isEmpty());
+	CHECK(a.getSize() == 1000);
+	CHECK(!a.isShared());
+	memset(a.write(), 7, 1000);
+
+	// copying a handle shares the pixels
+	unsigned long long copied = pool.getBytesCopied(), shared = pool.getBytesShared();
+	frameBuffer b = a;
+	CHECK(a.isShared() && b.isShared());
+	CHECK(a.read() == b.read());
+	CHECK(pool.getBytesCopied() == copied);
+	CHECK(pool.getBytesShared() == shared + 1000);
+
+	// writing to shared pixels copies them first, and the other handle
+	// keeps seeing what they were
+	unsigned char * pixels = b.write();
+	CHECK(pixels != a.read());
+	CHECK(pixels[0] == 7 && pixels[999] == 7);
+	memset(pixels, 9, 1000);
+	CHECK(a.read()[0] == 7);
+	CHECK(!a.isShared() && !b.isShared());
+	CHECK(pool.getBytesCopied() == copied + 1000);
+	// and writing again doesn't
+	CHECK(b.write() == pixels);
+	CHECK(pool.getBytesCopied() == copied + 1000);
+
+	// overwrite() doesn't copy shared pixels at all
+	frameBuffer c = a;
+	unsigned char * fresh = c.overwrite();
+	CHECK(fresh != a.read());
+	CHECK(pool.getBytesCopied() == copied + 1000);
+	CHECK(a.read()[0] == 7);
+
+	// blocks go back to the pool and are handed out again
+	int blocks = pool.getBlockCount();
+	const unsigned char * old = c.read();
+	c.release();
+	CHECK(c.isEmpty());
+	CHECK(c.read() == NULL);
+	frameBuffer d = pool.acquire(1000);
+	CHECK(d.read() == old);
+	CHECK(pool.getBlockCount() == blocks);
+
+	// assigning a handle lets go of what it held
+	d = a;
+	CHECK(d.read() == a.read());
+	frameBuffer e = pool.acquire(1000);
+	CHECK(e.read() == old);
+	CHECK(pool.getBlockCount() == blocks);
+}
+
+//--------------------------------------------------------------
+class bufferSharer : public workerThread {
+
+	public:
+		frameBuffer source;
+		int rounds;
+
+	protected:
+		void threadedFunction() {
+			for (int n = 0; n < rounds; n++){
+				frameBuffer mine = source;
+				frameBuffer other;
+				other = mine;
+				// a copy of its own, which goes back to the pool
+				other.write()[0] = (unsigned char) n;
+			}
+		}
+};
+
+//--------------------------------------------------------------
+TEST(threading, sharedAcrossThreads) {
+	// Handles to the same pixels taken and dropped on several threads at
+	// once: the counts stay right, so the pixels are never recycled from
+	// under anyone and every copy goes back to the pool
+	frameBufferPool pool;
+	frameBuffer source = pool.acquire(4096);
+	memset(source.write(), 3, 4096);
+	bufferSharer sharers[4];
+	for (int t = 0; t < 4; t++){
+		sharers[t].source = source;
+		sharers[t].rounds = 20000;
+	}
+	for (int t = 0; t < 4; t++)
+		sharers[t].startThread();
+	for (int t = 0; t < 4; t++)
+		sharers[t].stopThread();
+	for (int t = 0; t < 4; t++){
+		CHECK(sharers[t].source.read() == source.read());
+		sharers[t].source.release();
+	}
+	CHECK(!source.isShared());
+	CHECK(source.read()[0] == 3 && source.read()[4095] == 3);
+	// at most the source and one copy per thread were ever out at once
+	CHECK(pool.getBlockCount() <= 5);
+	CHECK(pool.getBytesCopied() == 4ULL * 20000 * 4096);
+}
+
+//--------------------------------------------------------------
+class orderRecorder {
+
+	public:
+		orderRecorder() {
+			next = 0;
+			for (int i = 0; i < 6; i++)
+				order[i] = -1;
+		}
+
+		void done(int stage) {
+			order[stage] = __sync_fetch_and_add(&next, 1);
+		}
+
+		void a() { done(0); }
+		void b() { done(1); }
+		void c() { done(2); }
+		void d() { done(3); }
+		void e() { done(4); }
+		void f() { done(5); }
+
+		volatile int next;
+		int order[6];
+};
+
+//--------------------------------------------------------------
+TEST(threading, stageGraph) {
+	// Every stage runs once, after the stages it waits for, on a pool or
+	// not, and the timings stay the same size however many runs there are
+	threadPool pool;
+	pool.setup(3);
+	for (int serial = 0; serial < 2; serial++){
+		orderRecorder recorder;
+		stageGraph graph;
+		graph.setup(&pool);
+		graph.setSerial(serial != 0);
+		int a = graph.addStage("a", &recorder, &orderRecorder::a);
+		int b = graph.addStage("b", &recorder, &orderRecorder::b);
+		int c = graph.addStage("c", &recorder, &orderRecorder::c, a);
+		int d = graph.addStage("d", &recorder, &orderRecorder::d, a, b);
+		int e = graph.addStage("e", &recorder, &orderRecorder::e, c);
+		int f = graph.addStage("f", &recorder, &orderRecorder::f, d, e);
+		graph.addDependency(f, b);
+
+		bool ordered = true;
+		for (int run = 0; run < 1000; run++){
+			recorder.next = 0;
+			graph.run();
+			int * o = recorder.order;
+			ordered = ordered && recorder.next == 6 &&
+				o[c] > o[a] && o[d] > o[a] && o[d] > o[b] && o[e] > o[c] && o[f] > o[d] && o[f] > o[e];
+		}
+		CHECK(ordered);
+		// timed into the histograms, but no samples kept without sampling
+		CHECK(graph.getTimings()[f].getCount() == 1000);
+		CHECK(graph.getStats()[f].getCount() == 0);
+		graph.setSampling(true);
+		graph.run();
+		CHECK(graph.getStats()[f].getCount() == 1);
+		graph.clearStats();
+		CHECK(graph.getTimings()[f].getCount() == 0);
+	}
+	pool.stop();
+}
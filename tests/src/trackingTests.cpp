@@ -0,0 +1,264 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "testing.h"
+#include "blobTracker.h"
+#include "gestureRules.h"
+#include "eventSink.h"
+
+// blobTracker on synthetic hands, and mkart's steering from the tracks
+// through gestureRules and the eventDispatcher into a recordingEventSink.
+
+//--------------------------------------------------------------
+static void addBlob(blobList & blobs, float x, float y, float depth) {
+	int i = blobs.count++;
+	blobs.area[i] = 3000;
+	blobs.centroidX[i] = x;
+	blobs.centroidY[i] = y;
+	blobs.minX[i] = (int) x - 30;
+	blobs.minY[i] = (int) y - 30;
+	blobs.maxX[i] = (int) x + 30;
+	blobs.maxY[i] = (int) y + 30;
+	blobs.depth[i] = depth;
+	blobs.depthVariance[i] = 4;
+}
+
+//--------------------------------------------------------------
+TEST(tracking, kalmanPath) {
+	// One hand moving at a steady 90, -45 pixels per second with a pixel
+	// or two of jitter. The filter should settle on that velocity (on
+	// average, it is tuned to follow hands that change speed quickly) and
+	// stay closer to the true path than the raw blobs do.
+	testRandom random(31);
+	blobTracker tracker;
+	float dt = 1 / 30.0f;
+	float vx = 90, vy = -45;
+	int id = -1;
+	float rawError = 0, trackError = 0;
+	float sumVx = 0, sumVy = 0;
+	for (int frame = 0; frame < 90; frame++){
+		float x = 100 + vx * frame * dt, y = 300 + vy * frame * dt;
+		float jx = random.range(-20, 21) / 10.0f, jy = random.range(-20, 21) / 10.0f;
+		blobList blobs;
+		blobs.count = 0;
+		addBlob(blobs, x + jx, y + jy, 800);
+		tracker.update(blobs, dt);
+
+		trackList & tracks = tracker.getTracks();
+		if (!CHECK(tracks.count == 1))
+			return;
+		if (frame == 0)
+			id = tracks.id[0];
+		CHECK(tracks.id[0] == id);
+		CHECK(tracks.blob[0] == 0);
+		if (frame >= 30) {
+			rawError += sqrtf(jx*jx + jy*jy);
+			trackError += sqrtf((tracks.x[0] - x)*(tracks.x[0] - x) + (tracks.y[0] - y)*(tracks.y[0] - y));
+			sumVx += tracks.vx[0];
+			sumVy += tracks.vy[0];
+		}
+	}
+	CHECK(fabsf(sumVx / 60 - vx) < 10);
+	CHECK(fabsf(sumVy / 60 - vy) < 10);
+	CHECK(trackError < rawError);
+
+	// predict() runs the path on, a frame or two ahead like mkart's lead
+	float px, py, pz;
+	tracker.predict(0, 0.05f, px, py, pz);
+	float x = 100 + vx * 89 * dt, y = 300 + vy * 89 * dt;
+	CHECK(fabsf(px - (x + vx * 0.05f)) < 5);
+	CHECK(fabsf(py - (y + vy * 0.05f)) < 5);
+	CHECK(fabsf(pz - 800) < 2);
+}
+
+//--------------------------------------------------------------
+TEST(tracking, idsFollowBlobs) {
+	// Two hands moving towards each other, with the blobs coming in a
+	// different order every frame, keep their ids
+	blobTracker tracker;
+	float dt = 1 / 30.0f;
+	int leftId = -1, rightId = -1;
+	for (int frame = 0; frame < 40; frame++){
+		float left = 100 + frame * 3, right = 500 - frame * 3;
+		blobList blobs;
+		blobs.count = 0;
+		if (frame % 2 == 0) {
+			addBlob(blobs, left, 240, 800);
+			addBlob(blobs, right, 260, 820);
+		} else {
+			addBlob(blobs, right, 260, 820);
+			addBlob(blobs, left, 240, 800);
+		}
+		tracker.update(blobs, dt);
+		trackList & tracks = tracker.getTracks();
+		if (!CHECK(tracks.count == 2))
+			return;
+		// oldest first, and both started together in blob order
+		int l = tracks.x[0] < tracks.x[1] ? 0 : 1;
+		if (frame == 0) {
+			leftId = tracks.id[l];
+			rightId = tracks.id[1 - l];
+		}
+		CHECK(tracks.id[l] == leftId);
+		CHECK(tracks.id[1 - l] == rightId);
+		CHECK(fabsf(blobs.centroidX[tracks.blob[l]] - left) < 0.01f);
+	}
+}
+
+//--------------------------------------------------------------
+TEST(tracking, coastAndDrop) {
+	// A hand that goes unseen coasts on its prediction for maxMisses
+	// frames, and is dropped after that
+	blobTracker tracker;
+	tracker.setMaxMisses(3);
+	float dt = 1 / 30.0f;
+	for (int frame = 0; frame < 20; frame++){
+		blobList blobs;
+		blobs.count = 0;
+		addBlob(blobs, 100 + frame * 4, 200, 800);
+		tracker.update(blobs, dt);
+	}
+	int id = tracker.getTracks().id[0];
+	float lastX = tracker.getTracks().x[0];
+	blobList none;
+	none.count = 0;
+	for (int miss = 1; miss <= 3; miss++){
+		tracker.update(none, dt);
+		trackList & tracks = tracker.getTracks();
+		if (!CHECK(tracks.count == 1))
+			return;
+		CHECK(tracks.id[0] == id);
+		CHECK(tracks.blob[0] == -1);
+		CHECK(tracks.misses[0] == miss);
+		// still moving right at about 120 pixels per second
+		CHECK(tracks.x[0] > lastX);
+		lastX = tracks.x[0];
+	}
+	tracker.update(none, dt);
+	CHECK(tracker.getTracks().count == 0);
+	CHECK(tracker.find(id) == -1);
+
+	// and a hand seen again starts a new track, with a new id
+	blobList blobs;
+	blobs.count = 0;
+	addBlob(blobs, 200, 200, 800);
+	tracker.update(blobs, dt);
+	CHECK(tracker.getTracks().count == 1);
+	CHECK(tracker.getTracks().id[0] != id);
+}
+
+//--------------------------------------------------------------
+// Runs mkart's steering for one frame: the features from the tracks, the
+// rules, and only the keys that changed posted to the dispatcher
+static unsigned int steer(blobTracker & tracker, gestureRules & rules, eventDispatcher & keys, unsigned int keysDown,
+						  float leftY, float rightY, int feet, unsigned long long now) {
+	blobList blobs;
+	blobs.count = 0;
+	addBlob(blobs, 200, leftY, 800);
+	addBlob(blobs, 440, rightY, 800);
+	tracker.update(blobs, 1 / 30.0f);
+
+	float features[GESTURE_FEATURE_COUNT];
+	gestureFeatures(tracker, feet, 0, features);
+	unsigned int down = rules.evaluate(features, now);
+	unsigned int changed = down ^ keysDown;
+	for (int k = 0; k < INPUT_KEY_COUNT; k++){
+		if (changed & (1 << k))
+			keys.post(k, (down & (1 << k)) != 0, now);
+	}
+	return down;
+}
+
+//--------------------------------------------------------------
+TEST(tracking, gestureKeys) {
+	gestureRules rules;
+	CHECK(rules.parse(GESTURE_RULES_DEFAULT));
+	CHECK(rules.getRuleCount() == 3);
+	// a line that doesn't parse keeps the old rules
+	CHECK(!rules.parse("hand_dy << -50 -45 0 left\n"));
+	CHECK(rules.getRuleCount() == 3);
+
+	recordingEventSink sink;
+	eventDispatcher keys;
+	keys.setup(&sink);
+	keys.startThread();
+	blobTracker tracker;
+	// the tracker smooths, so every position is held for a few frames
+	unsigned int down = 0;
+	unsigned long long now = 0;
+	struct step {
+		float leftY, rightY;
+		int feet;
+	} steps[] = {
+		{ 240, 240, 0 },   // level
+		{ 180, 300, 0 },   // turned left
+		{ 170, 310, 0 },   // turned further, still left
+		{ 240, 240, 0 },   // level again
+		{ 300, 180, 1 },   // turned right, with a foot down
+		{ 240, 240, 0 },   // and everything back up
+	};
+	unsigned int expected[] = {
+		0,
+		1u << INPUT_KEY_LEFT,
+		1u << INPUT_KEY_LEFT,
+		0,
+		(1u << INPUT_KEY_RIGHT) | (1u << INPUT_KEY_Z),
+		0,
+	};
+	for (int s = 0; s < 6; s++){
+		for (int frame = 0; frame < 30; frame++){
+			now += 33333;
+			down = steer(tracker, rules, keys, down, steps[s].leftY, steps[s].rightY, steps[s].feet, now);
+		}
+		CHECK(down == expected[s]);
+	}
+	// the same key posted again changes nothing, and isn't sent
+	keys.post(INPUT_KEY_LEFT, false, now);
+	keys.stopThread();
+
+	std::vector<keyEvent> events = sink.getEvents();
+	int sent[][2] = {
+		{ INPUT_KEY_LEFT, 1 }, { INPUT_KEY_LEFT, 0 },
+		{ INPUT_KEY_RIGHT, 1 }, { INPUT_KEY_Z, 1 },
+		{ INPUT_KEY_RIGHT, 0 }, { INPUT_KEY_Z, 0 },
+	};
+	if (CHECK(events.size() == 6)) {
+		for (int i = 0; i < 6; i++){
+			// right and z go down (and up) in the same frame, in key order
+			CHECK(events[i].key == sent[i][0]);
+			CHECK(events[i].down == (sent[i][1] != 0));
+		}
+		for (size_t i = 1; i < events.size(); i++)
+			CHECK(events[i].timestamp >= events[i-1].timestamp);
+	}
+	CHECK(keys.getCoalescedCount() == 1);
+	CHECK(!keys.isDown(INPUT_KEY_LEFT));
+}
+
+//--------------------------------------------------------------
+TEST(tracking, gestureHold) {
+	// A key only goes down once its rule has held for holdMs, and NaN
+	// (fewer than two hands) never matches
+	gestureRules rules;
+	CHECK(rules.parse("hand_distance > 100 80 200 up   # hands apart for 200ms\n"));
+	float features[GESTURE_FEATURE_COUNT];
+	for (int f = 0; f < GESTURE_FEATURE_COUNT; f++)
+		features[f] = NAN;
+	CHECK(rules.evaluate(features, 0) == 0);
+
+	features[GESTURE_HAND_DISTANCE] = 150;
+	CHECK(rules.evaluate(features, 1000000) == 0);
+	CHECK(rules.evaluate(features, 1100000) == 0);
+	CHECK(rules.evaluate(features, 1200000) == 1u << INPUT_KEY_UP);
+	// held down while over off, let go under it
+	features[GESTURE_HAND_DISTANCE] = 90;
+	CHECK(rules.evaluate(features, 1300000) == 1u << INPUT_KEY_UP);
+	features[GESTURE_HAND_DISTANCE] = 70;
+	CHECK(rules.evaluate(features, 1400000) == 0);
+	// and the hold starts over
+	features[GESTURE_HAND_DISTANCE] = 150;
+	CHECK(rules.evaluate(features, 1500000) == 0);
+	features[GESTURE_HAND_DISTANCE] = NAN;
+	CHECK(rules.evaluate(features, 1800000) == 0);
+}